@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "budget.h"
+
+#include <glib.h>
+
+struct budget
+{
+    guint64         limit;             /* bytes that can be admitted */
+    guint64         used;              /* bytes admitted now */
+    guint64         next_ticket;       /* ticket of the next job asking */
+    guint64         serving;           /* ticket of the job admitted next */
+    GMutex          mutex;             /* protects the fields above */
+    GCond           released;          /* signalled when bytes are freed
+                                        * or the next ticket is served */
+};
+
+
+
+struct budget *
+budget_new(guint64 limit)
+{
+    struct budget *budget;
+
+    budget = g_new0(struct budget, 1);
+    budget->limit = limit;
+    g_mutex_init(&budget->mutex);
+    g_cond_init(&budget->released);
+
+    return budget;
+}
+
+
+
+void
+budget_free(struct budget *budget)
+{
+    if (budget == NULL)
+        return;
+
+    g_assert(budget->used == 0);
+
+    g_mutex_clear(&budget->mutex);
+    g_cond_clear(&budget->released);
+    g_free(budget);
+}
+
+
+
+guint64
+budget_get_limit(struct budget *budget)
+{
+    guint64 limit;
+
+    g_assert(budget != NULL);
+
+    g_mutex_lock(&budget->mutex);
+    limit = budget->limit;
+    g_mutex_unlock(&budget->mutex);
+
+    return limit;
+}
+
+
+
+void
+budget_set_limit(struct budget *budget, guint64 limit)
+{
+    g_assert(budget != NULL);
+
+    g_mutex_lock(&budget->mutex);
+
+    /* a larger budget may admit jobs waiting already */
+    budget->limit = limit;
+    g_cond_broadcast(&budget->released);
+
+    g_mutex_unlock(&budget->mutex);
+}
+
+
+
+void
+budget_acquire(struct budget *budget, guint64 amount)
+{
+    guint64 ticket;
+
+    g_assert(budget != NULL);
+
+    g_mutex_lock(&budget->mutex);
+
+    /* wait for the turn, and an oversized job until it can run alone */
+    ticket = budget->next_ticket++;
+    while (ticket != budget->serving ||
+           (budget->used > 0 && budget->used + amount > budget->limit)) {
+        g_cond_wait(&budget->released, &budget->mutex);
+    }
+    budget->used += amount;
+
+    /* the next job may fit too */
+    budget->serving++;
+    g_cond_broadcast(&budget->released);
+
+    g_mutex_unlock(&budget->mutex);
+}
+
+
+
+void
+budget_release(struct budget *budget, guint64 amount)
+{
+    g_assert(budget != NULL);
+
+    g_mutex_lock(&budget->mutex);
+
+    g_assert(budget->used >= amount);
+    budget->used -= amount;
+    g_cond_broadcast(&budget->released);
+
+    g_mutex_unlock(&budget->mutex);
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
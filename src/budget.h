@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#ifndef PWGALLERY_BUDGET_H
+#define PWGALLERY_BUDGET_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <glib.h>
+
+/*
+ * Admission of jobs by their memory use. A job waits until its
+ * estimated memory fits in the budget along with the jobs already
+ * admitted. A job larger than the whole budget is admitted alone.
+ * Jobs are admitted in the order they asked, so a large job is not
+ * passed by a stream of small ones.
+ */
+struct budget;
+
+/*
+ * Create a budget of the given number of bytes
+ */
+struct budget *budget_new(guint64 limit);
+
+/*
+ * Free a budget. Nothing may be admitted anymore.
+ */
+void budget_free(struct budget *budget);
+
+/*
+ * Get the number of bytes in the budget
+ */
+guint64 budget_get_limit(struct budget *budget);
+
+/*
+ * Change the number of bytes in the budget. The jobs admitted already
+ * keep their bytes.
+ */
+void budget_set_limit(struct budget *budget, guint64 limit);
+
+/*
+ * Wait until the jobs asking earlier are admitted and the given number
+ * of bytes fits in the budget, and take them
+ */
+void budget_acquire(struct budget *budget, guint64 amount);
+
+/*
+ * Give back bytes taken with budget_acquire
+ */
+void budget_release(struct budget *budget, guint64 amount);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
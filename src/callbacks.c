@@ -24,9 +24,13 @@
 #include "main.h"
 #include "callbacks.h"
 #include "widgets.h"
+#include "thumbview.h"
 #include "gallery.h"
 #include "image.h"
 #include "vfs.h"
+#include "model.h"
+#include "import.h"
+#include "make.h"
 
 #include <glib.h>
 #include <gtk/gtk.h>
@@ -49,7 +53,8 @@ static void action_gal_sort_by_time(gpointer user_data);
 static void action_gal_slide_show(gpointer user_data);
 static void action_image_add(gpointer user_data);
 static void action_image_edit(gpointer user_data);
-static void update_preview_cb(GtkFileChooser *file_chooser, gpointer data);
+static void update_preview_cb(GtkFileChooser *file_chooser,
+                              gpointer user_data);
 static void action_image_remove(gpointer user_data);
 static void action_about_show(gpointer user_data);
 static void action_image_move(gpointer user_data, gint place);
@@ -428,6 +433,30 @@ on_button_move_bottom_clicked(GtkButton *button, gpointer user_data)
 }
 
 
+
+void
+on_button_import_cancel_clicked(GtkButton *button, gpointer user_data)
+{
+    g_debug("in on_button_import_cancel_clicked");
+
+    g_assert(user_data != NULL);
+
+    import_cancel(user_data);
+}
+
+
+
+void
+on_button_make_cancel_clicked(GtkButton *button, gpointer user_data)
+{
+    g_debug("in on_button_make_cancel_clicked");
+
+    g_assert(user_data != NULL);
+
+    make_cancel(user_data);
+}
+
+
 /**********************************************************************
  * The actions functions. These are called from above wrappers.
  * CHECKME: the one-liners could be called directly..
@@ -689,7 +718,7 @@ static void action_image_add(gpointer user_data)
     gtk_file_chooser_set_preview_widget(GTK_FILE_CHOOSER(dialog), 
                                         GTK_WIDGET(preview));
     g_signal_connect(GTK_FILE_CHOOSER(dialog), "update-preview",
-                     G_CALLBACK(update_preview_cb), preview);
+                     G_CALLBACK(update_preview_cb), data);
 
     do {
         result = gtk_dialog_run(GTK_DIALOG(dialog));
@@ -715,31 +744,32 @@ static void action_image_add(gpointer user_data)
 
 
 
-static void update_preview_cb(GtkFileChooser *file_chooser, gpointer data)
+static void update_preview_cb(GtkFileChooser *file_chooser, gpointer user_data)
 {
+    struct data *data;
     GtkWidget *preview;
-    char *filename;
-    GdkPixbuf *pixbuf;
+    char *uri;
+    GdkPixbuf *pixbuf = NULL;
     gboolean have_preview;
     
     g_assert(file_chooser != NULL);
-    g_assert(data != NULL);
+    g_assert(user_data != NULL);
 
     g_debug("in update_preview_cb");
 
-    preview = GTK_WIDGET(data);
-    filename = gtk_file_chooser_get_preview_filename(file_chooser);
+    data = user_data;
+    preview = gtk_file_chooser_get_preview_widget(file_chooser);
+    uri = gtk_file_chooser_get_preview_uri(file_chooser);
     
-    if (filename == NULL)
+    if (uri == NULL)
         return;
 
-    pixbuf = gdk_pixbuf_new_from_file_at_size
-        (filename, 
-         PWGALLERY_PREVIEW_THUMBNAIL_WIDTH,
-         PWGALLERY_PREVIEW_THUMBNAIL_HEIGHT,
-         NULL);
+    /* the same thumbnail as in the list, from the thumbnail cache */
+    if (vfs_is_image(data, uri)) {
+        pixbuf = image_load_preview(data, uri);
+    }
     have_preview = (pixbuf != NULL);
-    g_free(filename);
+    g_free(uri);
     
     gtk_image_set_from_pixbuf(GTK_IMAGE(preview), pixbuf);
     if (pixbuf)
@@ -807,8 +837,7 @@ static void action_image_edit(gpointer user_data)
                 data->current_img->uri, edited_uri);
         vfs_copy(data, data->current_img->uri, edited_uri);
 
-        g_free(data->current_img->uri);
-        data->current_img->uri = edited_uri;
+        model_set_uri(data->gal->model, data->current_img, edited_uri);
     }
 
     g_debug("editing %s", data->current_img->uri);
@@ -898,40 +927,33 @@ action_image_move(gpointer user_data, gint place)
         return;
 
     /* get the index number of the currently selected image */
-    current_no = g_slist_index(data->gal->images, data->current_img);
+    current_no = model_index(data->gal->model, data->current_img);
     g_assert(current_no > -1);
 
     /* if moving up and  image is already on top, just return */
     if (current_no == 0 && place == PWGALLERY_IMAGE_MOVE_UP)
         return;
 
-    /* delete element from the list */
-    data->gal->images = g_slist_remove(data->gal->images, data->current_img);
-
     switch(place)
     {
     case PWGALLERY_IMAGE_MOVE_TOP:
-        data->gal->images = g_slist_prepend(data->gal->images, 
-                                            data->current_img);
+        model_move(data->gal->model, data->current_img, 0);
         break;
     case PWGALLERY_IMAGE_MOVE_UP:
-        data->gal->images = g_slist_insert(data->gal->images, 
-                                           data->current_img,
-                                           current_no - 1);
+        model_move(data->gal->model, data->current_img, current_no - 1);
         break;
     case PWGALLERY_IMAGE_MOVE_DOWN:
-        /* if current_no + 1 is too big, it's appended anyways */
-        data->gal->images = g_slist_insert(data->gal->images, 
-                                           data->current_img,
-                                           current_no + 1);
+        /* if current_no + 1 is too big, it's moved to the end anyways */
+        model_move(data->gal->model, data->current_img, current_no + 1);
         break;
     case PWGALLERY_IMAGE_MOVE_BOTTOM:
-        data->gal->images = g_slist_append(data->gal->images, 
-                                           data->current_img);
+        model_move(data->gal->model, data->current_img,
+                   model_length(data->gal->model));
         break;
     }
 
-    /* update the thumbnail list */
+    /* move the row and keep it selected */
+    thumbview_move(data, data->current_img, current_no);
 	widgets_update_table(data);
 
     data->gal->edited = TRUE;
@@ -188,6 +188,16 @@ void on_button_move_down_clicked(GtkButton *button, gpointer user_data);
  */
 void on_button_move_bottom_clicked(GtkButton *button, gpointer user_data);
 
+/*
+ * "Cancel" button of adding images clicked
+ */
+void on_button_import_cancel_clicked(GtkButton *button, gpointer user_data);
+
+/*
+ * "Cancel" button of making the gallery clicked
+ */
+void on_button_make_cancel_clicked(GtkButton *button, gpointer user_data);
+
 /* Emacs indentatation information
    Local Variables:
    indent-tabs-mode:nil
@@ -475,6 +475,76 @@ set_defaults(GKeyFile *keyfile)
                                NULL);
     }
 
+    /* Images per index page */
+    if (g_key_file_has_key(keyfile, "Default",
+                           PWGALLERY_RCKEY_INDEX_PAGE_SIZE, NULL ) == FALSE)
+    {
+        g_key_file_set_value(keyfile, "Default",
+                             PWGALLERY_RCKEY_INDEX_PAGE_SIZE,
+                             PWGALLERY_DEFAULT_INDEX_PAGE_SIZE);
+
+        g_key_file_set_comment(keyfile, "Default",
+                               PWGALLERY_RCKEY_INDEX_PAGE_SIZE, 
+                               _("Default number of images per index page "
+                                 "(0 for all images on one page)"),
+                               NULL);
+    }
+
+    /* Parallel jobs */
+    if (g_key_file_has_key(keyfile, "Default", PWGALLERY_RCKEY_JOBS,
+                           NULL ) == FALSE)
+    {
+        g_key_file_set_value(keyfile, "Default", PWGALLERY_RCKEY_JOBS,
+                             PWGALLERY_DEFAULT_JOBS);
+
+        g_key_file_set_comment(keyfile, "Default", PWGALLERY_RCKEY_JOBS, 
+                               _("Number of images processed in parallel "
+                                 "(0 for one per CPU)"),
+                               NULL);
+    }
+
+    /* Thumbnail memory */
+    if (g_key_file_has_key(keyfile, "Default", PWGALLERY_RCKEY_THUMB_MEMORY,
+                           NULL ) == FALSE)
+    {
+        g_key_file_set_value(keyfile, "Default", PWGALLERY_RCKEY_THUMB_MEMORY,
+                             PWGALLERY_DEFAULT_THUMB_MEMORY);
+
+        g_key_file_set_comment(keyfile, "Default",
+                               PWGALLERY_RCKEY_THUMB_MEMORY, 
+                               _("Memory in megabytes for the thumbnails "
+                                 "shown in the main window"),
+                               NULL);
+    }
+
+    /* Make memory */
+    if (g_key_file_has_key(keyfile, "Default", PWGALLERY_RCKEY_MAKE_MEMORY,
+                           NULL ) == FALSE)
+    {
+        g_key_file_set_value(keyfile, "Default", PWGALLERY_RCKEY_MAKE_MEMORY,
+                             PWGALLERY_DEFAULT_MAKE_MEMORY);
+
+        g_key_file_set_comment(keyfile, "Default",
+                               PWGALLERY_RCKEY_MAKE_MEMORY, 
+                               _("Memory in megabytes for the images "
+                                 "decoded in parallel when making a gallery"),
+                               NULL);
+    }
+
+    /* Slide show memory */
+    if (g_key_file_has_key(keyfile, "Default", PWGALLERY_RCKEY_SS_MEMORY,
+                           NULL ) == FALSE)
+    {
+        g_key_file_set_value(keyfile, "Default", PWGALLERY_RCKEY_SS_MEMORY,
+                             PWGALLERY_DEFAULT_SS_MEMORY);
+
+        g_key_file_set_comment(keyfile, "Default",
+                               PWGALLERY_RCKEY_SS_MEMORY, 
+                               _("Memory in megabytes for the images "
+                                 "loaded ahead and kept in the slide show"),
+                               NULL);
+    }
+
 
     /* Global comment */
     /* FIXME: this is prepended in the configrc file on each load? */
@@ -603,6 +673,26 @@ set_rc_values(struct data *data, GKeyFile *keyfile)
     data->rename = g_key_file_get_boolean(keyfile, "Default",
                                           PWGALLERY_RCKEY_RENAME,  NULL);
 
+    /* Images per index page, no error checking.. */
+    data->index_page_size = g_key_file_get_integer(
+        keyfile, "Default", PWGALLERY_RCKEY_INDEX_PAGE_SIZE,  NULL);
+
+    /* Parallel jobs, no error checking.. */
+    data->jobs = g_key_file_get_integer(keyfile, "Default",
+                                        PWGALLERY_RCKEY_JOBS,  NULL);
+
+    /* Thumbnail memory, no error checking.. */
+    data->thumb_memory = g_key_file_get_integer(
+        keyfile, "Default", PWGALLERY_RCKEY_THUMB_MEMORY,  NULL);
+
+    /* Make memory, no error checking.. */
+    data->make_memory = g_key_file_get_integer(
+        keyfile, "Default", PWGALLERY_RCKEY_MAKE_MEMORY,  NULL);
+
+    /* Slide show memory, no error checking.. */
+    data->ss_memory = g_key_file_get_integer(
+        keyfile, "Default", PWGALLERY_RCKEY_SS_MEMORY,  NULL);
+
 }
 
 
@@ -697,6 +787,27 @@ get_rc_values(struct data *data, GKeyFile *keyfile)
     g_key_file_set_boolean(keyfile, "Default",
                            PWGALLERY_RCKEY_RENAME, data->rename);
 
+    /* Images per index page */
+    g_key_file_set_integer(keyfile, "Default",
+                           PWGALLERY_RCKEY_INDEX_PAGE_SIZE,
+                           data->index_page_size);
+
+    /* Parallel jobs */
+    g_key_file_set_integer(keyfile, "Default",
+                           PWGALLERY_RCKEY_JOBS, data->jobs);
+
+    /* Thumbnail memory */
+    g_key_file_set_integer(keyfile, "Default",
+                           PWGALLERY_RCKEY_THUMB_MEMORY, data->thumb_memory);
+
+    /* Make memory */
+    g_key_file_set_integer(keyfile, "Default",
+                           PWGALLERY_RCKEY_MAKE_MEMORY, data->make_memory);
+
+    /* Slide show memory */
+    g_key_file_set_integer(keyfile, "Default",
+                           PWGALLERY_RCKEY_SS_MEMORY, data->ss_memory);
+
 }
 
 /* Emacs indentatation information
@@ -58,31 +58,22 @@ exif_free(struct exif *exif)
 
 
 gboolean
-exif_data_get(struct data *data, struct image *img)
+exif_data_parse(struct data *data, struct image *img,
+                const guchar *buf, gsize len)
 {
     ExifData        *edata;
     ExifEntry       *eentry;
     ExifContent     *eifd;
     ExifByteOrder   eorder;
     ExifShort       eorientation;
-    gchar           *filename;
-    GError          *error = NULL;
 
     g_assert(data != NULL);
     g_assert(img != NULL);
+    g_assert(buf != NULL);
     
-    g_debug("in exif_data_get");
+    g_debug("in exif_data_parse");
 
-    filename = g_filename_from_uri(img->uri, NULL, &error);
-    if (filename == NULL)
-    {
-        g_warning("Failed to get filename from uri: %s", error->message);
-        g_error_free(error);
-        return FALSE;
-    }
-
-    edata = exif_data_new_from_file(filename);
-    g_free(filename);
+    edata = exif_data_new_from_data(buf, len);
 
     if (!edata)
     {
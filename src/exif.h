@@ -40,9 +40,11 @@ struct exif *exif_new(void);
 void exif_free(struct exif *exif);
 
 /*
- * Update exif data to image struct
+ * Update exif data to image struct from the beginning of the image
+ * file already read to buf
  */
-gboolean exif_data_get(struct data *data, struct image *img);
+gboolean exif_data_parse(struct data *data, struct image *img,
+                         const guchar *buf, gsize len);
 
 #endif
 
@@ -29,6 +29,14 @@
 #include "vfs.h"
 #include "xml.h"
 #include "html.h"
+#include "pool.h"
+#include "manifest.h"
+#include "model.h"
+#include "thumbview.h"
+#include "import.h"
+#include "budget.h"
+#include "prefetch.h"
+#include "make.h"
 
 #include <glib.h>
 #include <gdk/gdkkeysyms.h>          /* GDK key symbols */
@@ -36,13 +44,21 @@
 #include <string.h>                  /* memset, strcmp */
 #include <strings.h>                 /* rindex */
 
-#define PWGALLERY_MAX_SLIDESHOW_PRELOAD  5
-#define PWGALLERY_MAKE_THREADS           4
-
-static gpointer _thread_make_image(gpointer data);
-static gpointer _thread_make_thumb(gpointer data);
-static gboolean _make_thumbnails(struct data *data);
-static gboolean _make_webimages(struct data *data);
+struct make_pipeline;
+
+static gboolean _make_decode_job(gpointer user_data);
+static gboolean _make_write_job(gpointer user_data);
+static guint64 _make_unknown_estimate(GPtrArray *tds, gint n_workers,
+                                      guint64 memory);
+static void _make_image_done(struct make_pipeline *pipeline, gboolean ok);
+static void _make_wait(struct make_pipeline *pipeline, gint running,
+                       gint total);
+static gboolean _make_pipeline_failed(struct make_pipeline *pipeline);
+static void _make_images_progress(gint done, gint total, gpointer user_data);
+static gboolean _make_images(struct data *data);
+static void _free_gallery(struct gallery *gal);
+static void _make_failed(struct data *data);
+static void _make_status(struct data *data, gfloat frac, const gchar *text);
 static gint sort_exif_timestamp(gconstpointer a, gconstpointer b);
 static gboolean ss_key(GtkWidget *widget,
                        GdkEventKey *event,
@@ -58,20 +74,45 @@ static void ss_start_timer(struct data *data);
 static void ss_skip_forward(struct data *data);
 static void ss_skip_backward(struct data *data);
 static void ss_show_image(struct data *data);
-static gpointer ss_loading_thread(gpointer data);
+
+/* thumbnail and four web image sizes */
+#define PWGALLERY_MAKE_OUTPUTS           5
+
+/* interval of the progress updates while making images, in ms */
+#define PWGALLERY_MAKE_PROGRESS_INTERVAL 100
 
 struct thread_image_data {
     struct data *data;
-    gchar *img_uri;
-    int tmp_h;
+    struct make_pipeline *pipeline;    /* make of the image */
     struct image *image;
+    struct image *prev;                /* neighbours for the page links */
+    struct image *next;
+    guint position;                    /* place of the image in the gallery */
+    struct html_pages *pages;          /* image page template or NULL */
+    struct magick_output outputs[PWGALLERY_MAKE_OUTPUTS];
+    gint n_outputs;
+    gint64 memory;                     /* budget reserved for decoding */
 };
 
-
-struct thread_thumb_data {
-    struct data *data;
-    gchar *thumb_uri;
-    struct image *image;
+/*
+ * Images are made in jobs on the shared worker pool. A decoding job
+ * reads an original, decodes it and encodes the outputs, and queues a
+ * writing job for the results and the image pages. The thread making
+ * the gallery admits the images in the gallery order, each when its
+ * estimated memory fits the budget, and keeps at most one image per
+ * worker in flight. The jobs never wait for each other, so the
+ * imports and the other galleries take turns on the same workers.
+ */
+struct make_pipeline {
+    struct data *data;                 /* snapshot being made */
+    struct pool_batch *batch;          /* decoding and writing jobs */
+    struct budget *budget;             /* memory for decoding, shared */
+    GMutex mutex;                      /* protects the fields below */
+    GCond cond;                        /* an image finished */
+    gint running;                      /* images admitted, not finished */
+    gint done;                         /* images finished */
+    gint reported;                     /* images in the last progress */
+    gboolean failed;                   /* some image failed */
 };
     
 
@@ -92,7 +133,7 @@ gallery_init(struct data *data)
     data->current_ss_img = NULL; /* no currently selected image for slideshow */
 
 	data->gal->edited = FALSE;
-    data->gal->images = NULL;
+    data->gal->model = model_new();
 
 	/* Set default values */
 	data->gal->uri            = g_strdup("");
@@ -116,6 +157,7 @@ gallery_init(struct data *data)
 	data->gal->image_h4       = data->image_h4;
 	data->gal->remove_exif    = data->remove_exif;
 	data->gal->rename         = data->rename;
+	data->gal->index_page_size = data->index_page_size;
 }
 
 
@@ -123,9 +165,6 @@ gallery_init(struct data *data)
 void
 gallery_free(struct data *data)
 {
-	GSList *list;
-	struct image *img;
-
 	g_assert(data != NULL);
 
 	if (data->gal == NULL)
@@ -133,58 +172,66 @@ gallery_free(struct data *data)
 
     g_debug("in gallery_free");
 
-	/* free images */
-    if (data->gal->images != NULL) {
-        list = data->gal->images;
-        while (list) {
-            img = list->data;
-            image_free(img);
-            list->data = NULL;
-            list = list->next;
-        }
-        g_slist_free(data->gal->images);
-        data->gal->images = NULL;
-    }
-
-	/* free other fields */
-	g_free(data->gal->uri);
-    data->gal->uri = NULL;
-
-	g_free(data->gal->name);
-    data->gal->name = NULL;
-
-	g_free(data->gal->desc);
-    data->gal->desc = NULL;
+	/* stop adding images and free images */
+    import_cancel(data);
+    thumbview_clear(data);
+    _free_gallery(data->gal);
+	data->gal = NULL;
+}
 
-	g_free(data->gal->output_dir);
-    data->gal->output_dir = NULL;
 
-	g_free(data->gal->base_dir);
-    data->gal->base_dir = NULL;
 
-	g_free(data->gal->dir_name);
-    data->gal->dir_name = NULL;
+struct gallery *
+gallery_snapshot(struct data *data)
+{
+    struct gallery *gal;
+    guint i;
 
-	g_free(data->gal->page_gen_prog);
-    data->gal->page_gen_prog = NULL;
+	g_assert(data != NULL);
+	g_assert(data->gal != NULL);
+
+    g_debug("in gallery_snapshot");
+
+    gal = g_new0(struct gallery, 1);
+
+    /* plain settings are copied as they are */
+    *gal = *data->gal;
+    gal->manifest = NULL;
+
+    gal->uri = g_strdup(data->gal->uri);
+    gal->name = g_strdup(data->gal->name);
+    gal->desc = g_strdup(data->gal->desc);
+    gal->base_dir = g_strdup(data->gal->base_dir);
+    gal->output_dir = g_strdup(data->gal->output_dir);
+    gal->dir_name = g_strdup(data->gal->dir_name);
+    gal->page_gen_prog = g_strdup(data->gal->page_gen_prog);
+    gal->templ_index = g_strdup(data->gal->templ_index);
+    gal->templ_indeximg = g_strdup(data->gal->templ_indeximg);
+    gal->templ_indexgen = g_strdup(data->gal->templ_indexgen);
+    gal->templ_image = g_strdup(data->gal->templ_image);
+    gal->templ_gen = g_strdup(data->gal->templ_gen);
+
+    gal->model = model_new();
+    for (i = 0; i < model_length(data->gal->model); i++) {
+        model_append(gal->model,
+                     image_copy(data, model_nth(data->gal->model, i)));
+    }
 
-	g_free(data->gal->templ_index);
-    data->gal->templ_index = NULL;
+    return gal;
+}
 
-	g_free(data->gal->templ_image);
-    data->gal->templ_image = NULL;
 
-	g_free(data->gal->templ_indeximg);
-    data->gal->templ_indeximg = NULL;
 
-	g_free(data->gal->templ_indexgen);
-    data->gal->templ_indexgen = NULL;
+void
+gallery_snapshot_free(struct gallery *gal)
+{
+    if (gal == NULL)
+        return;
 
-	g_free(data->gal->templ_gen);
-    data->gal->templ_gen = NULL;
+    g_debug("in gallery_snapshot_free");
 
-	g_free(data->gal);
-	data->gal = NULL;
+    manifest_free(gal->manifest);
+    _free_gallery(gal);
 }
 
 
@@ -324,10 +371,9 @@ gallery_open(struct data *data)
 
 
 
-void gallery_open_uri(struct data *data, gchar *uri)
+gboolean gallery_open_uri(struct data *data, gchar *uri)
 {
-    guchar *xml_content;
-    gsize xml_content_len;
+    gboolean ok;
 
     g_assert(data != NULL );
     g_assert(uri != NULL );
@@ -335,12 +381,8 @@ void gallery_open_uri(struct data *data, gchar *uri)
     g_free(data->gal->uri);
     data->gal->uri = g_strdup(uri);
 
-    /* read the gallery to memory */
-    vfs_read_file(data, data->gal->uri, &xml_content, &xml_content_len);
-
     /* create a new gallery structure based on xml file */
-    xml_gal_parse(data, xml_content, xml_content_len);
-    g_free(xml_content);
+    ok = xml_gal_parse(data, data->gal->uri);
 
     /* update the image text etc shown in the main window */
     widgets_set_image_information(data, data->current_img);
@@ -348,6 +390,7 @@ void gallery_open_uri(struct data *data, gchar *uri)
     /* no need to save an gallery that is just opened */
 	data->gal->edited = FALSE;
 
+    return ok;
 }
 
 
@@ -355,8 +398,7 @@ void gallery_open_uri(struct data *data, gchar *uri)
 void
 gallery_save(struct data *data)
 {
-    guchar *xml_content;
-    gsize xml_content_size;
+    gchar *tmp_uri;
 
     g_assert(data != NULL );
 
@@ -369,9 +411,17 @@ gallery_save(struct data *data)
         return;
     }
 
-    xml_content = xml_gal_write(data, &xml_content_size);
-
-    vfs_write_file(data, data->gal->uri, xml_content, xml_content_size);
+    /* write next to the gallery and replace it only when complete */
+    tmp_uri = g_strdup_printf("%s.tmp", data->gal->uri);
+    if (!xml_gal_write(data, tmp_uri)) {
+        /* FIXME: popup */
+        g_warning("Failed to save gallery '%s'", data->gal->uri);
+        vfs_unlink(data, tmp_uri);
+        g_free(tmp_uri);
+        return;
+    }
+    vfs_replace(data, tmp_uri, data->gal->uri);
+    g_free(tmp_uri);
 
     /* not edited anymore */
     data->gal->edited = FALSE;
@@ -441,6 +491,12 @@ gallery_make(struct data *data)
 
     g_debug("in gallery_make");
 
+    /* one make at a time */
+    if (data->make != NULL) {
+        widgets_set_status(data, _("The gallery is being made"));
+        return;
+    }
+
     /* Verify that the template files exists */
     if (!vfs_is_file(data, data->gal->templ_index) ||
         !vfs_is_file(data, data->gal->templ_indeximg)) {
@@ -538,56 +594,59 @@ gallery_make(struct data *data)
         }
     }
 
-    /* make top level directory for gallery */
-    if (vfs_is_dir(data, data->gal->output_dir) == TRUE) {
-        gchar *dir;
-        int i = 1;
-        do {
-            dir = g_strdup_printf("%s.%d", data->gal->output_dir, i);
-            if(vfs_is_dir(data, dir) == FALSE) {
-                break;
-            }
-            g_free(dir);
-            ++i;
-        } while(1);
-
-        vfs_rename(data, data->gal->output_dir, dir);
-        vfs_mkdir(data, data->gal->output_dir);
-        vfs_copy_htaccess(data, dir, data->gal->output_dir);
-        g_free(dir);
-    } else {
-        vfs_mkdir(data, data->gal->output_dir);
+    /* in the GUI the gallery is made in the background from a copy */
+    if (data->use_gui) {
+        make_start(data);
+        return;
     }
 
-    widgets_set_progress(data, 0, _("Creating gallery"));
+    gallery_build(data);
+}
 
-    /* make thumbnails */
-    if (!_make_thumbnails(data)) {
-        widgets_set_progress(data, 0, _("Failed!"));
-        return;
+
+
+gboolean
+gallery_build(struct data *data)
+{
+    g_assert(data != NULL);
+    g_assert(data->gal != NULL);
+
+    g_debug("in gallery_build");
+
+    /* Make only what has changed since the previous make, if it left
+     * a manifest. Otherwise the old directory is moved aside when the
+     * new one is complete. */
+    data->gal->manifest = manifest_load(data, data->gal->output_dir);
+    if (manifest_found(data->gal->manifest)) {
+        g_debug("gallery_make: updating %s", data->gal->output_dir);
     }
 
-    /* make webimages */
-    if (!_make_webimages(data)) {
-        widgets_set_progress(data, 0, _("Failed!"));
-        return;
+    _make_status(data, 0, _("Creating gallery"));
+
+    /* make thumbnails, webimages and image pages */
+    if (!_make_images(data)) {
+        _make_failed(data);
+        return FALSE;
     }
 
-    /* make index page */
-    if (!html_make_index_page(data)) {
-        widgets_set_progress(data, 0, _("Failed!"));
-        return;
+    /* make index page, image pages were made with the images */
+    if (make_is_cancelled(data->make) || !html_make_index_page(data)) {
+        _make_failed(data);
+        return FALSE;
     }
 
-    /* make image pages */
-    if (!vfs_is_file(data, data->gal->templ_image)) {
-        g_debug("No image template, skipping image html");
-    } else if (!html_make_image_pages(data)) {
-        widgets_set_progress(data, 0, _("Failed!"));
-        return;
+    /* move the made files in place, remove orphaned files and save the
+     * manifest for the next make */
+    if (!manifest_save(data->gal->manifest)) {
+        _make_failed(data);
+        return FALSE;
     }
+    manifest_free(data->gal->manifest);
+    data->gal->manifest = NULL;
 
-    widgets_set_progress(data, 0, _("Idle"));
+    _make_status(data, 0, _("Idle"));
+
+    return TRUE;
 }
 
 
@@ -597,11 +656,11 @@ gallery_sort_by_time(struct data *data)
 {
     g_debug("in %s", __func__);
 
-    if (data && data->gal && data->gal->images) {
+    if (data && data->gal && model_length(data->gal->model) > 0) {
 
         /* Sort the gallery based on exif time stamps */
-        data->gal->images =
-            g_slist_sort(data->gal->images, sort_exif_timestamp);
+        model_sort(data->gal->model, sort_exif_timestamp);
+        thumbview_reorder(data);
 
         widgets_update_table(data);
 
@@ -615,10 +674,11 @@ gallery_slide_show(struct data *data)
 {
     GtkWidget *ss_image;
     GdkColor color = {0, 0, 0, 0};
+    GdkScreen *screen;
 
     g_debug("in %s", __func__);
 
-    if (!data || !data->gal || !data->gal->images) {
+    if (!data || !data->gal || model_length(data->gal->model) == 0) {
         /* No images, notify the user */
         GtkWidget *label;
         GtkWidget *dialog;
@@ -647,6 +707,7 @@ gallery_slide_show(struct data *data)
         gtk_widget_destroy(data->ss_window);
         data->ss_window = NULL;
     }
+    prefetch_free(data->ss_prefetch);
 
     /* Create a new full screen window for the slide show */
     data->ss_window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
@@ -668,10 +729,11 @@ gallery_slide_show(struct data *data)
 
     gtk_widget_show_all(data->ss_window);
 
-    g_cond_init(&data->ss_data_cond);
-    g_mutex_init(&data->ss_data_mutex);
+    /* Start loading the images around the shown one */
+    screen = gdk_display_get_screen(gdk_display_get_default(), 0);
+    data->ss_prefetch = prefetch_new(data, gdk_screen_get_width(screen),
+                                     gdk_screen_get_height(screen));
 
-    data->ss_stop = FALSE;
     data->ss_show_text = TRUE;
     data->current_ss_img = NULL;
    
@@ -684,72 +746,13 @@ gallery_slide_show(struct data *data)
 void
 gallery_add_new_images(struct data *data, GSList *uris)
 {
-	struct image *img;
-	GSList       *first;
-	gint         tot_files, file_counter;
-	gchar        p_text[128];
-
 	g_assert(data != NULL);
 	g_assert(uris != NULL);
 
     g_debug("in gallery_add_new_images");
 
-	first = uris;
-	tot_files = g_slist_length(uris); /* number of images to add */
-	file_counter = 0;
-	
-    widgets_set_status(data, _("Adding images"));
-
-	/* Add images */
-	while (uris) {
-        /* Set rotate to -1 to choose the exif rotation */
-		img = image_open(data, uris->data, -1);
-		if (img != NULL) {
-			/* update progress */
-			g_snprintf(p_text, 128, "%d/%d", file_counter++, tot_files);
-			widgets_set_progress(data, (gfloat)file_counter/(gfloat)tot_files,
-								 p_text);
-			data->gal->images = g_slist_append(data->gal->images, img);
-            g_debug("Added %s", img->uri);
-            
-            if (data->use_gui) {
-                gtk_widget_show(img->image);
-                gtk_widget_show(img->button);
-            }
-		} else {
-            g_warning("Failed to open image");
-        }
-		uris = uris->next;
-	}
-    
-	g_slist_free(first);
-
-    /* select first image, if there was no images before this addition */
-    if (data->current_img == NULL) {
-        if (data->gal->images != NULL) {
-            data->current_img = (struct image *)(data->gal->images->data);
-            /* update the image text etc shown in the main window */
-            widgets_set_image_information(data, data->current_img);
-        } else {
-            /* nothing to do, still no images */
-            return ;
-        }
-    }
-
-    widgets_update_table(data);
-    
-    /* total files now in the gallery */
-	tot_files = g_slist_length(data->gal->images);
-
-	/* set progress and status */
-	widgets_set_progress(data, 0, _("Idle"));
-	g_snprintf(p_text, 128, "%d %s", tot_files, 
-               tot_files == 1 ? _("Image") : _("Images"));
-	widgets_set_status(data, p_text);
-
-    /* gallery edited */
-    data->gal->edited = TRUE;
-
+    /* opened on the worker pool and added in order when ready */
+    import_uris(data, uris);
 }
 
 
@@ -757,74 +760,13 @@ gallery_add_new_images(struct data *data, GSList *uris)
 void
 gallery_open_images(struct data *data, GSList *imgs)
 {
-	struct image *img, *tmpimg;
-	GSList       *first;
-	gint         tot_files, file_counter;
-	gchar        p_text[128];
-
 	g_assert(data != NULL);
     /* imgs can be null */
 
     g_debug("in gallery_open_images");
 
-	first = imgs;
-	tot_files = g_slist_length(imgs); /* number of images to open */
-	file_counter = 0;
-
-	widgets_set_status(data, _("Opening images"));
-
-	/* Open images */
-	while (imgs) {
-        tmpimg = imgs->data;
-        /* Always use the rotate from the saved gallery instead of exif */
-        img = image_open(data, g_strdup(tmpimg->uri), tmpimg->rotate);
-        if (img != NULL)
-            {
-                /* update progress */
-                g_snprintf(p_text, 128, "%d/%d", file_counter++, tot_files);
-                widgets_set_progress(data, (gfloat)file_counter/(gfloat)tot_files,
-                                     p_text);
-                data->gal->images = g_slist_append(data->gal->images, img);
-
-                if (data->use_gui) {
-                    gtk_widget_show(img->image);
-                    gtk_widget_show(img->button);
-                }
-
-                /* set image values from */
-                g_free(img->text);
-                img->text     = g_strdup(tmpimg->text);
-                img->gamma    = tmpimg->gamma;
-                img->rotate   = tmpimg->rotate;
-                img->nomodify = tmpimg->nomodify;
-                img->image_h  = tmpimg->image_h;
-            
-            } else {
-            g_warning("Failed to add image");
-        }
-        image_free(tmpimg);
-        imgs = imgs->next;
-    }
-
-	g_slist_free(first);
-
-    /* select first image of the gallery */
-    if (data->gal->images != NULL) {
-        data->current_img = (struct image *)(data->gal->images->data);
-    }
-
-	widgets_update_table(data);
-    
-    /* total files now in the gallery */
-	tot_files = g_slist_length(data->gal->images);
-
-	/* set progress and status */
-	widgets_set_progress(data, 0, _("Idle"));
-	g_snprintf(p_text, 128, "%d %s", tot_files, 
-               tot_files == 1 ? _("Image") : _("Images"));
-	widgets_set_status(data, p_text);
-
     /* data->gal->edited is set in gallery_open() */
+    import_saved(data, imgs);
 }
 
 
@@ -835,7 +777,6 @@ gallery_remove_image(struct data *data, struct image *img)
     gint current_no;
     gint tot_files;
  	gchar p_text[128];
-    GSList *tmplist;
 
 	g_assert(data != NULL);
 	g_assert(img != NULL);
@@ -843,33 +784,28 @@ gallery_remove_image(struct data *data, struct image *img)
     g_debug("in gallery_remove_image");
 
     /* get the index number of the currently selected image */
-    current_no = g_slist_index(data->gal->images, img);
+    current_no = model_index(data->gal->model, img);
     g_assert(current_no > -1);
 
-    /* free image and remove it from the list */
-    data->gal->images = g_slist_remove(data->gal->images, img);
+    /* free image and remove it from the gallery and the list */
+    thumbview_forget(data, img);
+    model_remove(data->gal->model, img);
     image_free(img);
 
     /* set currently selected image to the next one of the deleted image */
-    tmplist = g_slist_nth(data->gal->images, current_no);
+    data->current_img = model_nth(data->gal->model, current_no);
 
     /* select the last image if deleted one was the last one */
-    if (tmplist != NULL) {
-        data->current_img = tmplist->data;
-    }
-    else {
-        tmplist = g_slist_last(data->gal->images);
-        if (tmplist != NULL)
-            data->current_img = tmplist->data;
-        else
-            data->current_img = NULL;
+    if (data->current_img == NULL) {
+        data->current_img = model_nth(data->gal->model,
+                                      model_length(data->gal->model) - 1);
     }
 
     /* update the thumbnail list */
 	widgets_update_table(data);
 
     /* total files now in the gallery */
-	tot_files = g_slist_length(data->gal->images);
+	tot_files = model_length(data->gal->model);
 
     /* update the image text etc shown in the main window */
     widgets_set_image_information(data, data->current_img);
@@ -884,47 +820,14 @@ gallery_remove_image(struct data *data, struct image *img)
 
 
 
-gboolean
-gallery_image_selected(GtkWidget *widget,
-                       GdkEventButton *event,
-                       gpointer user_data)
+void
+gallery_image_selected(struct data *data, struct image *img)
 {
-    GSList *imgs;
-    struct data *data;
-    struct image *img = NULL;
-
-	g_assert(widget != NULL);
-	g_assert(event != NULL);
-	g_assert(user_data != NULL);
+	g_assert(data != NULL);
+	g_assert(img != NULL);
 
     g_debug("in gallery_image_selected");
 
-    data = user_data;
-
-    /* on doubleclick we already have set everything on first
-     * click. Now just show the web image */
-    if (event->type == GDK_2BUTTON_PRESS) {
-        widgets_set_status(data, "Showing preview..");        
-        magick_show_preview(data, data->current_img,  data->gal->image_h);
-        widgets_set_status(data, "Idle");
-        return FALSE;
-    }
-
-    /* Find out which button was pressed by going through all image
-     * buttons and matching pointer address.
-     * CHECKME: This should be probably implemented in some more sane way 
-     */
-    imgs = data->gal->images;
-    while (imgs) {
-        img = imgs->data;
-        if ((GtkWidget*)(img->button) == widget)
-            break;
-        imgs = imgs->next;
-    }
-
-    /* the image must be found since it was clicked.. */
-    g_assert(img != NULL);
-
     /* save previously selected image's (if any) text */
     gallery_image_save_text(data);
 
@@ -932,8 +835,23 @@ gallery_image_selected(GtkWidget *widget,
     
     /* update the image text etc shown in the main window */
     widgets_set_image_information(data, data->current_img);
+}
+
 
-    return FALSE; /* let others handle the click too */
+
+void
+gallery_image_activated(struct data *data, struct image *img)
+{
+	g_assert(data != NULL);
+	g_assert(img != NULL);
+
+    g_debug("in gallery_image_activated");
+
+    /* on doubleclick we already have set everything on first
+     * click. Now just show the web image */
+    widgets_set_status(data, "Showing preview..");        
+    magick_show_preview(data, img, data->gal->image_h);
+    widgets_set_status(data, "Idle");
 }
 
 
@@ -965,181 +883,115 @@ gallery_image_save_text(struct data *data)
 }
 
 
-/*
- *
- * Static functions
- *
- */
 
-/*
- * Make thumbnails for the gallery.
- */
-static gboolean
-_make_thumbnails(struct data *data)
+struct pool *
+gallery_get_pool(struct data *data)
 {
-    gchar       *dir_uri;
-    GSList      *images;  
-    gint        tot, i;
-    gboolean    failed = FALSE;
+    gint n_workers;
 
     g_assert(data != NULL);
 
-    g_debug("in _make_thumbnails");
+    if (data->pool != NULL)
+        return data->pool;
 
-    tot = g_slist_length(data->gal->images);
-    i = 0;
+    /* command line overrides the configrc, 0 for one per CPU */
+    n_workers = data->arg_jobs > 0 ? data->arg_jobs : data->jobs;
 
-    /* make the thumbnail directory */
-    dir_uri = g_strdup_printf("%s/thumbnails", data->gal->output_dir);
-    vfs_mkdir(data, dir_uri);
-
-    /* make the thumbnails for all images in gallery */
-    images = data->gal->images;
-    while(images != NULL) {
-        int cpu_index;
-        GThread *threads[PWGALLERY_MAKE_THREADS];
-        
-        for (cpu_index = 0; cpu_index < PWGALLERY_MAKE_THREADS; cpu_index++) {
-            threads[cpu_index] = NULL;
-        }
-        
-        for (cpu_index = 0; cpu_index < PWGALLERY_MAKE_THREADS; cpu_index++) {
-            gchar *thumb_uri;
-            struct image *image = images->data;
-            gfloat frac;
-            gchar progress[256];
-            struct thread_thumb_data *td;
-            
-            thumb_uri = g_strdup_printf("%s/%s.%s", dir_uri, 
-                                        image->basefilename, image->ext);
-            
-            td = malloc(sizeof(struct thread_thumb_data));
-            g_assert(td != NULL);
-            td->data = data;
-            td->image = image;
-            td->thumb_uri = g_strdup(thumb_uri);
-            
-            threads[cpu_index] = g_thread_new("make_thumb",
-                                              _thread_make_thumb,
-                                              (void*)td);
-            g_free(thumb_uri);
-            
-            images = images->next;
-            
-            /* update status */
-            ++i;
-            snprintf(progress, 256, "%s: %d/%d", _("Creating thumbnails"), i, tot);
-            frac = (gfloat)i/(gfloat)tot;
-            g_debug("frac: %f", frac);
-            widgets_set_progress(data, frac, progress);
-
-            if (images == NULL) {
-                break;
-            }
-        }
+    data->pool = pool_new(n_workers);
 
-        /* Wait for threads to finish */
-        for (cpu_index = 0; cpu_index < PWGALLERY_MAKE_THREADS; cpu_index++) {
-            gpointer retval;
-            gint r;
-            
-            if (threads[cpu_index] == NULL) {
-                break;
-            }
-            
-            retval = g_thread_join(threads[cpu_index]);
-            
-            /* Check the return values */
-            r = GPOINTER_TO_INT(retval);
-            if (r == FALSE) {
-                failed = TRUE;
-            }
-        }
-        
-        if (failed) {
-            return FALSE;
-        }
-
-    }
-    g_free(dir_uri);
-
-    return TRUE;
+    return data->pool;
 }
 
 
-
-/*
- * Make image in a thread
- */
-static gpointer
-_thread_make_image(gpointer data)
+struct budget *
+gallery_get_budget(struct data *data)
 {
-    struct thread_image_data *td;
-    gboolean retval;
+    guint64 memory;
 
     g_assert(data != NULL);
-    td = data;
 
-    /* make the webimage and save it to a file */
-    retval = magick_make_webimage(td->data, td->image, td->img_uri, td->tmp_h);
+    /* shared by all the galleries being made at once and kept in step
+     * with the settings between makes */
+    memory = (guint64)MAX(data->make_memory, 1) * 1024 * 1024;
+    if (data->budget == NULL) {
+        data->budget = budget_new(memory);
+        magick_set_memory_limit(memory);
+    } else if (budget_get_limit(data->budget) != memory) {
+        budget_set_limit(data->budget, memory);
+        magick_set_memory_limit(memory);
+    }
 
-    g_free(td->img_uri);
-    g_free(td);
-    
-    return GINT_TO_POINTER(retval);
+    return data->budget;
 }
 
 
+/*
+ *
+ * Static functions
+ *
+ */
 
 /*
- * Make thumbnail in a thread
+ * Free the images and the settings of a gallery
  */
-static gpointer
-_thread_make_thumb(gpointer data)
+static void
+_free_gallery(struct gallery *gal)
 {
-    struct thread_thumb_data *td;
-    gboolean retval;
-
-    g_assert(data != NULL);
-    td = data;
-
-    g_debug("make_thumb: %s\n", td->thumb_uri);
-    /* make the thumbnail and save it to a file */
-    retval = magick_make_thumbnail(td->data, td->image, td->thumb_uri);
- 
-    g_free(td->thumb_uri);
-    g_free(td);
-    
-    return GINT_TO_POINTER(retval);
+    model_free(gal->model);
+
+    g_free(gal->uri);
+    g_free(gal->name);
+    g_free(gal->desc);
+    g_free(gal->output_dir);
+    g_free(gal->base_dir);
+    g_free(gal->dir_name);
+    g_free(gal->page_gen_prog);
+    g_free(gal->templ_index);
+    g_free(gal->templ_image);
+    g_free(gal->templ_indeximg);
+    g_free(gal->templ_indexgen);
+    g_free(gal->templ_gen);
+    g_free(gal);
 }
 
 
+
 /*
- * Make webimages for the gallery.
+ * Make thumbnails and webimages of all sizes for the gallery, and the
+ * image pages. Each original is decoded only once for all of them.
+ * Reading, decoding and writing of different images overlap in a
+ * pipeline.
  */
 static gboolean
-_make_webimages(struct data *data)
+_make_images(struct data *data)
 {
-    gint image_index = 0;
-    gint tot, i;
+    gchar       *dir_uris[PWGALLERY_MAKE_OUTPUTS];
+    gint        heights[PWGALLERY_MAKE_OUTPUTS];
+    gint        size_index;
+    guint       i;
+    struct pool *pool;
+    struct html_pages *pages;
+    struct make_pipeline pipeline;
+    guint64     unknown;
+    gint        n_workers;
+    GPtrArray   *tds;
+    gboolean    ok;
 
     g_assert(data != NULL);
 
-    g_debug("in _make_webimages");
+    g_debug("in _make_images");
 
-    tot = g_slist_length(data->gal->images);
+    /* make the thumbnail directory */
+    dir_uris[0] = g_strdup_printf("%s/thumbnails", data->gal->output_dir);
+    ok = manifest_stage_dir(data->gal->manifest, dir_uris[0]);
+    heights[0] = 0;
 
-    /* go through all sizes */
-    while(++image_index < 5) {
-        gchar       *dir_uri;
-        GSList      *images;
-        gint        image_h = -1;
-        gboolean    failed = FALSE;
-        
-        i = 0; /* zero image counter */
+    /* make the webimage directories for the specified sizes */
+    for (size_index = 1; size_index < PWGALLERY_MAKE_OUTPUTS; size_index++) {
+        gint image_h = -1;
 
         /* FIXME: ugly. Sizes should be in a list */
-        switch(image_index) {
+        switch(size_index) {
         case 1:
             image_h = data->gal->image_h;
             break;
@@ -1152,114 +1004,402 @@ _make_webimages(struct data *data)
         case 4:
             image_h = data->gal->image_h4;
             break;
-        default: 
-            /* we shouldn't be here */
-            g_error("_make_webimages: Too many image sizes");
         }
-        
+        heights[size_index] = image_h;
+
         /* make only images with specified size */
         if (image_h == 0) {
+            dir_uris[size_index] = NULL;
             continue;
         }
 
-        /* make the webimage directory */
-        if (image_index == 1) {
+        if (size_index == 1) {
             /* default size images to "images" dir for backward compability */
-            dir_uri = g_strdup_printf("%s/images", data->gal->output_dir);
+            dir_uris[size_index] = g_strdup_printf("%s/images",
+                                                   data->gal->output_dir);
         } else {
-            dir_uri = g_strdup_printf("%s/images_%d", 
-                                      data->gal->output_dir, image_h);
+            dir_uris[size_index] = g_strdup_printf("%s/images_%d", 
+                                                   data->gal->output_dir,
+                                                   image_h);
         }
-        vfs_mkdir(data, dir_uri);
+        if (ok)
+            ok = manifest_stage_dir(data->gal->manifest,
+                                    dir_uris[size_index]);
+    }
 
-        /* make the webimages for all images in gallery */
-        images = data->gal->images;
-        while(images != NULL) {
-            int cpu_index;
-            GThread *threads[PWGALLERY_MAKE_THREADS];
+    /* image pages are made as soon as the sizes of an image are known */
+    if (!vfs_is_file(data, data->gal->templ_image)) {
+        g_debug("No image template, skipping image html");
+        pages = NULL;
+    } else if (ok) {
+        pages = html_image_pages_new(data);
+        ok = pages != NULL;
+    }
 
-            for (cpu_index = 0; cpu_index < PWGALLERY_MAKE_THREADS; cpu_index++) {
-                threads[cpu_index] = NULL;
+    if (!ok) {
+        for (size_index = 0; size_index < PWGALLERY_MAKE_OUTPUTS;
+             size_index++) {
+            g_free(dir_uris[size_index]);
+        }
+        return FALSE;
+    }
+
+    /* collect the images and the outputs to make of them */
+    tds = g_ptr_array_new();
+
+    for (i = 0; i < model_length(data->gal->model); i++) {
+        struct image *image = model_nth(data->gal->model, i);
+        struct thread_image_data *td;
+            
+        td = g_new0(struct thread_image_data, 1);
+        td->data = data;
+        td->image = image;
+        td->prev = model_nth(data->gal->model, (gint)i - 1);
+        td->next = model_nth(data->gal->model, i + 1);
+        td->position = i;
+        td->pages = pages;
+
+        /* thumbnail and the webimages in the order of sizes */
+        for (size_index = 0; size_index < PWGALLERY_MAKE_OUTPUTS;
+             size_index++) {
+            struct magick_output *out;
+
+            if (dir_uris[size_index] == NULL) {
+                continue;
             }
 
-            for (cpu_index = 0; cpu_index < PWGALLERY_MAKE_THREADS; cpu_index++) {
-
-                gchar *img_uri;
-                struct image *image = images->data;
-                gfloat frac;
-                gchar progress[256];
-                int tmp_h;
-                struct thread_image_data *td;
-
-                img_uri = g_strdup_printf("%s/%s.%s", dir_uri, image->basefilename, 
-                                          image->ext);
-                
-                /* Check if the image overrides the generic size */
-                if (image->image_h != 0) {
-                    tmp_h = image->image_h;
-                } else {
-                    tmp_h = image_h;
-                }
-                
-                td = malloc(sizeof(struct thread_image_data));
-                g_assert(td != NULL);
-                td->data = data;
-                td->image = image;
-                td->tmp_h = tmp_h;
-                td->img_uri = g_strdup(img_uri);
-
-
-                threads[cpu_index] = g_thread_new("make_image",
-                                                  _thread_make_image,
-                                                  (void*)td);
-
-                g_free(img_uri);
-                
-                images = images->next;
-                
-                /* update status */
-                ++i;
-                snprintf(progress, 256, "%s %d: %d/%d", 
-                         _("Creating images"), image_h, i, tot);
-                frac = (gfloat)i/(gfloat)tot;
-                g_debug("frac: %f", frac);
-                widgets_set_progress(data, frac, progress);
-
-                if (images == NULL) {
-                    break;
-                }
+            out = &td->outputs[td->n_outputs++];
+            out->uri = g_strdup_printf("%s/%s.%s", dir_uris[size_index],
+                                       image->basefilename, image->ext);
+            if (size_index == 0) {
+                out->thumb_w = data->gal->thumb_w;
+            } else if (image->image_h != 0) {
+                /* the image overrides the generic size */
+                out->height = image->image_h;
+            } else {
+                out->height = heights[size_index];
             }
 
-            /* Wait for threads to finish */
-            for (cpu_index = 0; cpu_index < PWGALLERY_MAKE_THREADS; cpu_index++) {
-                gpointer retval;
-                gint r;
+            /* skip the outputs made already in a previous make */
+            out->current = manifest_output_is_current(data->gal->manifest,
+                                                      image, out);
+        }
+            
+        g_ptr_array_add(tds, td);
+    }
+
+    pool = gallery_get_pool(data);
+    n_workers = pool_get_n_workers(pool);
 
-                if (threads[cpu_index] == NULL) {
-                    break;
-                }
+    memset(&pipeline, 0, sizeof(pipeline));
+    pipeline.data = data;
+    pipeline.batch = pool_batch_new(pool);
+    pipeline.budget = gallery_get_budget(data);
+    pipeline.reported = -1;
+    g_mutex_init(&pipeline.mutex);
+    g_cond_init(&pipeline.cond);
 
-                retval = g_thread_join(threads[cpu_index]);
+    unknown = _make_unknown_estimate(tds, n_workers,
+                                     budget_get_limit(pipeline.budget));
 
-                /* Check the return values */
-                r = GPOINTER_TO_INT(retval);
-                if (r == FALSE) {
-                    failed = TRUE;
-                }
-            }
+    /* Admit the images in order. The budget decides how many of them
+     * decode at once, so a huge image holds back only the images that
+     * do not fit with it. */
+    for (i = 0; i < tds->len; i++) {
+        struct thread_image_data *td = g_ptr_array_index(tds, i);
+
+        /* one image per worker at most, progress shown meanwhile */
+        _make_wait(&pipeline, n_workers - 1, tds->len);
+
+        /* no point starting more if the make fails anyway */
+        if (_make_pipeline_failed(&pipeline))
+            break;
+
+        td->pipeline = &pipeline;
+        td->memory = magick_estimate_memory(td->image, td->outputs,
+                                            td->n_outputs);
+        if (td->memory < 0)
+            td->memory = unknown;
+        budget_acquire(pipeline.budget, td->memory);
+
+        g_mutex_lock(&pipeline.mutex);
+        pipeline.running++;
+        g_mutex_unlock(&pipeline.mutex);
+
+        pool_push(pipeline.batch, _make_decode_job, td);
+    }
+
+    /* the images finish before their jobs return */
+    _make_wait(&pipeline, 0, tds->len);
+    pool_batch_wait(pipeline.batch, NULL, NULL);
+    pool_batch_free(pipeline.batch);
 
-            if (failed) {
-                return FALSE;
+    ok = !pipeline.failed && i == tds->len;
+
+    g_mutex_clear(&pipeline.mutex);
+    g_cond_clear(&pipeline.cond);
+    html_image_pages_free(pages);
+
+    /* record the outputs to the manifest and free the jobs */
+    for (i = 0; i < tds->len; i++) {
+        struct thread_image_data *td = g_ptr_array_index(tds, i);
+
+        for (size_index = 0; size_index < td->n_outputs; size_index++) {
+            if (ok) {
+                manifest_add_output(data->gal->manifest, td->image,
+                                    &td->outputs[size_index]);
             }
+            g_free(td->outputs[size_index].uri);
+        }
+        g_free(td);
+    }
+    g_ptr_array_free(tds, TRUE);
 
+    for (size_index = 0; size_index < PWGALLERY_MAKE_OUTPUTS; size_index++) {
+        g_free(dir_uris[size_index]);
+    }
+
+    return ok;
+}
+
+
+
+/*
+ * Job reading an original and decoding it to the thumbnail and the
+ * webimages. The writing job is queued to the head of the worker's own
+ * deque, so the encoded images are written soon after.
+ */
+static gboolean
+_make_decode_job(gpointer user_data)
+{
+    struct thread_image_data *td;
+    struct make_pipeline *pipeline;
+    struct vfs_view *view = NULL;
+    gboolean made = FALSE;
+    gint out;
+
+    g_assert(user_data != NULL);
+    td = user_data;
+    pipeline = td->pipeline;
+
+    g_debug("make_image: %s\n", td->image->uri);
+
+    /* after a failure the admitted images are only let go */
+    if (!_make_pipeline_failed(pipeline)) {
+        /* the original is needed only if some output is to be made */
+        for (out = 0; out < td->n_outputs; out++) {
+            if (!td->outputs[out].current) {
+                /* NULL if it can't be read, failing the image */
+                view = vfs_view_new(td->data, td->image->uri);
+                break;
+            }
         }
-        g_free(dir_uri);
+
+        made = magick_make_images(td->data, td->image, view,
+                                  td->outputs, td->n_outputs);
+        vfs_view_release(view);
     }
+
+    budget_release(pipeline->budget, td->memory);
+
+    if (!made) {
+        _make_image_done(pipeline, FALSE);
+        return FALSE;
+    }
+
+    pool_push(pipeline->batch, _make_write_job, td);
+
     return TRUE;
 }
 
 
 
+/*
+ * Job writing the encoded images and the pages of an image, whose
+ * sizes are known now
+ */
+static gboolean
+_make_write_job(gpointer user_data)
+{
+    struct thread_image_data *td;
+    gboolean ok;
+
+    g_assert(user_data != NULL);
+    td = user_data;
+
+    ok = magick_write_outputs(td->data->gal->manifest, td->outputs,
+                              td->n_outputs);
+
+    if (ok && td->pages != NULL)
+        ok = html_make_image_pages(td->pages, td->prev, td->image,
+                                   td->next, td->position);
+
+    _make_image_done(td->pipeline, ok);
+
+    return ok;
+}
+
+
+
+/*
+ * Estimate for the images of unknown size: the largest known estimate,
+ * or a share of the budget when no size is known
+ */
+static guint64
+_make_unknown_estimate(GPtrArray *tds, gint n_workers, guint64 memory)
+{
+    gint64 largest = 0;
+    guint i;
+
+    g_assert(tds != NULL);
+
+    for (i = 0; i < tds->len; i++) {
+        struct thread_image_data *td = g_ptr_array_index(tds, i);
+
+        largest = MAX(largest,
+                      magick_estimate_memory(td->image, td->outputs,
+                                             td->n_outputs));
+    }
+
+    return largest > 0 ? (guint64)largest : memory / MAX(n_workers, 1);
+}
+
+
+
+/*
+ * An image is finished, made or failed
+ */
+static void
+_make_image_done(struct make_pipeline *pipeline, gboolean ok)
+{
+    g_mutex_lock(&pipeline->mutex);
+    pipeline->running--;
+    pipeline->done++;
+    if (!ok)
+        pipeline->failed = TRUE;
+    g_cond_signal(&pipeline->cond);
+    g_mutex_unlock(&pipeline->mutex);
+}
+
+
+
+/*
+ * Wait until no more than the given number of images are in flight,
+ * showing the progress meanwhile. Called in the thread making the
+ * gallery, never in the workers.
+ */
+static void
+_make_wait(struct make_pipeline *pipeline, gint running, gint total)
+{
+    g_mutex_lock(&pipeline->mutex);
+    while (TRUE) {
+        gint64 end_time;
+
+        /* report progress without holding the lock */
+        if (pipeline->done != pipeline->reported) {
+            gint done = pipeline->done;
+
+            pipeline->reported = done;
+            g_mutex_unlock(&pipeline->mutex);
+            _make_images_progress(done, total, pipeline->data);
+            g_mutex_lock(&pipeline->mutex);
+            continue;
+        }
+
+        if (pipeline->running <= running)
+            break;
+
+        end_time = g_get_monotonic_time() + 
+            PWGALLERY_MAKE_PROGRESS_INTERVAL * G_TIME_SPAN_MILLISECOND;
+        g_cond_wait_until(&pipeline->cond, &pipeline->mutex, end_time);
+    }
+    g_mutex_unlock(&pipeline->mutex);
+}
+
+
+
+/*
+ * Check if the make has failed or is cancelled. A cancelled make stops
+ * between images.
+ */
+static gboolean
+_make_pipeline_failed(struct make_pipeline *pipeline)
+{
+    gboolean failed;
+
+    if (make_is_cancelled(pipeline->data->make))
+        return TRUE;
+
+    g_mutex_lock(&pipeline->mutex);
+    failed = pipeline->failed;
+    g_mutex_unlock(&pipeline->mutex);
+
+    return failed;
+}
+
+
+
+/*
+ * Making the gallery failed or was cancelled. The files made are
+ * removed and the output directory and the manifest of the previous
+ * make are left as they were.
+ */
+static void
+_make_failed(struct data *data)
+{
+    g_assert(data != NULL);
+
+    manifest_discard(data->gal->manifest);
+    manifest_free(data->gal->manifest);
+    data->gal->manifest = NULL;
+
+    if (make_is_cancelled(data->make))
+        _make_status(data, 0, _("Cancelled"));
+    else
+        _make_status(data, 0, _("Failed!"));
+}
+
+
+
+/*
+ * Show the progress of making the gallery, through the main loop when
+ * made in the background
+ */
+static void
+_make_status(struct data *data, gfloat frac, const gchar *text)
+{
+    g_assert(data != NULL);
+
+    if (data->make != NULL)
+        make_progress(data->make, frac, text);
+    else
+        widgets_set_progress(data, frac, text);
+}
+
+
+
+/*
+ * Show progress of making images. Called in the thread making the
+ * gallery, never in the workers.
+ */
+static void
+_make_images_progress(gint done, gint total, gpointer user_data)
+{
+    struct data *data;
+    gchar progress[256];
+    gfloat frac;
+
+    g_assert(user_data != NULL);
+    data = user_data;
+
+    snprintf(progress, 256, "%s: %d/%d", _("Creating images"), done, total);
+    frac = total > 0 ? (gfloat)done/(gfloat)total : 0;
+    g_debug("frac: %f", frac);
+    _make_status(data, frac, progress);
+}
+
+
+
 /* Compare the exif timestamps */
 static gint
 sort_exif_timestamp(gconstpointer a, gconstpointer b)
@@ -1372,7 +1512,7 @@ static gboolean
 ss_load_next(gpointer user_data)
 {
     struct data *data;
-    GSList *current_image;
+    gint current_no;
 
     g_assert(user_data != NULL);
     data = user_data;
@@ -1383,27 +1523,21 @@ ss_load_next(gpointer user_data)
 
     if (data->current_ss_img == NULL) {
         /* We are about to show the first image*/
-        data->current_ss_img = data->gal->images->data;
-
-        /* Start a thread loading images */
-        data->ss_thread = g_thread_new("load",
-                                       ss_loading_thread,
-                                       data);
-
+        data->current_ss_img = model_nth(data->gal->model, 0);
     } else {
-        current_image = g_slist_find(data->gal->images, data->current_ss_img);
+        current_no = model_index(data->gal->model, data->current_ss_img);
 
-        if (current_image == NULL) {
+        if (current_no == -1) {
             ss_stop(data);
             return FALSE;
         }
         
         /* Stop after the slide show keeping the last image showing */
-        if (current_image->next == NULL) {
+        if (model_nth(data->gal->model, current_no + 1) == NULL) {
             return TRUE;
         }
 
-        data->current_ss_img = current_image->next->data;
+        data->current_ss_img = model_nth(data->gal->model, current_no + 1);
     }
 
     ss_show_image(data);
@@ -1425,10 +1559,8 @@ ss_stop(struct data *data)
 
     g_debug("in %s", __func__);
 
-    data->ss_stop = TRUE;
-
-    g_mutex_clear(&data->ss_data_mutex);
-    g_cond_clear(&data->ss_data_cond);
+    prefetch_free(data->ss_prefetch);
+    data->ss_prefetch = NULL;
 
     if (data->ss_window != NULL) {
         gtk_widget_destroy(data->ss_window);
@@ -1500,7 +1632,7 @@ ss_start_timer(struct data *data)
 static void
 ss_skip_forward(struct data *data)
 {
-    GSList *current_image;
+    gint current_no;
 
     g_assert(data != NULL);
 
@@ -1508,19 +1640,19 @@ ss_skip_forward(struct data *data)
 
     ss_stop_timer(data);
   
-    current_image = g_slist_find(data->gal->images, data->current_ss_img);
+    current_no = model_index(data->gal->model, data->current_ss_img);
 
-    if (current_image == NULL) {
+    if (current_no == -1) {
         ss_stop(data);
         return;
     }
 
     /* Stop after the slide show keeping the last image showing */
-    if (current_image->next == NULL) {
+    if (model_nth(data->gal->model, current_no + 1) == NULL) {
         return;
     }
 
-    data->current_ss_img = current_image->next->data;
+    data->current_ss_img = model_nth(data->gal->model, current_no + 1);
 
     ss_show_image(data);
 
@@ -1537,7 +1669,7 @@ ss_skip_forward(struct data *data)
 static void
 ss_skip_backward(struct data *data)
 {
-    GSList *images, *prev_img = NULL;
+    gint current_no;
 
     g_assert(data != NULL);
 
@@ -1545,21 +1677,13 @@ ss_skip_backward(struct data *data)
 
     ss_stop_timer(data);
   
-    /* find the previous image */
-    images = data->gal->images->next;
-    prev_img = data->gal->images;
-    while (images) {
-        if (images->data == data->current_ss_img) {
-            break;
-        }
-        prev_img = images;
-        images = images->next;
-    }
-    if (prev_img == NULL) {
-        prev_img = data->gal->images;
+    /* the previous image, or the first one if already there */
+    current_no = model_index(data->gal->model, data->current_ss_img);
+    if (current_no < 1) {
+        current_no = 1;
     }
 
-    data->current_ss_img = prev_img->data;
+    data->current_ss_img = model_nth(data->gal->model, current_no - 1);
 
     ss_show_image(data);
 
@@ -1570,105 +1694,6 @@ ss_skip_backward(struct data *data)
 
 
 
-/*
- * A separate thread loading images to keep +-5 images loaded all the time
- */
-static gpointer
-ss_loading_thread(gpointer user_data)
-{
-    struct data *data;
-
-    g_assert(user_data != NULL);
-    data = user_data;
-    
-    g_debug("in %s", __func__);
-    
-    while(TRUE) {
-        GSList         *current_image;
-        GSList         *image_to_load;
-        struct image   *current_ss_img;
-        int i;
-
-        /* Store current status of the viewer thread */
-        current_ss_img = data->current_ss_img;
-        current_image = g_slist_find(data->gal->images, current_ss_img);
-        
-        if (current_image == NULL) {
-            /* FIXME: signal main thread */
-            g_error("%s: Failed to find current image", __func__);
-            g_thread_exit(FALSE);
-        }
-        
-
-        image_to_load = current_image;
-        for(i = 0; i < PWGALLERY_MAX_SLIDESHOW_PRELOAD; ++i) {
-            struct image *img; 
-            struct image *image;
-            GSList *list;
-            int index;
-            int j;
-            
-            if (i > 0 && image_to_load->next != NULL) {
-                image_to_load = image_to_load->next;
-            }
-            
-            img = image_to_load->data;
-
-            /* Load the pixbuf, if not loaded yet */
-            if (img->ss_pixbuf == NULL) {
-                g_debug("%s: loading pixbuf for %s",
-                        __func__, img->basefilename);
-                if (!image_load_ss_pixbuf(data, img)) {
-                    /* FIXME: signal main thread */
-                    g_error("%s: Failed to load image pixbuf data",
-                            __func__);
-                    g_thread_exit(FALSE);
-                }
-                
-                /* Signal viewer thread about new image data */
-                g_debug("%s: Signalling viewer thread about new data",
-                        __func__);
-                g_cond_signal(&data->ss_data_cond);
-            }
-
-            /* Clean up old image data */
-            index = g_slist_index(data->gal->images, current_ss_img);
-            index -= PWGALLERY_MAX_SLIDESHOW_PRELOAD;
-            if (index < 0) {
-                index = 0;
-            }
-            
-            list = data->gal->images;
-            j = 0;
-            while (j++ < index && list != NULL) {
-                image = list->data;
-                if (image->ss_pixbuf) {
-                    g_debug("%s: free pixbuf for %s",
-                            __func__, image->basefilename);
-                    g_object_unref(image->ss_pixbuf);
-                    image->ss_pixbuf = NULL;
-                }
-                list = list->next;
-            }
-            
-            if (current_ss_img != data->current_ss_img) {
-                /* Start again */
-                break;
-            }
-   
-            if (data->ss_stop == TRUE) {
-                g_debug("%s: Stop flag true, exiting", __func__);
-                g_thread_exit(FALSE);
-            }
-        }
-
-        /* Wait 100ms to "prevent" busylooping */
-        g_usleep(100 * 1000);
-    }
-}
-
-
-
 /*
  * Show the image once the current image pointer is set.
  */
@@ -1685,18 +1710,21 @@ ss_show_image(struct data *data)
 
     ss_image = gtk_bin_get_child(GTK_BIN(data->ss_window));
 
-    /* Wait for pixbuf data, if not exist yet */
+    /* Wait for pixbuf data, if not loaded yet */
     g_debug("%s: waiting for data", __func__);
-    g_mutex_lock(&data->ss_data_mutex);
-    while (!data->current_ss_img->ss_pixbuf) {
-        g_cond_wait(&data->ss_data_cond, &data->ss_data_mutex);
+    pixbuf = prefetch_get(data->ss_prefetch,
+                          model_index(data->gal->model,
+                                      data->current_ss_img));
+    if (pixbuf == NULL) {
+        /* FIXME: popup */
+        g_warning("%s: Failed to load image %s", __func__,
+                  data->current_ss_img->basefilename);
+        return;
     }
-    g_mutex_unlock(&data->ss_data_mutex);
     g_debug("%s: got data", __func__);
 
 
     /* Create a drawable for optional text rendering */
-    pixbuf = data->current_ss_img->ss_pixbuf;
     pixbuf_w = gdk_pixbuf_get_width(pixbuf);
     pixbuf_h = gdk_pixbuf_get_height(pixbuf);
 
@@ -1781,6 +1809,7 @@ ss_show_image(struct data *data)
             gdk_pixbuf_get_height(pixbuf));
 
     g_object_unref(pixmap);
+    g_object_unref(pixbuf);
 
 }
 
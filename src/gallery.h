@@ -45,9 +45,10 @@ void gallery_new(struct data *data);
 void gallery_open(struct data *data);
 
 /* 
- * Open gallery specified by the uri
+ * Open gallery specified by the uri. Returns FALSE if it can't be read
+ * or parsed.
  */
-void gallery_open_uri(struct data *data, gchar *uri);
+gboolean gallery_open_uri(struct data *data, gchar *uri);
 
 /*
  * Save gallery
@@ -60,10 +61,27 @@ void gallery_save(struct data *data);
 void gallery_save_as(struct data *data);
 
 /* 
- * Make gallery
+ * Make gallery, in the background when the GUI is used
  */
 void gallery_make(struct data *data);
 
+/*
+ * Make the output of data->gal. Called in the thread making the
+ * gallery. Returns FALSE if the make failed or was cancelled.
+ */
+gboolean gallery_build(struct data *data);
+
+/*
+ * Copy the settings and the images of the gallery, for making it
+ * while the gallery is edited
+ */
+struct gallery *gallery_snapshot(struct data *data);
+
+/*
+ * Free a copy made with gallery_snapshot
+ */
+void gallery_snapshot_free(struct gallery *gal);
+
 /*
  * Sort gallery based on EXIF time stamps
  */
@@ -82,7 +100,8 @@ gallery_slide_show(struct data *data);
 void gallery_free(struct data *data);
 
 /*
- * Add new images to gallery
+ * Add new images to gallery. Takes the list and the uris. In the GUI
+ * the images are added after this returns.
  */
 void gallery_add_new_images(struct data *data, GSList *uris);
 
@@ -92,22 +111,37 @@ void gallery_add_new_images(struct data *data, GSList *uris);
 void gallery_remove_image(struct data *data, struct image *img);
 
 /*
- * Open existing images to gallery
+ * Open images read from a gallery file and add them to the gallery.
+ * Takes the list and the images, the ones that fail to open are freed.
+ * In the GUI the images are added after this returns.
  */
 void gallery_open_images(struct data *data, GSList *imgs);
 
 /*
- * User selected an image (clicked gtk button containing the image)
+ * User selected an image from the thumbnail list
  */
-gboolean gallery_image_selected(GtkWidget *widget,
-                                GdkEventButton *event,
-                                gpointer user_data);
+void gallery_image_selected(struct data *data, struct image *img);
+
+/*
+ * User double clicked an image on the thumbnail list
+ */
+void gallery_image_activated(struct data *data, struct image *img);
 
 /*
  * Saves image description text from the text view to the image struct.
  */
 void gallery_image_save_text(struct data *data);
 
+/*
+ * Get the worker pool, start it on the first use
+ */
+struct pool *gallery_get_pool(struct data *data);
+
+/*
+ * Get the memory budget for decoding images, create it on the first use
+ */
+struct budget *gallery_get_budget(struct data *data);
+
 #endif
 
 /* Emacs indentatation information
@@ -26,21 +26,23 @@
 #include "gallery.h"
 #include "html.h"
 #include "vfs.h"
+#include "manifest.h"
+#include "template.h"
+#include "model.h"
 
 #include <glib.h>
 #include <gdk/gdkkeysyms.h>       /* key codes for _escape */
 #include <strings.h>              /* rindex */
-#include <string.h>               /* strstr */
-
-struct pwg_tag {
-    gchar *tag;
-    gsize len;
-    gsize pos;
-};
+#include <string.h>               /* memcpy */
 
 #define TAG_INDEX_TITLE       "<<TITLE>>"
 #define TAG_INDEX_INDEX_IMG   "<<INDEX_IMG>>"
 #define TAG_INDEX_GAL_DESC    "<<DESCRIPTION>>"
+#define TAG_INDEX_PAGE        "<<PAGE>>"
+#define TAG_INDEX_PAGES       "<<PAGES>>"
+#define TAG_INDEX_PREV_PAGE   "<<PREV_PAGE>>"
+#define TAG_INDEX_NEXT_PAGE   "<<NEXT_PAGE>>"
+#define TAG_INDEX_PAGE_LINKS  "<<PAGE_LINKS>>"
 
 #define TAG_INDEX_IMAGE_PAGE  "<<IMAGE_PAGE>>"
 #define TAG_INDEX_DESC        "<<DESC>>"
@@ -63,380 +65,465 @@ struct pwg_tag {
 #define TAG_IMAGE_ALT         "<<IMAGE_ALT>>"
 #define TAG_IMAGE_DESC        "<<DESC>>"
 
+/* an index page is written to the disk in parts of about this size */
+#define PWGALLERY_HTML_WRITE_SIZE (64*1024)
+
+
+
+/* Tags of the index page template */
+enum {
+    INDEX_TITLE,
+    INDEX_INDEX_IMG,
+    INDEX_GAL_DESC,
+    INDEX_PAGE,
+    INDEX_PAGES,
+    INDEX_PREV_PAGE,
+    INDEX_NEXT_PAGE,
+    INDEX_PAGE_LINKS,
+    INDEX_N_TAGS
+};
+static const gchar *index_tags[] = {
+    TAG_INDEX_TITLE,
+    TAG_INDEX_INDEX_IMG,
+    TAG_INDEX_GAL_DESC,
+    TAG_INDEX_PAGE,
+    TAG_INDEX_PAGES,
+    TAG_INDEX_PREV_PAGE,
+    TAG_INDEX_NEXT_PAGE,
+    TAG_INDEX_PAGE_LINKS,
+    NULL
+};
+
+/* Tags of the index page template per image. The tags of the index
+ * page, like <<DESCRIPTION>>, are replaced in it too and follow these
+ * in the same order as in index_tags. */
+enum {
+    INDEXIMG_IMAGE_PAGE,
+    INDEXIMG_DESC,
+    INDEXIMG_THUMB_IMG,
+    INDEXIMG_THUMB_W,
+    INDEXIMG_THUMB_H,
+    INDEXIMG_IMAGE_W,
+    INDEXIMG_IMAGE_H,
+    INDEXIMG_IMAGE_LINK,
+    INDEXIMG_THUMB_ALT,
+    INDEXIMG_INDEX_TAGS,
+    INDEXIMG_N_TAGS = INDEXIMG_INDEX_TAGS + INDEX_N_TAGS
+};
+static const gchar *indeximg_tags[] = {
+    TAG_INDEX_IMAGE_PAGE,
+    TAG_INDEX_DESC,
+    TAG_INDEX_THUMB_IMG,
+    TAG_INDEX_THUMB_W,
+    TAG_INDEX_THUMB_H,
+    TAG_IMAGE_W,
+    TAG_IMAGE_H,
+    TAG_IMAGE_LINK,
+    TAG_INDEX_THUMB_ALT,
+    TAG_INDEX_TITLE,
+    TAG_INDEX_INDEX_IMG,
+    TAG_INDEX_GAL_DESC,
+    TAG_INDEX_PAGE,
+    TAG_INDEX_PAGES,
+    TAG_INDEX_PREV_PAGE,
+    TAG_INDEX_NEXT_PAGE,
+    TAG_INDEX_PAGE_LINKS,
+    NULL
+};
+
+/* Tags of the image page template */
+enum {
+    IMAGE_TITLE,
+    IMAGE_PREV,
+    IMAGE_NEXT,
+    IMAGE_INDEX,
+    IMAGE_LINK,
+    IMAGE_SIZE_1,
+    IMAGE_SIZE_2,
+    IMAGE_SIZE_3,
+    IMAGE_SIZE_4,
+    IMAGE_W,
+    IMAGE_H,
+    IMAGE_ALT,
+    IMAGE_DESC,
+    IMAGE_N_TAGS
+};
+static const gchar *image_tags[] = {
+    TAG_IMAGE_TITLE,
+    TAG_IMAGE_PREV,
+    TAG_IMAGE_NEXT,
+    TAG_IMAGE_INDEX,
+    TAG_IMAGE_LINK,
+    TAG_IMAGE_SIZE_1,
+    TAG_IMAGE_SIZE_2,
+    TAG_IMAGE_SIZE_3,
+    TAG_IMAGE_SIZE_4,
+    TAG_IMAGE_W,
+    TAG_IMAGE_H,
+    TAG_IMAGE_ALT,
+    TAG_IMAGE_DESC,
+    NULL
+};
 
+/* Compiled image page template and values common to all pages */
+struct html_pages
+{
+    struct data     *data;
+    struct template *templ;            /* image page template */
+    gchar           *index_ext;        /* extension of the index page */
+    gchar           *page_ext;         /* extension of the image pages */
+    GString         *esc_name;         /* escaped gallery name */
+};
 
-void _tag_replace(GString **templ, const gchar *tag, const gchar *value);
 GString *_escape(gchar *text);
+static gchar *_template_ext(const gchar *templ_uri);
+static gchar *_index_page_name(guint page, const gchar *ext);
+static GString *_index_page_links(guint page, guint n_pages,
+                                  const gchar *ext);
+static void _render_index_img(struct template *templ, GString *out,
+                              struct image *image, const gchar *page_ext,
+                              const gchar **index_values);
 
 /*
- * Make index page html
+ * Make index pages html. The images are split to pages of
+ * index_page_size images. Each page is streamed to the staging
+ * directory as it is rendered, and kept only if it differs from the
+ * previous make.
  */
 gboolean
 html_make_index_page(struct data *data)
 {
-    guchar      *templ_index_data;
-    gsize       templ_index_len;
-    guchar      *templ_index_img_data;
-    gsize       templ_index_img_len;
+    struct template *index_templ;
+    struct template *index_img_templ;
+    const gchar *index_values[INDEX_N_TAGS];
     gchar       *ext;
     gchar       *image_tmpl_ext;
-    GSList      *images;  
-    GString     *index_img;
-    GString     *index_img_templ;
-    GString     *index_templ;
-    GString     *tmp;
+    GString     *page;
+    GString     *esc_name;
     GString     *esc_desc;
-    gchar       *index_page_uri;
+    guint       n_images, page_size, n_pages, p;
+    gboolean    ok = TRUE;
 
     g_assert(data != NULL);
 
     g_debug("in html_make_index_page");
 
+    /* compile the templates once for all the pages */
+    index_templ = template_load(data, data->gal->templ_index, index_tags);
+    index_img_templ = template_load(data, data->gal->templ_indeximg,
+                                    indeximg_tags);
+    if (index_templ == NULL || index_img_templ == NULL) {
+        template_free(index_templ);
+        template_free(index_img_templ);
+        return FALSE;
+    }
 
-    /* read index page template to memory */
-    vfs_read_file(data, data->gal->templ_index, &templ_index_data,
-                  &templ_index_len);
-
-    /* init g_string for index page template. Let's hope 100k is
-       usually enough */
-    index_templ = g_string_sized_new(100*1024);
-    index_templ = g_string_append(index_templ, (gchar*)templ_index_data);
-    g_free(templ_index_data);
-
-
-    /* read index page template to memory */
-    vfs_read_file(data, data->gal->templ_indeximg, &templ_index_img_data,
-                  &templ_index_img_len);
-
-    /* init g_string for index_img template. */
-    index_img_templ = g_string_new((gchar *)templ_index_img_data);
-    g_free(templ_index_img_data);
-
-
-    /* init g_string for all index imgs. Let's hope 100k is usually enough */
-    index_img = g_string_sized_new(100*1024);
-
-
-    /* init g_string for single index imgs. Let's hope 4096 bytes is
-       usually enough */
-    tmp = g_string_sized_new(4096);
+    /* get template index and image page extensions to be used for links */
+    ext = _template_ext(data->gal->templ_index);
+    image_tmpl_ext = _template_ext(data->gal->templ_image);
 
+    /* split the images to pages, at least one even if empty */
+    n_images = model_length(data->gal->model);
+    if (data->gal->index_page_size > 0)
+        page_size = data->gal->index_page_size;
+    else
+        page_size = MAX(n_images, 1);
+    n_pages = MAX((n_images + page_size - 1) / page_size, 1);
 
-    /* get template image page extension to be used for links */
-    image_tmpl_ext = rindex(data->gal->templ_image, '.');
-    if (image_tmpl_ext == NULL) {
-        /* no extension found, assume html */
-        image_tmpl_ext = g_strdup("html");
-    } else {
-        /* copy extension */
-        image_tmpl_ext = g_strdup(image_tmpl_ext + 1);
-    }
-
+    esc_name = _escape(data->gal->name);
+    esc_desc = _escape(data->gal->desc);
 
-    /* make the index_img for all images in gallery */
-    images = data->gal->images;
-    while(images != NULL) {
-        struct image       *image = images->data;
-        struct image_size  *size;
-        gchar              tmpbuf[1024];
-        GString            *esc;
+    page = g_string_sized_new(2 * PWGALLERY_HTML_WRITE_SIZE);
+
+    for (p = 0; p < n_pages && ok; p++) {
+        struct manifest_file *file;
+        GString     *page_links;
+        gchar       *page_name, *prev_name, *next_name;
+        gchar       *page_uri;
+        gchar       page_num[16], pages_num[16];
+        guint       position = 0;
+        guint       i;
+
+        page_name = _index_page_name(p, ext);
+        page_uri = g_strdup_printf("%s/%s", data->gal->output_dir, page_name);
+        file = manifest_file_new(data->gal->manifest, page_uri);
+        g_free(page_uri);
+        if (file == NULL) {
+            g_free(page_name);
+            ok = FALSE;
+            break;
+        }
 
-        if (image->sizes == NULL) {
-            /* FIXME: popup */
-            g_error("html_make_index_page: no sizes!");
+        prev_name = p > 0 ? _index_page_name(p - 1, ext) : g_strdup("");
+        next_name = p + 1 < n_pages ? _index_page_name(p + 1, ext) 
+            : g_strdup("");
+        page_links = _index_page_links(p, n_pages, ext);
+        g_snprintf(page_num, 16, "%d", p + 1);
+        g_snprintf(pages_num, 16, "%d", n_pages);
+
+        index_values[INDEX_TITLE]      = esc_name->str;
+        index_values[INDEX_INDEX_IMG]  = NULL; /* rendered below */
+        index_values[INDEX_GAL_DESC]   = esc_desc->str;
+        index_values[INDEX_PAGE]       = page_num;
+        index_values[INDEX_PAGES]      = pages_num;
+        index_values[INDEX_PREV_PAGE]  = prev_name;
+        index_values[INDEX_NEXT_PAGE]  = next_name;
+        index_values[INDEX_PAGE_LINKS] = page_links->str;
+
+        /* render the page, stopping at the place of the images */
+        while (template_render_part(index_templ, page, index_values,
+                                    &position) != -1) {
+
+            /* render the images of this page, writing out as it grows */
+            for (i = p * page_size;
+                 i < (p + 1) * page_size && i < n_images && ok; i++) {
+                _render_index_img(index_img_templ, page,
+                                  model_nth(data->gal->model, i),
+                                  image_tmpl_ext, index_values);
+                if (page->len >= PWGALLERY_HTML_WRITE_SIZE) {
+                    ok = manifest_file_write(file, (guchar*)page->str,
+                                             page->len);
+                    g_string_truncate(page, 0);
+                }
+            }
         }
 
-        size = image->sizes->data;
+        /* an unchanged page is left untouched */
+        if (ok)
+            ok = manifest_file_write(file, (guchar*)page->str, page->len);
+        if (!manifest_file_close(file))
+            ok = FALSE;
+        g_string_truncate(page, 0);
+
+        g_free(page_name);
+        g_free(prev_name);
+        g_free(next_name);
+        g_string_free(page_links, TRUE);
+    }
 
-        /* copy empty index_img template */
-        tmp = g_string_assign(tmp, index_img_templ->str);
+    g_string_free(page, TRUE);
+    g_string_free(esc_name, TRUE);
+    g_string_free(esc_desc, TRUE);
+    g_free(image_tmpl_ext);
+    g_free(ext);
 
-        /* image_page */
-        g_snprintf(tmpbuf, 1024, "%s.%s", 
-                   image->basefilename, image_tmpl_ext);
-        _tag_replace(&tmp, TAG_INDEX_IMAGE_PAGE, tmpbuf);
+    template_free(index_templ);
+    template_free(index_img_templ);
 
-        /* description */
-        esc = _escape(image->text);
-        _tag_replace(&tmp, TAG_INDEX_DESC, esc->str);
-        g_string_free(esc, TRUE);
+    return ok;
+}
 
-        /* thumb_img */
-        g_snprintf(tmpbuf, 1024, "thumbnails/%s.%s", 
-                   image->basefilename, image->ext);
-        _tag_replace(&tmp, TAG_INDEX_THUMB_IMG, tmpbuf);
-        
-        /* thumb_w */
-        g_snprintf(tmpbuf, 1024, "%d", image->thumb_w);
-        _tag_replace(&tmp, TAG_INDEX_THUMB_W, tmpbuf);
 
-        /* thumb_h */
-        g_snprintf(tmpbuf, 1024, "%d", image->thumb_h);
-        _tag_replace(&tmp, TAG_INDEX_THUMB_H, tmpbuf);
 
-        /* image width */
-        g_snprintf(tmpbuf, 1024, "%d", size->width);
-        _tag_replace(&tmp, TAG_IMAGE_W, tmpbuf);
+struct html_pages *
+html_image_pages_new(struct data *data)
+{
+    struct html_pages *pages;
 
-        /* image height */
-        g_snprintf(tmpbuf, 1024, "%d", size->height);
-        _tag_replace(&tmp, TAG_IMAGE_H, tmpbuf);
+    g_assert(data != NULL);
 
-        /* image link */
-        g_snprintf(tmpbuf, 1024, "images/%s.%s",
-                   image->basefilename, image->ext);
-        _tag_replace(&tmp, TAG_IMAGE_LINK, tmpbuf);
+    g_debug("in html_image_pages_new");
 
-        /* thumb_alt */
-        g_snprintf(tmpbuf, 1024, "%dKb", size->size);
-        _tag_replace(&tmp, TAG_INDEX_THUMB_ALT, tmpbuf);
-        
-        /* append data to index_img for later addition to index page */
-        index_img = g_string_append(index_img, tmp->str);
+    pages = g_new0(struct html_pages, 1);
+    pages->data = data;
 
-        images = images->next;
+    /* compile the template once for all the pages */
+    pages->templ = template_load(data, data->gal->templ_image, image_tags);
+    if (pages->templ == NULL) {
+        g_free(pages);
+        return NULL;
     }
-    g_string_free(tmp, TRUE);
-    g_free(image_tmpl_ext);
-
-    /* replace tags in index page template */
-    /* title tag */
-    esc_desc = _escape(data->gal->name);
-    _tag_replace(&index_templ, TAG_INDEX_TITLE, esc_desc->str);
-    g_string_free(esc_desc, TRUE);
-
-    _tag_replace(&index_templ, TAG_INDEX_INDEX_IMG, index_img->str);
-
-    /* description tag */
-    esc_desc = _escape(data->gal->desc);
-    _tag_replace(&index_templ, TAG_INDEX_GAL_DESC, esc_desc->str);
-    g_string_free(esc_desc, TRUE);
 
+    /* get index and image template extensions */
+    pages->index_ext = _template_ext(data->gal->templ_index);
+    pages->page_ext = _template_ext(data->gal->templ_image);
 
-    /* save index page to file */
+    /* title is the same on all pages */
+    pages->esc_name = _escape(data->gal->name);
 
-    /* get template index extension */
-    ext = rindex(data->gal->templ_index, '.');
-    if (ext == NULL) {
-        /* no extension found, assume html */
-        ext = g_strdup("html");
-    } else {
-        /* copy extension */
-        ext = g_strdup(ext + 1);
-    }
+    return pages;
+}
 
-    index_page_uri = g_strdup_printf("%s/index.%s", data->gal->output_dir, ext);
-    g_free(ext);
 
-    vfs_write_file(data, index_page_uri, 
-                   (guchar*)index_templ->str, index_templ->len);
-    g_string_free(index_templ, TRUE);
-    g_free(index_page_uri);
 
-    return TRUE;
+void
+html_image_pages_free(struct html_pages *pages)
+{
+    if (pages == NULL)
+        return;
+
+    template_free(pages->templ);
+    g_free(pages->index_ext);
+    g_free(pages->page_ext);
+    g_string_free(pages->esc_name, TRUE);
+    g_free(pages);
 }
 
 
 
 /*
- * Make html for image pages
+ * Make html for the pages of an image, one for each size
  */
 gboolean
-html_make_image_pages(struct data *data)
+html_make_image_pages(struct html_pages *pages, struct image *prev,
+                      struct image *image, struct image *next,
+                      guint position)
 {
-    guchar       *templ_page_data;
-    gsize        templ_page_len;
-    gchar        *index_ext;
-    gchar        *page_ext;
-    GSList       *images;
+    const gchar  *values[IMAGE_N_TAGS];
     GSList       *sizes;
-    GString      *page_templ;
     GString      *page;
-    struct image *prev_img = NULL;
+    GString      *esc_desc;
+    gchar        *index_name;
+    gboolean     first_size = TRUE;
+    gboolean     ok = TRUE;
+    int          size_index = 0; /* ugly, again */
 
-    g_assert(data != NULL);
+    g_assert(pages != NULL);
+    g_assert(image != NULL);
 
     g_debug("in html_make_image_pages");
 
-    /* read index page template to memory */
-    vfs_read_file(data, data->gal->templ_image, &templ_page_data,
-                  &templ_page_len);
-
-    /* init g_string for page template. */
-    page_templ = g_string_new((gchar*)templ_page_data);
-    g_free(templ_page_data);
-
     /* init g_string for page html. Let's hope 10k is usually enough */
     page = g_string_sized_new(10*1024);
-   
-    /* get index template extension */
-    index_ext = rindex(data->gal->templ_index, '.');
-    if (index_ext == NULL) {
-        /* no extension found, assume html */
-        index_ext = g_strdup("html");
-    } else {
-        /* copy extension */
-        index_ext = g_strdup(index_ext + 1);
-    }
 
-    /* get image template extension */
-    page_ext = rindex(data->gal->templ_image, '.');
-    if (page_ext == NULL) {
-        /* no extension found, assume html */
-        page_ext = g_strdup("html");
+    esc_desc = _escape(image->text);
+
+    /* the index page the image is on */
+    if (pages->data->gal->index_page_size > 0) {
+        index_name = _index_page_name(
+            position / pages->data->gal->index_page_size, pages->index_ext);
     } else {
-        /* copy extension */
-        page_ext = g_strdup(page_ext + 1);
+        index_name = _index_page_name(0, pages->index_ext);
     }
 
-    /* make the html pages for all images in gallery */
-    images = data->gal->images;
-    while(images != NULL) {
-        struct image   *image = images->data;
-        gchar          tmpbuf[1024];
-        gboolean       first_size = TRUE;
-        int            size_index = 0; /* ugly, again */
-
-        /* go through all image sizes */
-        sizes = image->sizes;
-        while(sizes) {
-            struct image_size *size = sizes->data;
-            GString           *esc;
-
-            ++size_index; /* index number of sizes */
-
-            /* copy empty image template */
-            page = g_string_assign(page, page_templ->str);
-
-            /* replace tags in index page template */
-            
-            /* title */
-            esc = _escape(data->gal->name);
-            _tag_replace(&page, TAG_IMAGE_TITLE, esc->str);
-            g_string_free(esc, TRUE);
-
-            
-            /* prev link to previous image or, if null, to index */
-            if (prev_img == NULL) {
-                g_snprintf(tmpbuf, 1024, "%sindex.%s", 
-                           (first_size ? "" : "../"), index_ext);
-            } else {
-                g_snprintf(tmpbuf, 1024, "%s.%s", 
-                           prev_img->basefilename, page_ext);
-            }
-            _tag_replace(&page, TAG_IMAGE_PREV, tmpbuf);
-            
-            /* next link to next image or, if null, to index */
-            if (images->next == NULL) {
-                g_snprintf(tmpbuf, 1024, "%sindex.%s",
-                           (first_size ? "" : "../"), index_ext);
-            } else {
-                g_snprintf(tmpbuf, 1024, "%s.%s", 
-                           ((struct image *)(images->next->data))->basefilename,
-                           page_ext);
-            }
-            _tag_replace(&page, TAG_IMAGE_NEXT, tmpbuf);
-            
-            /* link to index */
-            g_snprintf(tmpbuf, 1024, "%sindex.%s", 
-                       (first_size ? "" : "../"),
-                       index_ext);
-            _tag_replace(&page, TAG_IMAGE_INDEX, tmpbuf);
-            
-            /* image link */
-            g_snprintf(tmpbuf, 1024, "%s%s.%s", 
-                       (first_size ? "images/" : ""),
-                       image->basefilename, image->ext);
-            _tag_replace(&page, TAG_IMAGE_LINK, tmpbuf);
-            
-            /* link to size 1 (default size) image */
-            g_snprintf(tmpbuf, 1024, "%s%s.%s", 
-                       (first_size ? "" : "../"),
-                       image->basefilename, page_ext);
-            _tag_replace(&page, TAG_IMAGE_SIZE_1, tmpbuf);
-
-            /* link to size 2 image */
-            g_snprintf(tmpbuf, 1024, "%simages_%d/%s.%s", 
-                       (first_size ? "" : "../"),
-                       data->gal->image_h2,
-                       image->basefilename, page_ext);
-            _tag_replace(&page, TAG_IMAGE_SIZE_2, tmpbuf);
-
-            /* link to size 3 image */
-            g_snprintf(tmpbuf, 1024, "%simages_%d/%s.%s", 
-                       (first_size ? "" : "../"),
-                       data->gal->image_h3,
-                       image->basefilename, page_ext);
-            _tag_replace(&page, TAG_IMAGE_SIZE_3, tmpbuf);
-
-            /* link to size 4 image */
-            g_snprintf(tmpbuf, 1024, "%simages_%d/%s.%s", 
-                       (first_size ? "" : "../"),
-                       data->gal->image_h4,
-                       image->basefilename, page_ext);
-            _tag_replace(&page, TAG_IMAGE_SIZE_4, tmpbuf);
-
-            /* image width */
-            g_snprintf(tmpbuf, 1024, "%d", size->width);
-            _tag_replace(&page, TAG_IMAGE_W, tmpbuf);
-            
-            /* image height */
-            g_snprintf(tmpbuf, 1024, "%d", size->height);
-            _tag_replace(&page, TAG_IMAGE_H, tmpbuf);
-            
-            /* image alt desc */
-            _tag_replace(&page, TAG_IMAGE_ALT, "");
-            
-            /* image desc */
-            esc = _escape(image->text);
-            _tag_replace(&page, TAG_IMAGE_DESC, esc->str);
-            g_string_free(esc, TRUE);
-
-            /* save page to file */
-            if (first_size) {
-                g_snprintf(tmpbuf, 1024, "%s/%s.%s", 
-                           data->gal->output_dir, 
-                           image->basefilename, page_ext);
-            } else {
-                /* ugly: we need to put all pages to same size based dir.. */
-                int common_height; 
-
-                /* ugly: get the common size */
-                switch (size_index) {
-                case 2:
-                    common_height = data->gal->image_h2;
-                    break;
-                case 3:
-                    common_height = data->gal->image_h3;
-                    break;
-                case 4:
-                    common_height = data->gal->image_h4;
-                    break;
-                default:
-                    /* FIXME: popup? */
-                    g_error("%s: Unknown size index: %d",
-                            __func__, size_index);
-                    break;
-                }
-                g_snprintf(tmpbuf, 1024, "%s/images_%d/%s.%s", 
-                           data->gal->output_dir,
-                           common_height, 
-                           image->basefilename, page_ext);
+    /* go through all image sizes */
+    sizes = image->sizes;
+    while(sizes && ok) {
+        struct image_size *size = sizes->data;
+        gchar             prev_link[1024], next_link[1024], index[1024];
+        gchar             link[1024];
+        gchar             size_1[1024], size_2[1024];
+        gchar             size_3[1024], size_4[1024];
+        gchar             image_w[16], image_h[16];
+        gchar             page_uri[1024];
+
+        ++size_index; /* index number of sizes */
+
+        /* prev link to previous image or, if null, to index */
+        if (prev == NULL) {
+            g_snprintf(prev_link, 1024, "%s%s", 
+                       (first_size ? "" : "../"), index_name);
+        } else {
+            g_snprintf(prev_link, 1024, "%s.%s", 
+                       prev->basefilename, pages->page_ext);
+        }
+        
+        /* next link to next image or, if null, to index */
+        if (next == NULL) {
+            g_snprintf(next_link, 1024, "%s%s",
+                       (first_size ? "" : "../"), index_name);
+        } else {
+            g_snprintf(next_link, 1024, "%s.%s", 
+                       next->basefilename,
+                       pages->page_ext);
+        }
+        
+        /* link to index */
+        g_snprintf(index, 1024, "%s%s", 
+                   (first_size ? "" : "../"), index_name);
+        
+        /* image link */
+        g_snprintf(link, 1024, "%s%s.%s", 
+                   (first_size ? "images/" : ""),
+                   image->basefilename, image->ext);
+        
+        /* link to size 1 (default size) image */
+        g_snprintf(size_1, 1024, "%s%s.%s", 
+                   (first_size ? "" : "../"),
+                   image->basefilename, pages->page_ext);
+
+        /* link to size 2 image */
+        g_snprintf(size_2, 1024, "%simages_%d/%s.%s", 
+                   (first_size ? "" : "../"),
+                   pages->data->gal->image_h2,
+                   image->basefilename, pages->page_ext);
+
+        /* link to size 3 image */
+        g_snprintf(size_3, 1024, "%simages_%d/%s.%s", 
+                   (first_size ? "" : "../"),
+                   pages->data->gal->image_h3,
+                   image->basefilename, pages->page_ext);
+
+        /* link to size 4 image */
+        g_snprintf(size_4, 1024, "%simages_%d/%s.%s", 
+                   (first_size ? "" : "../"),
+                   pages->data->gal->image_h4,
+                   image->basefilename, pages->page_ext);
+
+        /* image width and height */
+        g_snprintf(image_w, 16, "%d", size->width);
+        g_snprintf(image_h, 16, "%d", size->height);
+
+        values[IMAGE_TITLE]  = pages->esc_name->str;
+        values[IMAGE_PREV]   = prev_link;
+        values[IMAGE_NEXT]   = next_link;
+        values[IMAGE_INDEX]  = index;
+        values[IMAGE_LINK]   = link;
+        values[IMAGE_SIZE_1] = size_1;
+        values[IMAGE_SIZE_2] = size_2;
+        values[IMAGE_SIZE_3] = size_3;
+        values[IMAGE_SIZE_4] = size_4;
+        values[IMAGE_W]      = image_w;
+        values[IMAGE_H]      = image_h;
+        values[IMAGE_ALT]    = "";
+        values[IMAGE_DESC]   = esc_desc->str;
+
+        g_string_truncate(page, 0);
+        template_render(pages->templ, page, values);
+
+        /* save page to file */
+        if (first_size) {
+            g_snprintf(page_uri, 1024, "%s/%s.%s", 
+                       pages->data->gal->output_dir, 
+                       image->basefilename, pages->page_ext);
+        } else {
+            /* ugly: we need to put all pages to same size based dir.. */
+            int common_height; 
+
+            /* ugly: get the common size */
+            switch (size_index) {
+            case 2:
+                common_height = pages->data->gal->image_h2;
+                break;
+            case 3:
+                common_height = pages->data->gal->image_h3;
+                break;
+            case 4:
+                common_height = pages->data->gal->image_h4;
+                break;
+            default:
+                /* FIXME: popup? */
+                g_error("%s: Unknown size index: %d",
+                        __func__, size_index);
+                break;
             }
-            vfs_write_file(data, tmpbuf, (guchar*)page->str, page->len);
-            
-            first_size = FALSE;
-            sizes = sizes->next;
+            g_snprintf(page_uri, 1024, "%s/images_%d/%s.%s", 
+                       pages->data->gal->output_dir,
+                       common_height, 
+                       image->basefilename, pages->page_ext);
         }
-        prev_img = image;
-        images = images->next;
+        ok = manifest_write_file(pages->data->gal->manifest, page_uri,
+                                 (guchar*)page->str, page->len);
+        
+        first_size = FALSE;
+        sizes = sizes->next;
     }
 
-    g_free(index_ext);
+    g_free(index_name);
+    g_string_free(esc_desc, TRUE);
     g_string_free(page, TRUE);
-    g_string_free(page_templ, TRUE);
 
-    return TRUE;
+    return ok;
 }
 
 
@@ -449,26 +536,130 @@ html_make_image_pages(struct data *data)
 
 
 /*
- * Replace "tag" with "value" in "templ
+ * Get the extension of a template for the links, html by default
+ */
+static gchar *
+_template_ext(const gchar *templ_uri)
+{
+    gchar *ext;
+
+    ext = rindex(templ_uri, '.');
+    if (ext == NULL) {
+        /* no extension found, assume html */
+        return g_strdup("html");
+    }
+
+    /* copy extension */
+    return g_strdup(ext + 1);
+}
+
+
+
+/*
+ * Get the file name of an index page, index.html for the first one
+ * and index_2.html etc. for the rest
  */
-void _tag_replace(GString **templ, const gchar *tag, const gchar *value)
+static gchar *
+_index_page_name(guint page, const gchar *ext)
 {
-    gchar *pos;
-    gssize intpos;
+    if (page == 0)
+        return g_strdup_printf("index.%s", ext);
 
-    g_assert(templ != NULL);
-    g_assert(tag != NULL);
-    g_assert(value != NULL);
+    return g_strdup_printf("index_%d.%s", page + 1, ext);
+}
 
-    while((pos = strstr((*templ)->str, tag)) != NULL) {
-        
-        /* calculate position from the start */
-        intpos = pos - (*templ)->str;
-        
-        /* replace tag with value */
-        *templ = g_string_erase(*templ, intpos, strlen(tag));
-        *templ = g_string_insert(*templ, intpos, value);
+
+
+/*
+ * Make links to all index pages, the current page without a link.
+ * Empty if there is only one page.
+ */
+static GString *
+_index_page_links(guint page, guint n_pages, const gchar *ext)
+{
+    GString *links;
+    guint i;
+
+    links = g_string_new("");
+
+    if (n_pages < 2)
+        return links;
+
+    for (i = 0; i < n_pages; i++) {
+        gchar *name;
+
+        if (i > 0)
+            g_string_append_c(links, ' ');
+
+        if (i == page) {
+            g_string_append_printf(links, "%d", i + 1);
+            continue;
+        }
+
+        name = _index_page_name(i, ext);
+        g_string_append_printf(links, "<a href=\"%s\">%d</a>", name, i + 1);
+        g_free(name);
     }
+
+    return links;
+}
+
+
+
+/*
+ * Render the index page html of an image to the end of out. The tags
+ * of the index page, like <<DESCRIPTION>>, are replaced in the same
+ * pass.
+ */
+static void
+_render_index_img(struct template *templ, GString *out,
+                  struct image *image, const gchar *page_ext,
+                  const gchar **index_values)
+{
+    const gchar        *values[INDEXIMG_N_TAGS];
+    struct image_size  *size;
+    gchar              image_page[1024];
+    gchar              thumb_img[1024];
+    gchar              thumb_w[16], thumb_h[16];
+    gchar              image_w[16], image_h[16];
+    gchar              image_link[1024];
+    gchar              thumb_alt[32];
+    GString            *esc;
+
+    if (image->sizes == NULL) {
+        /* FIXME: popup */
+        g_error("html_make_index_page: no sizes!");
+    }
+
+    size = image->sizes->data;
+
+    g_snprintf(image_page, 1024, "%s.%s", 
+               image->basefilename, page_ext);
+    esc = _escape(image->text);
+    g_snprintf(thumb_img, 1024, "thumbnails/%s.%s", 
+               image->basefilename, image->ext);
+    g_snprintf(thumb_w, 16, "%d", image->thumb_w);
+    g_snprintf(thumb_h, 16, "%d", image->thumb_h);
+    g_snprintf(image_w, 16, "%d", size->width);
+    g_snprintf(image_h, 16, "%d", size->height);
+    g_snprintf(image_link, 1024, "images/%s.%s",
+               image->basefilename, image->ext);
+    g_snprintf(thumb_alt, 32, "%dKb", size->size);
+
+    values[INDEXIMG_IMAGE_PAGE] = image_page;
+    values[INDEXIMG_DESC]       = esc->str;
+    values[INDEXIMG_THUMB_IMG]  = thumb_img;
+    values[INDEXIMG_THUMB_W]    = thumb_w;
+    values[INDEXIMG_THUMB_H]    = thumb_h;
+    values[INDEXIMG_IMAGE_W]    = image_w;
+    values[INDEXIMG_IMAGE_H]    = image_h;
+    values[INDEXIMG_IMAGE_LINK] = image_link;
+    values[INDEXIMG_THUMB_ALT]  = thumb_alt;
+    memcpy(&values[INDEXIMG_INDEX_TAGS], index_values,
+           INDEX_N_TAGS * sizeof(const gchar *));
+
+    template_render(templ, out, values);
+    g_string_free(esc, TRUE);
 }
 
 
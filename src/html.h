@@ -30,7 +30,31 @@
 
 gboolean html_make_index_page(struct data *data);
 
-gboolean html_make_image_pages(struct data *data);
+/*
+ * Image page template compiled for making the pages of a gallery
+ */
+struct html_pages;
+
+/*
+ * Compile the image page template of the gallery. Returns NULL if it
+ * can't be read.
+ */
+struct html_pages *html_image_pages_new(struct data *data);
+
+/*
+ * Free the compiled image page template
+ */
+void html_image_pages_free(struct html_pages *pages);
+
+/*
+ * Make the pages of an image, one for each size. Prev and next are
+ * the neighbours of the image or NULL and position is the place of
+ * the image in the gallery, used to link to the right index page.
+ * Can be called in several threads at the same time.
+ */
+gboolean html_make_image_pages(struct html_pages *pages, struct image *prev,
+                               struct image *image, struct image *next,
+                               guint position);
 
 #endif
 
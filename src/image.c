@@ -26,6 +26,8 @@
 #include "gallery.h"
 #include "vfs.h"
 #include "exif.h"
+#include "probe.h"
+#include "thumbcache.h"
 
 #include <glib.h>
 #include <gtk/gtk.h>
@@ -33,11 +35,23 @@
 #include <string.h>       /* memset */
 
 
+static gboolean _open(struct data *data, struct image *img, gint rotate);
+static gboolean _read(struct data *data, struct image *img);
+static gboolean _read_size(struct data *data, struct image *img,
+                           GnomeVFSHandle *handle, GByteArray *header);
+static GdkPixbuf *_load_thumbnail(struct data *data, struct image *img);
 static void set_size(GdkPixbufLoader *gdkpixbufloader, 
                      gint arg1, gint arg2, gpointer data);
 static void set_ss_size(GdkPixbufLoader *gdkpixbufloader, 
                         gint arg1, gint arg2, gpointer data);
 
+/* Slide show image being loaded and the screen to fit it to */
+struct ss_size {
+    struct image    *img;
+    gint            screen_w;
+    gint            screen_h;
+};
+
 
 struct image *
 image_init(struct data *data)
@@ -49,9 +63,6 @@ image_init(struct data *data)
 	img = g_new0(struct image, 1);
 
     /* initialize values */
-    img->image        = NULL;
-    img->button       = NULL;
-    img->ss_pixbuf    = NULL;
     img->sizes        = NULL;
     img->width        = 0;
     img->height       = 0;
@@ -66,24 +77,59 @@ image_init(struct data *data)
     img->ext          = g_strdup("");
     img->nomodify     = FALSE;
     img->exif         = exif_new();
+    img->file_size    = -1;
+    img->mtime        = -1;
+    img->index        = -1;
 
 	return img;
 }
 
 
 
+struct image *
+image_copy(struct data *data, const struct image *img)
+{
+	struct image *copy;
+
+	g_assert(data != NULL);
+	g_assert(img != NULL);
+
+	copy = image_init(data);
+
+    copy->width        = img->width;
+    copy->height       = img->height;
+    copy->thumb_w      = img->thumb_w;
+    copy->thumb_h      = img->thumb_h;
+    copy->image_h      = img->image_h;
+    copy->rotate       = img->rotate;
+    copy->gamma        = img->gamma;
+    copy->nomodify     = img->nomodify;
+    copy->file_size    = img->file_size;
+    copy->mtime        = img->mtime;
+
+    g_free(copy->text);
+    copy->text = g_strdup(img->text);
+    g_free(copy->uri);
+    copy->uri = g_strdup(img->uri);
+    g_free(copy->basefilename);
+    copy->basefilename = g_strdup(img->basefilename);
+    g_free(copy->ext);
+    copy->ext = g_strdup(img->ext);
+
+    copy->exif->orientation = img->exif->orientation;
+    copy->exif->timestamp = g_strdup(img->exif->timestamp);
+
+	return copy;
+}
+
+
+
 void
 image_free(struct image *img)
 {
     GSList *list;
 
 	g_assert(img != NULL);
-	
-	/* destroy widgets */
-	if (img->button) {
-        gtk_widget_destroy(img->button);
-        /* No need to destroy img->image, since its contained in the button */
-    }
 
     /* free list of image sizes */
     list = img->sizes;
@@ -91,11 +137,6 @@ image_free(struct image *img)
         g_free(list->data);
         list = g_slist_delete_link(list, list);
     }
-
-    if (img->ss_pixbuf) {
-        g_object_unref(img->ss_pixbuf);
-        img->ss_pixbuf = NULL;
-    }
 	/* free other fields */
 	g_free(img->text);
 	g_free(img->uri);
@@ -110,60 +151,111 @@ image_free(struct image *img)
 struct image *
 image_open(struct data *data, gchar *uri, gint rotate)
 {
+	struct image     *img;
+
+	g_assert(data != NULL);
+	g_assert(uri != NULL);
+
+	g_debug("in image_open");
+
+	img = image_init(data);
+
+    g_free(img->uri);
+    img->uri = uri;
+
+    if (!_open(data, img, rotate)) {
+        image_free(img);
+        return NULL;
+    }
+
+    return img;
+}
+
+
+
+gboolean
+image_open_saved(struct data *data, struct image *img)
+{
+	g_assert(data != NULL);
+	g_assert(img != NULL);
+
+	g_debug("in image_open_saved");
+
+    /* Always use the rotate from the saved gallery instead of exif */
+    return _open(data, img, img->rotate);
+}
+
+
+
+gboolean
+image_is_edited(struct data *data, struct image *img)
+{
+    gchar *urimatch;
+    gboolean is_edited;
+
+	g_assert(data != NULL);
+	g_assert(img != NULL);
+
+	g_debug("in image_is_edited");
+
+    urimatch = g_strdup_printf("/edited/%s.%s", img->basefilename, img->ext);
 
+    is_edited = g_str_has_suffix(img->uri, urimatch);
+    g_free(urimatch);
+
+    return is_edited;
+}
+
+
+
+GdkPixbuf *
+image_load_ss_pixbuf(struct data *data, struct image *img,
+                     gint screen_w, gint screen_h, gint *cancel)
+{
     GdkPixbufLoader  *loader;
+    GdkPixbuf        *pixbuf;
     guchar           buf[PWGALLERY_IMG_READ_BUF_SIZE];
-	struct image     *img;
-    GdkColor         color, prelight;
+    struct ss_size   ss_size;
 	GnomeVFSResult   result;
 	GnomeVFSHandle   *handle;
 	GnomeVFSFileSize bytes;
 	GError           *error = NULL;
-	gchar            *tmpp;
-	GnomeVFSURI*     vfsuri = NULL;
 
 	g_assert(data != NULL);
-	g_assert(uri != NULL);
-
-	g_debug("in image_open");
+	g_assert(img != NULL);
 
-    /* check if the file is image */
-    if (vfs_is_image(data, uri) == FALSE) {
-        g_warning("%s: not an image: %s", __func__, uri);
-        return NULL;
-    }
+	g_debug("in %s", __func__);
 
 	/* open image */
-	vfsuri = gnome_vfs_uri_new(uri);
-	result = gnome_vfs_open_uri(&handle, vfsuri,
-								GNOME_VFS_OPEN_READ);
-	gnome_vfs_uri_unref(vfsuri);
+	result = gnome_vfs_open(&handle, img->uri, GNOME_VFS_OPEN_READ);
 	if (result != GNOME_VFS_OK) {
         /* FIXME: popup */
-        g_warning("Skipping image because of error opening '%s': %s", uri, 
+        g_warning("Failed to open slide show image '%s': %s", img->uri, 
                   gnome_vfs_result_to_string(result));
-        g_free(uri);
-        /* FIXME: show invalid image? */
         return NULL;
     }
 
-	img = image_init(data);
-
-    g_free(img->uri);
-    img->uri = uri;
-
-    /* load exif data and set rotation */
-    exif_data_get(data, img);
-    img->rotate = img->exif->orientation;
-    if (rotate != -1) {
-        img->rotate = rotate;
-    }
+    /* the size is passed to the callback, images may be loaded in
+     * several threads */
+    ss_size.img = img;
+    ss_size.screen_w = screen_w;
+    ss_size.screen_h = screen_h;
 
     loader = gdk_pixbuf_loader_new();
-    g_signal_connect(loader, "size-prepared", G_CALLBACK(set_size), img);
+    g_signal_connect(loader, "size-prepared", G_CALLBACK(set_ss_size),
+                     &ss_size);
 
 	/* read image from the file */
 	while (TRUE) {
+        /* the image isn't needed anymore */
+        if (cancel != NULL && g_atomic_int_get(cancel)) {
+            g_debug("%s: cancelled %s", __func__, img->basefilename);
+            gnome_vfs_close(handle);
+            gdk_pixbuf_loader_close(loader, NULL);
+            g_object_unref(loader);
+            return NULL;
+        }
+
         result = gnome_vfs_read(handle, buf,
                                 PWGALLERY_IMG_READ_BUF_SIZE, &bytes);
 
@@ -174,21 +266,23 @@ image_open(struct data *data, gchar *uri, gint rotate)
         /* error reading */
         if (result != GNOME_VFS_OK) {
             /* FIXME: popup */
-            g_warning("Skipping image because of read error '%s': %s", uri, 
+            g_warning("Failed to load slow show image '%s': %s", img->uri, 
                       gnome_vfs_result_to_string(result));
-            image_free(img);
-            gdk_pixbuf_loader_close (loader, NULL);
+            gnome_vfs_close(handle);
+            gdk_pixbuf_loader_close(loader, NULL);
+            g_object_unref(loader);
             return NULL;
         }
 
         /* error parsing image data */
         if (gdk_pixbuf_loader_write(loader, buf, bytes, &error) == FALSE) {
-            gdk_pixbuf_loader_close (loader, NULL);
+            gnome_vfs_close(handle);
+            gdk_pixbuf_loader_close(loader, NULL);
+            g_object_unref(loader);
             /* FIXME: popup */
-            g_warning("Skipping image because of parse error '%s': %s", uri,
+            g_warning("Failed to parse slide show image '%s': %s", img->uri,
                       error->message);
             g_error_free(error);
-            image_free(img);
             return NULL;
         }
 		
@@ -198,57 +292,144 @@ image_open(struct data *data, gchar *uri, gint rotate)
 
     gdk_pixbuf_loader_close(loader, NULL); /* no more writes */
 
-    if (data->use_gui) {
-
-        /* create button and set colors */
-        img->button = gtk_button_new();
-        g_object_ref(img->button);
+    pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
+    if (pixbuf == NULL) {
+        g_object_unref(loader);
+        return NULL;
+    }
 
-        color.pixel = 0;
-        color.red   = 10000;
-        color.green = 20000;
-        color.blue  = 50000;
-        prelight.pixel = 0;
-        prelight.red   = 15000;
-        prelight.green = 15000;
-        prelight.blue  = 37500;
-        
-        gtk_widget_modify_bg( img->button, GTK_STATE_NORMAL, &color);
-        gtk_widget_modify_bg( img->button, GTK_STATE_SELECTED, &color);
-        gtk_widget_modify_bg( img->button, GTK_STATE_PRELIGHT, &prelight );
-        
-        g_signal_connect( img->button, "button_press_event", 
-                          G_CALLBACK( gallery_image_selected ), data );
+    if (img->rotate == 90 || img->rotate == 270) {
+        GdkPixbufRotation rot;
         
-        if (img->rotate == 90 || img->rotate == 270) {
-            GdkPixbuf *pix, *pix_rotated;
-            GdkPixbufRotation rot;
-                
-            if (img->rotate == 90)
-                rot = GDK_PIXBUF_ROTATE_CLOCKWISE;
-            else
-                rot = GDK_PIXBUF_ROTATE_COUNTERCLOCKWISE;
-                
-            pix = gdk_pixbuf_loader_get_pixbuf(loader);
-            pix_rotated = gdk_pixbuf_rotate_simple(pix, rot);
-                
-            img->image = gtk_image_new_from_pixbuf(pix_rotated);
-        } else {
-            img->image = gtk_image_new_from_pixbuf
-                (gdk_pixbuf_loader_get_pixbuf(loader));
-        }
+        if (img->rotate == 90)
+            rot = GDK_PIXBUF_ROTATE_CLOCKWISE;
+        else
+            rot = GDK_PIXBUF_ROTATE_COUNTERCLOCKWISE;
         
-        gtk_container_add( GTK_CONTAINER( img->button ), img->image);
-        gtk_container_set_border_width( GTK_CONTAINER( img->button ), 
-                                        PWGALLERY_THUMBNAIL_BORDER_WIDTH );
+        pixbuf = gdk_pixbuf_rotate_simple(pixbuf, rot);
+    } else {
+        g_object_ref(pixbuf);
+    }
+
+    /* the pixbuf is kept, the loader is not needed anymore */
+    g_object_unref(loader);
+
+    /* FIXME: adjust gamma, etc */
+
+    return pixbuf;
+}
+
+
+
+GdkPixbuf *
+image_load_thumbnail(struct data *data, struct image *img)
+{
+    GdkPixbuf         *pixbuf, *rotated;
+    GdkPixbufRotation rot;
+
+	g_assert(data != NULL);
+	g_assert(img != NULL);
+
+	g_debug("in %s", __func__);
+
+    /* saved the last time the image was shown */
+    pixbuf = thumbcache_lookup(data, img);
+    if (pixbuf != NULL) {
+        return pixbuf;
+    }
+
+    pixbuf = _load_thumbnail(data, img);
+    if (pixbuf == NULL) {
+        return NULL;
+    }
+
+    if (img->rotate == 90 || img->rotate == 270) {
+        if (img->rotate == 90)
+            rot = GDK_PIXBUF_ROTATE_CLOCKWISE;
+        else
+            rot = GDK_PIXBUF_ROTATE_COUNTERCLOCKWISE;
+
+        rotated = gdk_pixbuf_rotate_simple(pixbuf, rot);
+        g_object_unref(pixbuf);
+        pixbuf = rotated;
+    }
+
+    thumbcache_store(data, img, pixbuf);
+
+    return pixbuf;
+}
+
+
+
+GdkPixbuf *
+image_load_preview(struct data *data, const gchar *uri)
+{
+    struct image *img;
+    GdkPixbuf    *pixbuf;
+
+	g_assert(data != NULL);
+	g_assert(uri != NULL);
+
+	g_debug("in %s", __func__);
+
+    /* a not rotated thumbnail of an image not in the gallery */
+    img = image_init(data);
+    g_free(img->uri);
+    img->uri = g_strdup(uri);
+    vfs_stat(data, img->uri, &img->file_size, &img->mtime);
+
+    pixbuf = image_load_thumbnail(data, img);
+
+    image_free(img);
+
+    return pixbuf;
+}
+
+
+/**********************
+ *                    *
+ * Static functions   *
+ *                    *
+ **********************/
+
+
+/*
+ * Open an image. If the image already has a size and the same size
+ * and mtime as the file, its size and EXIF data are used without
+ * reading the file.
+ */
+static gboolean
+_open(struct data *data, struct image *img, gint rotate)
+{
+	gchar            *tmpp;
+    goffset          file_size = -1;
+    glong            mtime = -1;
+    gboolean         use_cache = FALSE;
+
+    if (img->width > 0 && img->height > 0) {
+        vfs_stat(data, img->uri, &file_size, &mtime);
+        use_cache = (mtime != -1 && img->mtime == mtime &&
+                     img->file_size == file_size);
     }
 
-    /* Set default values for a new image */
-	img->nomodify = FALSE;
-    img->gamma = 1.0;
+    if (use_cache) {
+        g_debug("%s: using cached metadata", __func__);
+    } else {
+        /* the cached data is stale, read the file */
+        img->width = 0;
+        img->height = 0;
+        exif_free(img->exif);
+        img->exif = exif_new();
+        if (!_read(data, img)) {
+            return FALSE;
+        }
+    }
 
-    g_free(img->text);
-    img->text = g_strdup( _("") );
+    /* set rotation */
+    img->rotate = img->exif->orientation;
+    if (rotate != -1) {
+        img->rotate = rotate;
+    }
 
     /* get basename of the file without extension and just the extension  */
     g_free(img->basefilename);
@@ -264,60 +445,192 @@ image_open(struct data *data, gchar *uri, gint rotate)
     }
 
     g_debug("img: %dx%d", img->width, img->height);
-    return img;	
+    return TRUE;
 }
 
 
 
-gboolean
-image_is_edited(struct data *data, struct image *img)
+/*
+ * Read everything needed to open a new or changed image with one open
+ * and one pass over the beginning of the file: the size and mtime of
+ * the file, the size of the image and the EXIF data. The thumbnails
+ * are decoded later when shown. Returns FALSE if the file can't be
+ * read or is not an image.
+ */
+static gboolean
+_read(struct data *data, struct image *img)
 {
-    gchar *urimatch;
-    gboolean is_edited;
+    GByteArray        *header;
+	GnomeVFSResult    result;
+	GnomeVFSHandle    *handle;
+	GnomeVFSFileSize  bytes;
+    enum probe_result probe = PROBE_NEED_MORE;
+    guint             len;
+    gboolean          ok = TRUE;
 
 	g_assert(data != NULL);
 	g_assert(img != NULL);
 
-	g_debug("in image_is_edited");
+	g_debug("in %s", __func__);
 
-    urimatch = g_strdup_printf("/edited/%s.%s", img->basefilename, img->ext);
+	result = gnome_vfs_open(&handle, img->uri, GNOME_VFS_OPEN_READ);
+	if (result != GNOME_VFS_OK) {
+        /* FIXME: popup */
+        g_warning("Skipping image because of error opening '%s': %s",
+                  img->uri, gnome_vfs_result_to_string(result));
+        return FALSE;
+    }
 
-    is_edited = g_str_has_suffix(img->uri, urimatch);
-    g_free(urimatch);
+    /* size and mtime for validating the cache the next time */
+    if (!vfs_stat_handle(data, handle, &img->file_size, &img->mtime)) {
+        img->file_size = -1;
+        img->mtime = -1;
+    }
 
-    return is_edited;
+    /* read until the size is found in the header, the magic bytes
+     * tell the format */
+    header = g_byte_array_new();
+    while (probe == PROBE_NEED_MORE && 
+           header->len < PWGALLERY_PROBE_MAX_LEN) {
+        len = header->len;
+        g_byte_array_set_size(header, len + PWGALLERY_HEADER_READ_SIZE);
+        result = gnome_vfs_read(handle, header->data + len,
+                                PWGALLERY_HEADER_READ_SIZE, &bytes);
+        if (result != GNOME_VFS_OK)
+            bytes = 0;
+        g_byte_array_set_size(header, len + bytes);
+
+        if (result == GNOME_VFS_ERROR_EOF)
+            break;
+
+        if (result != GNOME_VFS_OK) {
+            /* FIXME: popup */
+            g_warning("Skipping image because of read error '%s': %s",
+                      img->uri, gnome_vfs_result_to_string(result));
+            ok = FALSE;
+            break;
+        }
+
+        probe = probe_size(header->data, header->len,
+                           &img->width, &img->height);
+    }
+
+    /* the EXIF data is in the header too */
+    if (ok && header->len > 0) {
+        exif_data_parse(data, img, header->data, header->len);
+    }
+
+    /* not a format known by the probe */
+    if (ok && probe != PROBE_FOUND) {
+        ok = _read_size(data, img, handle, header);
+    }
+
+	gnome_vfs_close(handle); /* ignore result */
+    g_byte_array_free(header, TRUE);
+
+    return ok;
 }
 
 
 
-gboolean
-image_load_ss_pixbuf(struct data *data, struct image *img)
+/*
+ * Give the header already read and then the rest of the file to the
+ * pixbuf loader until it has found the size of the image. The loader
+ * recognizes the format. Returns FALSE if it is not an image.
+ */
+static gboolean
+_read_size(struct data *data, struct image *img,
+           GnomeVFSHandle *handle, GByteArray *header)
+{
+    GdkPixbufLoader  *loader;
+    guchar           buf[PWGALLERY_IMG_READ_BUF_SIZE];
+	GnomeVFSResult   result;
+	GnomeVFSFileSize bytes;
+	GError           *error = NULL;
+    const guchar     *next;
+
+	g_debug("in %s", __func__);
+
+    img->width = 0;
+    img->height = 0;
+
+    loader = gdk_pixbuf_loader_new();
+    g_signal_connect(loader, "size-prepared", G_CALLBACK(set_size), img);
+
+    next = header->data;
+    bytes = header->len;
+    while (bytes > 0) {
+        if (gdk_pixbuf_loader_write(loader, next, bytes, &error) == FALSE) {
+            /* FIXME: popup */
+            g_warning("Skipping image because of parse error '%s': %s",
+                      img->uri, error->message);
+            g_error_free(error);
+            break;
+        }
+
+        /* the pixels are not needed */
+        if (img->width > 0)
+            break;
+
+        result = gnome_vfs_read(handle, buf,
+                                PWGALLERY_IMG_READ_BUF_SIZE, &bytes);
+        if (result != GNOME_VFS_OK)
+            break;
+        next = buf;
+    }
+
+    /* stopping in the middle of the image is not an error here */
+    gdk_pixbuf_loader_close(loader, NULL);
+    g_object_unref(loader);
+
+    if (img->width == 0) {
+        g_warning("%s: not an image: %s", __func__, img->uri);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+
+/*
+ * Decode the image to a thumbnail, not rotated. Returns NULL on error.
+ */
+static GdkPixbuf *
+_load_thumbnail(struct data *data, struct image *img)
 {
     GdkPixbufLoader  *loader;
+    GdkPixbuf        *pixbuf;
     guchar           buf[PWGALLERY_IMG_READ_BUF_SIZE];
 	GnomeVFSResult   result;
 	GnomeVFSHandle   *handle;
 	GnomeVFSFileSize bytes;
 	GError           *error = NULL;
+	GnomeVFSURI*     vfsuri = NULL;
+    gchar            *uri;
 
 	g_assert(data != NULL);
 	g_assert(img != NULL);
 
 	g_debug("in %s", __func__);
 
+    uri = img->uri;
+
 	/* open image */
-	result = gnome_vfs_open_uri(&handle, gnome_vfs_uri_new(img->uri),
+	vfsuri = gnome_vfs_uri_new(uri);
+	result = gnome_vfs_open_uri(&handle, vfsuri,
 								GNOME_VFS_OPEN_READ);
+	gnome_vfs_uri_unref(vfsuri);
 	if (result != GNOME_VFS_OK) {
         /* FIXME: popup */
-        g_warning("Failed to open slide show image '%s': %s", img->uri, 
+        g_warning("Skipping image because of error opening '%s': %s", uri, 
                   gnome_vfs_result_to_string(result));
-        return FALSE;
+        /* FIXME: show invalid image? */
+        return NULL;
     }
 
-    data->ss_resize_img = img;
     loader = gdk_pixbuf_loader_new();
-    g_signal_connect(loader, "size-prepared", G_CALLBACK(set_ss_size), data);
+    g_signal_connect(loader, "size-prepared", G_CALLBACK(set_size), img);
 
 	/* read image from the file */
 	while (TRUE) {
@@ -331,20 +644,24 @@ image_load_ss_pixbuf(struct data *data, struct image *img)
         /* error reading */
         if (result != GNOME_VFS_OK) {
             /* FIXME: popup */
-            g_warning("Failed to load slow show image '%s': %s", img->uri, 
+            g_warning("Skipping image because of read error '%s': %s", uri, 
                       gnome_vfs_result_to_string(result));
+            gnome_vfs_close(handle);
             gdk_pixbuf_loader_close (loader, NULL);
-            return FALSE;
+            g_object_unref(loader);
+            return NULL;
         }
 
         /* error parsing image data */
         if (gdk_pixbuf_loader_write(loader, buf, bytes, &error) == FALSE) {
             gdk_pixbuf_loader_close (loader, NULL);
             /* FIXME: popup */
-            g_warning("Failed to parse slide show image '%s': %s", img->uri,
+            g_warning("Skipping image because of parse error '%s': %s", uri,
                       error->message);
             g_error_free(error);
-            return FALSE;
+            gnome_vfs_close(handle);
+            g_object_unref(loader);
+            return NULL;
         }
 		
     }
@@ -353,43 +670,20 @@ image_load_ss_pixbuf(struct data *data, struct image *img)
 
     gdk_pixbuf_loader_close(loader, NULL); /* no more writes */
 
-    img->ss_pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
-    if (img->ss_pixbuf == NULL) {
-        return FALSE;
-    }
-
-    if (img->rotate == 90 || img->rotate == 270) {
-        GdkPixbuf *orig;
-        GdkPixbufRotation rot;
-        
-        orig = img->ss_pixbuf;
-
-        if (img->rotate == 90)
-            rot = GDK_PIXBUF_ROTATE_CLOCKWISE;
-        else
-            rot = GDK_PIXBUF_ROTATE_COUNTERCLOCKWISE;
-        
-        img->ss_pixbuf = gdk_pixbuf_rotate_simple(orig, rot);
-        g_object_unref(orig);
-    }
-
-    if (img->ss_pixbuf == NULL) {
-        return FALSE;
+    pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
+    if (pixbuf != NULL) {
+        g_object_ref(pixbuf);
+    } else {
+        /* FIXME: popup */
+        g_warning("Skipping image because of parse error '%s'", uri);
     }
-    g_object_ref(img->ss_pixbuf);
 
-    /* FIXME: adjust gamma, etc */
+    g_object_unref(loader);
 
-    return TRUE;	
+    return pixbuf;
 }
 
 
-/**********************
- *                    *
- * Static functions   *
- *                    *
- **********************/
-
 
 /*
  * Calculate the size for thumbnails
@@ -407,19 +701,16 @@ set_size( GdkPixbufLoader *gdkpixbufloader, gint arg1, gint arg2, gpointer data)
 
     img = data;
     
-    if (img->rotate == 90 || img->rotate == 270) {
-        scale = (gdouble)arg2 / (gdouble)arg1;
-        
-        /* FIXME: get this from the width of the gtk_table? */
-        h = PWGALLERY_THUMB_W;
-        w = (gint)(h / scale);
-
-    } else {
+    /* Fit the longer side to the thumbnail list row, so that every row
+     * has the same height whatever the rotation. */
+    if (arg1 > arg2) {
         scale = (gdouble)arg1 / (gdouble)arg2;
-        
-        /* FIXME: get this from the width of the gtk_table? */
         w = PWGALLERY_THUMB_W;
         h = (gint)(w / scale);
+    } else {
+        scale = (gdouble)arg2 / (gdouble)arg1;
+        h = PWGALLERY_THUMB_W;
+        w = (gint)(h / scale);
     }
 
     g_debug("in set_size: %dx%d -> %dx%d",  arg1, arg2, w, h);
@@ -442,21 +733,18 @@ set_ss_size(GdkPixbufLoader *gdkpixbufloader,
 {
     gint         w, h, fs_w, fs_h;
     gdouble      img_scale, fs_scale;
-    struct data *data;
+    struct ss_size *ss_size;
     struct image *img;
-    GdkScreen *screen;
 
 	g_assert(user_data != NULL );
 
     g_debug("in %s", __func__ );
 
-    data = user_data;
-    img = data->ss_resize_img;
-
-    screen = gdk_display_get_screen(gdk_display_get_default(), 0);
+    ss_size = user_data;
+    img = ss_size->img;
 
-    fs_w = gdk_screen_get_width(screen);
-    fs_h = gdk_screen_get_height(screen);
+    fs_w = ss_size->screen_w;
+    fs_h = ss_size->screen_h;
 
     fs_scale = (gdouble)fs_w / (gdouble)fs_h;
 
@@ -27,6 +27,7 @@
 #include "main.h"
 
 #include <glib.h>
+#include <gtk/gtk.h>
 
 /* 
  * Initialize image
@@ -38,15 +39,46 @@ struct image * image_init(struct data *data);
  */
 void image_free(struct image *img);
 
+/*
+ * Copy the settings and the original's details of the image. The
+ * sizes of the made images are not copied.
+ */
+struct image *image_copy(struct data *data, const struct image *img);
+
 /*
  * Open image. *uri cannot be used once this is called.
  */
 struct image *image_open(struct data *data, gchar *uri, gint rotate);
 
 /*
- * Load an image from file to a pixbuf and scale it to full screen
+ * Open an image read from a saved gallery in place, keeping its
+ * settings. The size and EXIF data cached in the gallery file are
+ * used if the size and mtime of the file still match. Returns FALSE
+ * if the image can't be opened.
+ */
+gboolean image_open_saved(struct data *data, struct image *img);
+
+/*
+ * Load an image from file to a pixbuf scaled to fit the screen of the
+ * given size. Can be called in any thread. Loading is abandoned when
+ * *cancel becomes non-zero, if cancel is given. Returns a new pixbuf
+ * or NULL.
+ */
+GdkPixbuf *image_load_ss_pixbuf(struct data *data, struct image *img,
+                                gint screen_w, gint screen_h, gint *cancel);
+
+/*
+ * Get a rotated thumbnail of the image for the thumbnail list from the
+ * thumbnail cache, or decode and cache it. Returns a new pixbuf or
+ * NULL on error.
+ */
+GdkPixbuf *image_load_thumbnail(struct data *data, struct image *img);
+
+/*
+ * Load a thumbnail of an image file for the file chooser preview. It
+ * is the same as the thumbnail of a not rotated image in the list.
  */
-gboolean image_load_ss_pixbuf(struct data *data, struct image *img);
+GdkPixbuf *image_load_preview(struct data *data, const gchar *uri);
 
 /*
  * Check if the image is edited (the last dir in uri is 'edited')
@@ -0,0 +1,451 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "main.h"
+#include "import.h"
+#include "image.h"
+#include "gallery.h"
+#include "widgets.h"
+#include "thumbview.h"
+#include "model.h"
+#include "pool.h"
+
+#include <glib.h>
+
+/* How often (ms) the opened images are added in the GUI */
+#define PWGALLERY_IMPORT_INTERVAL        100
+
+struct import_slot
+{
+    struct import  *import;            /* import of the image */
+    gchar          *uri;               /* uri of a new image or NULL */
+    struct image   *image;             /* opened or saved image */
+    gboolean       is_new;             /* new image, gallery gets edited */
+    gboolean       done;               /* opened or failed */
+};
+
+struct import
+{
+    struct data    *data;
+    struct pool_batch *batch;          /* open jobs */
+    GPtrArray      *slots;             /* struct import_slot in order */
+    guint          next;               /* first slot not added yet */
+    guint          added;              /* images added to the gallery */
+    GMutex         mutex;              /* protects the slots and cancel */
+    gboolean       cancel;             /* jobs skip the rest */
+    gboolean       busy;               /* adding images in the main loop */
+    guint          timer;              /* timer adding the images or 0 */
+};
+
+static struct import *_get(struct data *data);
+static void _push(struct import *import, gchar *uri, struct image *img);
+static void _run(struct import *import);
+static gboolean _open_job(gpointer user_data);
+static gboolean _add_ready(gpointer user_data);
+static void _add(struct import *import, struct import_slot *slot);
+static void _discard(struct import *import);
+static void _finish(struct import *import);
+
+
+
+void
+import_uris(struct data *data, GSList *uris)
+{
+    struct import *import;
+    GSList        *list;
+
+    g_assert(data != NULL);
+
+    g_debug("in import_uris");
+
+    if (uris == NULL)
+        return;
+
+    import = _get(data);
+    for (list = uris; list != NULL; list = list->next) {
+        _push(import, list->data, NULL);
+    }
+	g_slist_free(uris);
+
+    _run(import);
+}
+
+
+
+void
+import_saved(struct data *data, GSList *imgs)
+{
+    struct import *import;
+    GSList        *list;
+
+    g_assert(data != NULL);
+
+    g_debug("in import_saved");
+
+    if (imgs == NULL)
+        return;
+
+    import = _get(data);
+    for (list = imgs; list != NULL; list = list->next) {
+        _push(import, NULL, list->data);
+    }
+	g_slist_free(imgs);
+
+    _run(import);
+}
+
+
+
+void
+import_cancel(struct data *data)
+{
+    struct import *import;
+
+    g_assert(data != NULL);
+
+    import = data->import;
+    if (import == NULL)
+        return;
+
+    g_debug("in import_cancel");
+
+    /* images given after this start a new import */
+    data->import = NULL;
+
+    g_mutex_lock(&import->mutex);
+    import->cancel = TRUE;
+    g_mutex_unlock(&import->mutex);
+
+    /* cancelled while updating the progress, freed when it returns */
+    if (import->busy)
+        return;
+
+    _discard(import);
+}
+
+
+
+/**********************
+ *                    *
+ * Static functions   *
+ *                    *
+ **********************/
+
+
+/*
+ * Get the running import or start a new one. Images given while an
+ * import is running are added after the ones already given.
+ */
+static struct import *
+_get(struct data *data)
+{
+    struct import *import;
+
+    if (data->import != NULL)
+        return data->import;
+
+    /* these run the main loop, so before there is anything to cancel */
+    widgets_set_status(data, _("Adding images"));
+    widgets_show_cancel(data, TRUE);
+
+    import = g_new0(struct import, 1);
+    import->data = data;
+    import->batch = pool_batch_new(gallery_get_pool(data));
+    import->slots = g_ptr_array_new();
+    g_mutex_init(&import->mutex);
+
+    data->import = import;
+
+    return import;
+}
+
+
+
+/*
+ * Queue a new image by uri or a saved image to be opened
+ */
+static void
+_push(struct import *import, gchar *uri, struct image *img)
+{
+    struct import_slot *slot;
+
+    slot = g_new0(struct import_slot, 1);
+    slot->import = import;
+    slot->uri = uri;
+    slot->image = img;
+    slot->is_new = (uri != NULL);
+
+    g_mutex_lock(&import->mutex);
+    g_ptr_array_add(import->slots, slot);
+    g_mutex_unlock(&import->mutex);
+
+    pool_push(import->batch, _open_job, slot);
+}
+
+
+
+/*
+ * Add the images as they are ready. Without the GUI there is no main
+ * loop, so wait for all of them.
+ */
+static void
+_run(struct import *import)
+{
+    if (!import->data->use_gui) {
+        pool_batch_wait(import->batch, NULL, NULL);
+        _add_ready(import);
+        return;
+    }
+
+    if (import->timer == 0) {
+        import->timer = g_timeout_add(PWGALLERY_IMPORT_INTERVAL,
+                                      _add_ready, import);
+    }
+}
+
+
+
+/*
+ * Open an image in a worker thread
+ */
+static gboolean
+_open_job(gpointer user_data)
+{
+    struct import_slot *slot;
+    struct import      *import;
+    struct image       *img;
+    gboolean           cancel;
+
+    g_assert(user_data != NULL);
+
+    slot = user_data;
+    import = slot->import;
+
+    g_mutex_lock(&import->mutex);
+    cancel = import->cancel;
+    g_mutex_unlock(&import->mutex);
+
+    if (cancel)
+        return TRUE;
+
+    if (slot->is_new) {
+        /* Set rotate to -1 to choose the exif rotation */
+        img = image_open(import->data, slot->uri, -1);
+    } else {
+        /* use the metadata cached in the gallery, if still valid */
+        img = slot->image;
+        if (!image_open_saved(import->data, img)) {
+            image_free(img);
+            img = NULL;
+        }
+    }
+
+    g_mutex_lock(&import->mutex);
+    slot->uri = NULL; /* taken by image_open */
+    slot->image = img;
+    slot->done = TRUE;
+    g_mutex_unlock(&import->mutex);
+
+    return TRUE;
+}
+
+
+
+/*
+ * Add the opened images to the gallery in the given order. Stops at
+ * the first image still being opened.
+ */
+static gboolean
+_add_ready(gpointer user_data)
+{
+    struct import      *import;
+    struct import_slot *slot;
+    GPtrArray          *ready;
+    guint              i;
+	gchar              p_text[128];
+
+    g_assert(user_data != NULL);
+
+    import = user_data;
+    ready = g_ptr_array_new();
+
+    g_mutex_lock(&import->mutex);
+    while (import->next < import->slots->len) {
+        slot = g_ptr_array_index(import->slots, import->next);
+        if (!slot->done)
+            break;
+        g_ptr_array_add(ready, slot);
+        import->next++;
+    }
+    g_mutex_unlock(&import->mutex);
+
+    for (i = 0; i < ready->len; i++) {
+        _add(import, g_ptr_array_index(ready, i));
+    }
+    g_ptr_array_free(ready, TRUE);
+
+    /* updating the progress runs the main loop, which may cancel */
+    import->busy = TRUE;
+    g_snprintf(p_text, 128, "%d/%d", import->added, import->slots->len);
+    widgets_set_progress(import->data, (gfloat)import->added /
+                         (gfloat)import->slots->len, p_text);
+    import->busy = FALSE;
+
+    /* the timer is removed by returning FALSE */
+    if (import->cancel) {
+        import->timer = 0;
+        _discard(import);
+        return FALSE;
+    }
+
+    if (import->next < import->slots->len)
+        return TRUE; /* more to come */
+
+    import->timer = 0;
+    _finish(import);
+
+    return FALSE;
+}
+
+
+
+/*
+ * Add an opened image to the gallery
+ */
+static void
+_add(struct import *import, struct import_slot *slot)
+{
+    struct data *data;
+
+    data = import->data;
+
+    if (slot->image == NULL) {
+        g_warning("Failed to open image");
+        return;
+    }
+
+    model_append(data->gal->model, slot->image);
+    thumbview_append(data, slot->image);
+    g_debug("Added %s", slot->image->uri);
+
+    import->added++;
+
+    if (slot->is_new) {
+        /* gallery edited */
+        data->gal->edited = TRUE;
+    }
+
+    /* select the first image, if there were no images before */
+    if (data->current_img == NULL) {
+        data->current_img = slot->image;
+        /* update the image text etc shown in the main window */
+        widgets_set_image_information(data, data->current_img);
+    }
+}
+
+
+
+/*
+ * Cancelled, wait for the jobs opening an image and free the images
+ * not added
+ */
+static void
+_discard(struct import *import)
+{
+    struct import_slot *slot;
+    guint              i;
+
+    pool_batch_wait(import->batch, NULL, NULL);
+
+    for (i = import->next; i < import->slots->len; i++) {
+        slot = g_ptr_array_index(import->slots, i);
+        if (slot->image != NULL)
+            image_free(slot->image);
+        g_free(slot->uri);
+    }
+    import->next = import->slots->len;
+
+    _finish(import);
+}
+
+
+
+/*
+ * All images added or cancelled, free the import
+ */
+static void
+_finish(struct import *import)
+{
+    struct data *data;
+	gint        tot_files;
+	gchar       p_text[128];
+    guint       i;
+
+    data = import->data;
+
+    g_debug("in %s: %d images added", __func__, import->added);
+
+    /* the last jobs may still be returning */
+    pool_batch_wait(import->batch, NULL, NULL);
+    pool_batch_free(import->batch);
+
+    if (import->timer != 0)
+        g_source_remove(import->timer);
+
+    for (i = 0; i < import->slots->len; i++) {
+        g_free(g_ptr_array_index(import->slots, i));
+    }
+    g_ptr_array_free(import->slots, TRUE);
+
+    if (data->import == import)
+        data->import = NULL;
+
+    g_mutex_clear(&import->mutex);
+    g_free(import);
+
+    /* a new import was started after cancelling this one */
+    if (data->import != NULL)
+        return;
+
+    /* select the current image */
+    widgets_update_table(data);
+    widgets_show_cancel(data, FALSE);
+
+    /* total files now in the gallery */
+	tot_files = model_length(data->gal->model);
+
+	/* set progress and status */
+	widgets_set_progress(data, 0, _("Idle"));
+	g_snprintf(p_text, 128, "%d %s", tot_files, 
+               tot_files == 1 ? _("Image") : _("Images"));
+	widgets_set_status(data, p_text);
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#ifndef PWGALLERY_IMPORT_H
+#define PWGALLERY_IMPORT_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "main.h"
+
+#include <glib.h>
+
+/*
+ * Images are opened on the worker pool. In the GUI the opened images
+ * are added to the gallery from the main loop as they are ready, in
+ * the order they were given. Without the GUI the functions return
+ * only when all images are added.
+ */
+struct import;
+
+/*
+ * Open new images and add them to the gallery. Takes the list and the
+ * uris.
+ */
+void import_uris(struct data *data, GSList *uris);
+
+/*
+ * Open images read from a gallery file in place and add them to the
+ * gallery. Takes the list and the images, the ones that fail to open
+ * are freed.
+ */
+void import_saved(struct data *data, GSList *imgs);
+
+/*
+ * Stop adding images. The images not added yet are freed.
+ */
+void import_cancel(struct data *data);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
@@ -26,140 +26,232 @@
 #include "gallery.h"
 #include "vfs.h"
 #include "magick.h"
+#include "manifest.h"
 
 #include <glib.h>                 /* glib */
 #include <wand/magick-wand.h>     /* ImageMagick */
 #include <wand/pixel-wand.h>      /* ImageMagick */
-#include <libgnomevfs/gnome-vfs.h>/* gnome_vfs_get_file_info */
+#include <stdlib.h>               /* qsort */
 
 static gboolean _apply_modifications(struct data *data, 
                                      MagickWand *wand, 
                                      struct image *image);
+static gboolean _make_outputs(struct data *data, 
+                              struct image *image,
+                              struct vfs_view *view,
+                              struct magick_output **order,
+                              gint n_make);
 static gboolean _load_image(struct data *data, 
                             MagickWand *wand, 
-                            struct image *image);
+                            struct image *image,
+                            struct vfs_view *view,
+                            gint width,
+                            gint height);
 static gboolean _resize(struct data *data,
                         MagickWand *wand, 
                         struct image *image,
                         gint width,
                         gint height);
-static gboolean _save(struct data *data, 
-                      MagickWand *wand, 
-                      const gchar *uri);
+static gboolean _encode(struct data *data, 
+                        MagickWand *wand, 
+                        struct magick_output *out);
+static void _thumbnail_size(struct image *image, gint thumb_w,
+                            gint *width, gint *height);
+static void _webimage_size(struct image *image, gint image_h,
+                           gint *width, gint *height);
+static gint _sort_outputs_by_area(gconstpointer a, gconstpointer b);
 static MagickWand *_generate_webimage(struct data *data, 
                                       struct image *image,
                                       gint image_h,
                                       struct image_size **img_size);
+static void _count_decoders(gint change);
+
+/* ImageMagick's pixel cache may use this many times the memory budget
+ * in memory mapped files and on the disk */
+#define PWGALLERY_MAGICK_MAP_FACTOR  2
+#define PWGALLERY_MAGICK_DISK_FACTOR 8
+
+/* originals being decoded in the process, by all the galleries */
+static gint _decoders;
 
+/* protects _decoders and the thread limit following it */
+static GMutex _decoders_mutex;
 
-gboolean magick_make_thumbnail(struct data *data, 
-                               struct image *image,
-                               const gchar *uri)
+
+gboolean magick_make_images(struct data *data, 
+                            struct image *image,
+                            struct vfs_view *view,
+                            struct magick_output *outputs,
+                            gint n_outputs)
 {
-    MagickWand *wand;
-    gdouble scale;
+    struct magick_output **order;
+    GSList *list;
+    gint i, n_make = 0;
+    gboolean ok = TRUE;
 
     g_assert(data != NULL);
     g_assert(image != NULL);
+    g_assert(outputs != NULL);
     
-    g_debug("in magick_make_thumbnail");
+    g_debug("in magick_make_images");
 
-    wand = NewMagickWand();
-    g_return_val_if_fail( wand, FALSE );
-
-    /* load image from file */
-    if (!_load_image(data, wand, image)) {
-        DestroyMagickWand(wand);
-        return FALSE;
+    /* forget the sizes of a possible previous make */
+    list = image->sizes;
+    while(list) {
+        g_free(list->data);
+        list = g_slist_delete_link(list, list);
     }
+    image->sizes = NULL;
 
-    /* apply modifications, if nomodify is not checked */
-    if (!image->nomodify) {
-        if (!_apply_modifications(data, wand, image)) {
-            DestroyMagickWand(wand);
-            return FALSE;
+    /* calculate the sizes of the outputs to be made */
+    order = g_new(struct magick_output *, n_outputs);
+    for (i = 0; i < n_outputs; i++) {
+        struct magick_output *out = &outputs[i];
+
+        /* up to date from a previous make */
+        if (out->current) {
+            continue;
+        }
+
+        if (out->thumb_w != 0) {
+            _thumbnail_size(image, out->thumb_w, &out->out_w, &out->out_h);
+        } else if (image->nomodify) {
+            /* no modify, just use the original size */
+            out->out_w = image->width;
+            out->out_h = image->height;
+        } else {
+            _webimage_size(image, out->height, &out->out_w, &out->out_h);
         }
+        out->size = 0;
+        order[n_make++] = out;
     }
-    
-    /* calculate width and height for the thumbnail */
-    image->thumb_w = data->gal->thumb_w;
-    switch( image->rotate ) 
-    {
-    case 0:
-    case 180:
-        scale = (gdouble)image->height / (gdouble)image->width;
-        break;
-    case 90:
-    case 270:
-        scale = (gdouble)image->width / (gdouble)image->height;
-        break;
-        /* FIXME: just to get some values.. */
-    default:
-        scale = (gdouble)image->width / (gdouble)image->height;
-        break;
+
+    /* decode the original only if something is to be made */
+    if (n_make > 0 && view == NULL) {
+        /* the original could not be read */
+        ok = FALSE;
+    } else if (n_make > 0) {
+        _count_decoders(1);
+        ok = _make_outputs(data, image, view, order, n_make);
+        _count_decoders(-1);
     }
-    image->thumb_h = (gint)(image->thumb_w * scale);
-    g_debug("%d x %d", image->width, image->height);
-    g_debug("%d x %d, rotate: %d, scale: %f", image->thumb_w, image->thumb_h, image->rotate, scale);
-    /* resize the thumbnail */
-    if (!_resize(data, wand, image, image->thumb_w, image->thumb_h)) {
-        DestroyMagickWand(wand);
+    g_free(order);
+
+    if (!ok) {
+        /* drop the images encoded before the failure */
+        for (i = 0; i < n_outputs; i++) {
+            if (outputs[i].blob != NULL) {
+                MagickRelinquishMemory(outputs[i].blob);
+                outputs[i].blob = NULL;
+                outputs[i].blob_len = 0;
+            }
+        }
         return FALSE;
     }
 
-    
-    /* save the thumbnail to a file */
-    if (!_save(data, wand, uri)) {
-        DestroyMagickWand(wand);
-        return FALSE;
+    /* store the results in the order the outputs were given */
+    for (i = 0; i < n_outputs; i++) {
+        struct magick_output *out = &outputs[i];
+        struct image_size *img_size;
+
+        if (out->thumb_w != 0) {
+            image->thumb_w = out->out_w;
+            image->thumb_h = out->out_h;
+            continue;
+        }
+
+        img_size = g_new0(struct image_size, 1);
+        img_size->width = out->out_w;
+        img_size->height = out->out_h;
+        img_size->size = out->size;
+        image->sizes = g_slist_append(image->sizes, img_size);
     }
-    
-    DestroyMagickWand(wand);
 
     return TRUE;
 }
 
 
-gboolean magick_make_webimage(struct data *data, 
-                              struct image *image,
-                              const gchar *uri,
-                              gint image_h)
-{
-    MagickWand *wand;
-    struct image_size *img_size = NULL;
-    GnomeVFSResult result;
-    GnomeVFSFileInfo *info;
 
-    g_debug("in magick_make_webimage");
+gint64 magick_estimate_memory(struct image *image,
+                              struct magick_output *outputs,
+                              gint n_outputs)
+{
+    size_t depth;
+    gint i;
 
-    wand = _generate_webimage(data, image, image_h, &img_size);
-    if (wand == NULL) 
-        return FALSE;
+    g_assert(image != NULL);
+    g_assert(outputs != NULL);
 
-    /* save the image to a file */
-    if (!_save(data, wand, uri)) {
-        DestroyMagickWand(wand);
-        g_free(img_size);
-        return FALSE;
+    for (i = 0; i < n_outputs; i++) {
+        if (!outputs[i].current)
+            break;
     }
-    
-    DestroyMagickWand(wand);
+    if (i == n_outputs)
+        return 0;
 
-    /* get file size */
-    info = gnome_vfs_file_info_new();
-    result = gnome_vfs_get_file_info(uri, info,
-                                     GNOME_VFS_FILE_INFO_DEFAULT | 
-                                     GNOME_VFS_FILE_INFO_FOLLOW_LINKS);
-    if (result == GNOME_VFS_OK) {
-        img_size->size = info->size / 1024;
-    } else {
-        img_size->size = 0;
+    if (image->width <= 0 || image->height <= 0)
+        return -1;
+
+    /* pixels are stored as four channels at the quantum depth */
+    MagickGetQuantumDepth(&depth);
+
+    /* the decoded original and the rotated or resized copy made of it */
+    return (gint64)image->width * image->height * 4 * (depth / 8) * 2;
+}
+
+
+
+void magick_set_memory_limit(guint64 limit)
+{
+    g_debug("in magick_set_memory_limit: %" G_GUINT64_FORMAT, limit);
+
+    /* Past the memory limit pixels go to memory mapped files and then
+     * to the disk cache. Those get a multiple of the budget, so that a
+     * huge image admitted alone is made slowly instead of failing. */
+    MagickSetResourceLimit(MemoryResource, limit);
+    MagickSetResourceLimit(MapResource,
+                           limit * PWGALLERY_MAGICK_MAP_FACTOR);
+    MagickSetResourceLimit(DiskResource,
+                           limit * PWGALLERY_MAGICK_DISK_FACTOR);
+}
+
+
+
+gboolean magick_write_outputs(struct manifest *manifest,
+                              struct magick_output *outputs,
+                              gint n_outputs)
+{
+    gint i;
+    gboolean ok = TRUE;
+
+    g_assert(manifest != NULL);
+    g_assert(outputs != NULL);
+
+    g_debug("in magick_write_outputs");
+
+    for (i = 0; i < n_outputs; i++) {
+        struct magick_output *out = &outputs[i];
+
+        /* up to date from a previous make */
+        if (out->current) {
+            continue;
+        }
+
+        if (out->blob == NULL) {
+            /* the output was not encoded */
+            ok = FALSE;
+        } else if (ok) {
+            /* after a failure the rest are only freed */
+            ok = manifest_stage_file(manifest, out->uri, out->blob,
+                                     out->blob_len);
+        }
+
+        MagickRelinquishMemory(out->blob);
+        out->blob = NULL;
+        out->blob_len = 0;
     }
-    
-    image->sizes = g_slist_append(image->sizes, img_size);
-    gnome_vfs_file_info_unref(info);
 
-    return TRUE;
+    return ok;
 }
 
 
@@ -213,7 +305,8 @@ static MagickWand *_generate_webimage(struct data *data,
 {
 
     MagickWand *wand;
-    gdouble scale;
+    struct vfs_view *view;
+    gboolean ok;
 
     g_assert(data != NULL);
     g_assert(image != NULL);
@@ -222,13 +315,25 @@ static MagickWand *_generate_webimage(struct data *data,
 
     *img_size = g_new0(struct image_size, 1);
 
+    /* calculate width and height for the webimage */
+    if (!image->nomodify) {
+        _webimage_size(image, image_h, 
+                       &(*img_size)->width, &(*img_size)->height);
+    }
+
     wand = NewMagickWand();
     g_return_val_if_fail( wand, FALSE );
 
-    /* load image from file */
-    if (!_load_image(data, wand, image)) {
+    /* load image from file, no larger than needed */
+    view = vfs_view_new(data, image->uri);
+    ok = view != NULL &&
+        _load_image(data, wand, image, view,
+                    (*img_size)->width, (*img_size)->height);
+    vfs_view_release(view);
+    if (!ok) {
         DestroyMagickWand(wand);
-        return FALSE;
+        g_free(*img_size);
+        return NULL;
     }
 
     /* apply modifications, if nomodify is not checked */
@@ -239,25 +344,6 @@ static MagickWand *_generate_webimage(struct data *data,
             return NULL;
         }
         
-        /* calculate width and height for the webimage */
-        (*img_size)->height = image_h;
-        switch( image->rotate ) 
-            {
-            case 90:
-            case 270:
-                scale = (gdouble)image->height / (gdouble)image->width;
-                break;
-            case 0:
-            case 180:
-                scale = (gdouble)image->width / (gdouble)image->height;
-                break;
-                /* FIXME: just to get some values.. */
-            default:
-                scale = (gdouble)image->width / (gdouble)image->height;
-                break;
-            }
-        (*img_size)->width = (gint)((*img_size)->height * scale);
-        
         /* resize the webimage */
         if (!_resize(data, wand, image, 
                      (*img_size)->width, (*img_size)->height)) {
@@ -275,16 +361,117 @@ static MagickWand *_generate_webimage(struct data *data,
 }
 
 /*
- * Load image to image magic
+ * Make the given outputs from a single decode of the original
+ */
+static gboolean _make_outputs(struct data *data, 
+                              struct image *image,
+                              struct vfs_view *view,
+                              struct magick_output **order,
+                              gint n_make)
+{
+    MagickWand *base;
+    MagickWand *prev = NULL;
+    gint i, hint_w = 0, hint_h = 0;
+    gboolean ok = TRUE, need_full = FALSE;
+
+    g_debug("in _make_outputs");
+
+    /* the decoded image must cover the largest output */
+    for (i = 0; i < n_make; i++) {
+        if (order[i]->thumb_w == 0 && image->nomodify) {
+            need_full = TRUE;
+        }
+        hint_w = MAX(hint_w, order[i]->out_w);
+        hint_h = MAX(hint_h, order[i]->out_h);
+    }
+    if (need_full) {
+        hint_w = hint_h = 0;
+    }
+
+    base = NewMagickWand();
+    g_return_val_if_fail( base, FALSE );
+
+    /* load image from file, only once for all the outputs */
+    if (!_load_image(data, base, image, view, hint_w, hint_h)) {
+        DestroyMagickWand(base);
+        return FALSE;
+    }
+
+    /* apply modifications, if nomodify is not checked */
+    if (!image->nomodify) {
+        if (!_apply_modifications(data, base, image)) {
+            DestroyMagickWand(base);
+            return FALSE;
+        }
+    }
+
+    /* Make the largest image first so that each smaller one can be
+     * resized from the previous one instead of the original */
+    qsort(order, n_make, sizeof(struct magick_output *),
+          _sort_outputs_by_area);
+
+    for (i = 0; i < n_make; i++) {
+        struct magick_output *out = order[i];
+        MagickWand *src, *wand;
+
+        g_debug("%s: %dx%d, rotate: %d", out->uri, 
+                out->out_w, out->out_h, image->rotate);
+
+        /* nomodify web images are saved in the original size */
+        if (out->thumb_w == 0 && image->nomodify) {
+            if (!_encode(data, base, out)) {
+                ok = FALSE;
+                break;
+            }
+            continue;
+        }
+
+        /* resize from the previous output if it is large enough */
+        if (prev != NULL &&
+            MagickGetImageWidth(prev) >= (gulong)out->out_w &&
+            MagickGetImageHeight(prev) >= (gulong)out->out_h) {
+            src = prev;
+        } else {
+            src = base;
+        }
+
+        wand = CloneMagickWand(src);
+        if (wand == NULL ||
+            !_resize(data, wand, image, out->out_w, out->out_h) ||
+            !_encode(data, wand, out)) {
+            if (wand)
+                DestroyMagickWand(wand);
+            ok = FALSE;
+            break;
+        }
+
+        if (prev != NULL)
+            DestroyMagickWand(prev);
+        prev = wand;
+    }
+
+    if (prev != NULL)
+        DestroyMagickWand(prev);
+    DestroyMagickWand(base);
+
+    return ok;
+}
+
+/*
+ * Load image to image magic. If width and height of the largest
+ * wanted output are given (after rotation), JPEG images are decoded
+ * directly in a reduced scale (1/2, 1/4 or 1/8) still covering
+ * them. Zero width or height loads the image in full size.
  */
 static gboolean _load_image(struct data *data, 
                             MagickWand *wand, 
-                            struct image *image)
+                            struct image *image,
+                            struct vfs_view *view,
+                            gint width,
+                            gint height)
 {
     gchar *desc;
     ExceptionType severity;
-    guchar *img_data;
-    gsize img_len;
 
     g_debug("in _load_image");
 
@@ -292,21 +479,35 @@ static gboolean _load_image(struct data *data,
     g_assert(wand != NULL);
     g_assert(image != NULL);
 
-    /* Read image from file to memory */
-    vfs_read_file(data, image->uri, &img_data, &img_len);
-    
-    /* Read image to image magick */
-    if (!MagickReadImageBlob(wand, img_data, img_len)) {
+    /* rotation by 90 or 270 swaps the limiting dimension */
+    if (image->rotate == 90 || image->rotate == 270) {
+        gint tmp = width;
+        width = height;
+        height = tmp;
+    }
+
+    /* Ask for a scaled decode, if at least half of the original will
+     * do. The decoder picks the smallest scale still covering it. */
+    if (width > 0 && height > 0 &&
+        width * 2 <= image->width && height * 2 <= image->height) {
+        gchar size[32];
+
+        g_snprintf(size, sizeof(size), "%dx%d", width, height);
+        g_debug("_load_image: jpeg:size %s", size);
+        MagickSetOption(wand, "jpeg:size", size);
+    }
+
+    /* Read image to image magick from the original read to memory by
+     * the caller */
+    if (!MagickReadImageBlob(wand, vfs_view_get_data(view),
+                             vfs_view_get_len(view))) {
         desc = MagickGetException(wand, &severity) ;
         /* FIXME: popup */
         g_warning("_load_image: error reading image: %s\n", desc);
-        g_free(img_data);
         desc = (char *) MagickRelinquishMemory(desc);
         return FALSE;
     }
 
-    g_free(img_data);
-
     return TRUE;
 }    
 
@@ -402,35 +603,143 @@ static gboolean _resize(struct data *data,
 
 
 /* save image to file */
-static gboolean _save(struct data *data, 
-                      MagickWand *wand, 
-                      const gchar *uri)
+static gboolean _encode(struct data *data, 
+                        MagickWand *wand, 
+                        struct magick_output *out)
 {
     gchar *desc;
-    guchar *img_data;
-    gsize img_len;
     ExceptionType severity;
 
-    g_debug("in _save");
+    g_debug("in _encode");
 
     g_assert(data != NULL);
     g_assert(wand != NULL);
-    g_assert(uri != NULL);
+    g_assert(out != NULL);
  
     if (data->gal->remove_exif && !MagickStripImage(wand))
     {
         desc = MagickGetException(wand, &severity);
-        g_warning("_save: error stripping image: %s\n", desc);
+        g_warning("_encode: error stripping image: %s\n", desc);
         desc = (char *) MagickRelinquishMemory(desc);
     }
 
-    img_data = MagickGetImagesBlob(wand, &img_len);
+    /* written to the file later by magick_write_outputs */
+    out->blob = MagickGetImagesBlob(wand, &out->blob_len);
+    if (out->blob == NULL) {
+        desc = MagickGetException(wand, &severity);
+        g_warning("_encode: error encoding image '%s': %s\n", out->uri,
+                  desc);
+        desc = (char *) MagickRelinquishMemory(desc);
+        out->blob_len = 0;
+        return FALSE;
+    }
+    out->size = out->blob_len / 1024;
+
+    return TRUE;
+}
+
 
-    vfs_write_file(data, uri, img_data, img_len);
 
-    MagickRelinquishMemory(img_data);
+/*
+ * Calculate the size of a thumbnail of the given width
+ */
+static void _thumbnail_size(struct image *image, gint thumb_w,
+                            gint *width, gint *height)
+{
+    gdouble scale;
 
-    return TRUE;
+    switch( image->rotate ) 
+    {
+    case 0:
+    case 180:
+        scale = (gdouble)image->height / (gdouble)image->width;
+        break;
+    case 90:
+    case 270:
+        scale = (gdouble)image->width / (gdouble)image->height;
+        break;
+        /* FIXME: just to get some values.. */
+    default:
+        scale = (gdouble)image->width / (gdouble)image->height;
+        break;
+    }
+
+    *width = thumb_w;
+    *height = (gint)(thumb_w * scale);
+}
+
+
+
+/*
+ * Calculate the size of a web image of the given height
+ */
+static void _webimage_size(struct image *image, gint image_h,
+                           gint *width, gint *height)
+{
+    gdouble scale;
+
+    switch( image->rotate ) 
+    {
+    case 90:
+    case 270:
+        scale = (gdouble)image->height / (gdouble)image->width;
+        break;
+    case 0:
+    case 180:
+        scale = (gdouble)image->width / (gdouble)image->height;
+        break;
+        /* FIXME: just to get some values.. */
+    default:
+        scale = (gdouble)image->width / (gdouble)image->height;
+        break;
+    }
+
+    *height = image_h;
+    *width = (gint)(image_h * scale);
+}
+
+
+
+/*
+ * Sort outputs to descending order by their area
+ */
+static gint _sort_outputs_by_area(gconstpointer a, gconstpointer b)
+{
+    const struct magick_output *oa = *(struct magick_output * const *)a;
+    const struct magick_output *ob = *(struct magick_output * const *)b;
+    gint64 area_a, area_b;
+
+    area_a = (gint64)oa->out_w * oa->out_h;
+    area_b = (gint64)ob->out_w * ob->out_h;
+
+    if (area_a > area_b)
+        return -1;
+    if (area_a < area_b)
+        return 1;
+    return 0;
+}
+
+
+
+/*
+ * Count the originals being decoded and split the CPUs between them for
+ * ImageMagick's own threads. Many images decoding at once get one
+ * thread each, and a few huge ones that the memory budget admits alone
+ * get many threads each. The limit is process-wide, so it applies to
+ * the operations started after the change.
+ */
+static void _count_decoders(gint change)
+{
+    gint decoders, threads;
+
+    g_mutex_lock(&_decoders_mutex);
+    decoders = _decoders += change;
+    threads = MAX(g_get_num_processors() / MAX(decoders, 1), 1);
+    MagickSetResourceLimit(ThreadResource, threads);
+    g_mutex_unlock(&_decoders_mutex);
+
+    g_debug("in _count_decoders: %d decoding, %d threads each",
+            decoders, threads);
 }
 
 /* Emacs indentatation information
@@ -24,21 +24,66 @@
 #  include <config.h>
 #endif
 
+struct vfs_view;
+struct manifest;
 
 /*
- * Make a thumbnail for the given image and save it to a file.
+ * One image to be created from the original. If thumb_w is non-zero
+ * a thumbnail of that width is made, otherwise a web image of the
+ * given height. The out_* fields, size and the encoded blob are filled
+ * when created. Outputs marked current are not made again, their out_* fields and
+ * size must be set by the caller.
  */
-gboolean magick_make_thumbnail(struct data *data, 
-                               struct image *image,
-                               const gchar *uri);
+struct magick_output
+{
+    gchar           *uri;              /* uri to save the image to */
+    gint            thumb_w;           /* width of the thumbnail or 0 */
+    gint            height;            /* height of the web image */
+    gint            out_w;             /* width of the created image */
+    gint            out_h;             /* height of the created image */
+    gint            size;              /* size of the image in kilobytes */
+    guchar          *blob;             /* encoded image, not yet written */
+    gsize           blob_len;          /* length of the encoded image */
+    gboolean        current;           /* up to date, not to be made */
+};
 
 /*
- * Make a webimage for the given image and save it to a file.
+ * Make the thumbnail and the web images for the given image from a
+ * single decode of the original in the view. Web images are added to
+ * image->sizes in the order they are given. The images are only
+ * encoded, magick_write_outputs writes them. The view is NULL if all
+ * outputs are current or the original could not be read.
  */
-gboolean magick_make_webimage(struct data *data, 
-                              struct image *image,
-                              const gchar *uri,
-                              gint image_h);
+gboolean magick_make_images(struct data *data, 
+                            struct image *image,
+                            struct vfs_view *view,
+                            struct magick_output *outputs,
+                            gint n_outputs);
+
+/*
+ * Estimate the peak memory in bytes needed by magick_make_images for
+ * the image, from its probed size. Returns 0 if nothing is to be made
+ * and -1 if the size of the image is not known.
+ */
+gint64 magick_estimate_memory(struct image *image,
+                              struct magick_output *outputs,
+                              gint n_outputs);
+
+/*
+ * Limit the memory ImageMagick uses for the pixels to the given number
+ * of bytes, the same budget the images are admitted with. The memory
+ * map and disk limits are set in proportion.
+ */
+void magick_set_memory_limit(guint64 limit);
+
+/*
+ * Write the encoded outputs to be moved to their uris with the rest of
+ * the gallery, and free the blobs. Returns FALSE if some output could
+ * not be written.
+ */
+gboolean magick_write_outputs(struct manifest *manifest,
+                              struct magick_output *outputs,
+                              gint n_outputs);
 
 /*
  * Show webimage as a preview
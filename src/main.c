@@ -27,6 +27,13 @@
 #include "gallery.h"
 #include "configrc.h"
 #include "vfs.h"
+#include "pool.h"
+#include "budget.h"
+#include "thumbview.h"
+#include "prefetch.h"
+#include "make.h"
+#include "regen.h"
+#include "watch.h"
 
 #include <stdlib.h>		/* exit, EXIT_SUCCESS/FAILURE */
 #include <getopt.h>		/* getopt */
@@ -45,8 +52,6 @@ static void print_usage(const char *self);
 static void print_version(const char *self);
 
 static void new_gallery(struct data *data);
-static void regen_galleries(struct data *data);
-static void regen_gallery(struct data *data, gchar *uri);
 
 static void generate_file_gslist(struct data *data, int argc, char *argv[]);
 
@@ -94,7 +99,17 @@ main(int argc, char *argv[])
         new_gallery(data);
         gallery_save(data);
     } else if (data->arg_regen) {
-        regen_galleries(data);
+        /* Make galleries without GUI */
+        if (!regen_galleries(data, data->arg_files)) {
+            free_data(data);
+            exit(EXIT_FAILURE);
+        }
+    } else if (data->arg_watch) {
+        /* Make galleries again when they change, without GUI */
+        if (!watch_galleries(data, data->arg_files)) {
+            free_data(data);
+            exit(EXIT_FAILURE);
+        }
     } else {
         /* Start GUI */
 
@@ -172,6 +187,8 @@ init_pwgallery(struct data *data)
         /* find top level window */
         data->top_window = GTK_WIDGET(gtk_builder_get_object(data->builder, "mainwindow"));
         g_assert(data->top_window);
+
+        thumbview_init(data);
     }
 }
 
@@ -198,10 +215,22 @@ free_data(struct data *data)
     }
 
 
+    /* a gallery being made is left as after a cancel */
+    make_stop(data);
+
+    /* the slide show images belong to the gallery */
+    prefetch_free(data->ss_prefetch);
+
     if (data->gal != NULL) {
         gallery_free(data);
     }
 
+    /* waits for the thumbnails being decoded in the pool */
+    thumbview_free(data);
+
+    pool_free(data->pool);
+    budget_free(data->budget);
+
     if (data->builder) {
         g_object_unref(data->builder);
     }
@@ -240,9 +269,11 @@ parse_args(struct data *data, int argc, char *argv[])
 			{"version",	0, 0, 'v'},
 			{"new",	1, 0, 'n'},
 			{"regen",	0, 0, 'r'},
+			{"watch",	0, 0, 'w'},
+			{"jobs",	1, 0, 'j'},
 			{0,		0, 0, 0}
 		};
-		c = getopt_long(argc, argv, "hvn:r",
+		c = getopt_long(argc, argv, "hvn:rwj:",
                         long_options, &option_index);
 		if (c == -1) {
 			break;
@@ -262,6 +293,18 @@ parse_args(struct data *data, int argc, char *argv[])
 		case 'r':
             data->use_gui = FALSE;
             data->arg_regen = TRUE;
+            break;
+		case 'w':
+            data->use_gui = FALSE;
+            data->arg_watch = TRUE;
+            break;
+		case 'j':
+            data->arg_jobs = (gint)g_ascii_strtoull(optarg, NULL, 10);
+            if (data->arg_jobs <= 0) {
+                g_warning("Invalid number of jobs: %s", optarg);
+                print_usage(argv[0]);
+                return -1;
+            }
             break;
 		case '?':
 			g_warning("Unknown option");
@@ -277,7 +320,7 @@ parse_args(struct data *data, int argc, char *argv[])
 
 	if (optind < argc) {
 
-        if (data->arg_regen || data->arg_new != NULL) {
+        if (data->arg_regen || data->arg_watch || data->arg_new != NULL) {
             /* Add the rest of the arguments as files */
             generate_file_gslist(data, argc, argv);
         } else {
@@ -306,14 +349,17 @@ print_usage(const char *self)
     g_print("\
 Usage: %s [options] [image ...]\n\
 Usage: %s -r [gallery ...]\n\
+Usage: %s -w [gallery ...]\n\
 \n\
 Options\n\
   -h  --help               Show this usage\n\
   -v  --version            Show version\n\
   -n  --new gallery_name   Create new gallery\n\
   -r  --regen              Regenerate galleries\n\
+  -w  --watch              Regenerate galleries when they change\n\
+  -j  --jobs N             Process N images in parallel\n\
 ",
-            self, self);
+            self, self, self);
 }
 
 
@@ -370,51 +416,6 @@ new_gallery(struct data *data)
 
     gallery_add_new_images(data, data->arg_files);
 }
-        
-
-
-
-/*
- * Regenerate galleries without GUI.
- */
-static void
-regen_galleries(struct data *data)
-{
-    GSList *uri;
-
-    g_assert(data != NULL);
-
-    g_debug("Generating galleries");
-
-    uri = data->arg_files;
-    while (uri) {
-        regen_gallery(data, uri->data);
-        uri = uri->next;
-    }
-}
-
-
-
-/*
- * Regenerate a gallery without GUI.
- */
-static void
-regen_gallery(struct data *data, gchar *uri)
-{
-	g_assert(data != NULL);
-	g_assert(uri != NULL);
-
-    g_debug("Generating1 %s", uri);
-
-    gallery_free(data);
-    g_debug("Generating2 %s", uri);
-    gallery_init(data);
-    g_debug("Generating3 %s", uri);
-    gallery_open_uri(data, uri);
-    g_debug("Generating4 %s", uri);
-    gallery_make(data);
-    g_debug("Generating5 %s", uri);
-}
 
 /* Emacs indentatation information
    Local Variables:
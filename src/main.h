@@ -32,14 +32,14 @@
                                            "templates"
 /* Buf size while reading images */
 #define PWGALLERY_IMG_READ_BUF_SIZE        4096
+/* Size of the reads of image headers */
+#define PWGALLERY_HEADER_READ_SIZE         (64 * 1024)
 /* Thumbnail width in the list */
 #define PWGALLERY_THUMB_W                  250
-/* Border width for the thumbnail images in buttons */
+/* Border width for the thumbnail images in the list */
 #define PWGALLERY_THUMBNAIL_BORDER_WIDTH   10
-/* Maximum width of preview thumbnails */
-#define PWGALLERY_PREVIEW_THUMBNAIL_WIDTH  256
-/* Maximum height of preview thumbnails */
-#define PWGALLERY_PREVIEW_THUMBNAIL_HEIGHT 256
+/* Directory of the caches under the user's cache directory */
+#define PWGALLERY_CACHE_DIR                "pwgallery"
 
 /* Page generators (template, script) */
 #define PWGALLERY_PAGE_GEN_TEMPL           1
@@ -91,6 +91,16 @@
 #define PWGALLERY_RCKEY_REMOVE_EXIF        "remove_exif"
 /* RC key for image renameing */
 #define PWGALLERY_RCKEY_RENAME             "rename_images"
+/* RC key for number of images per index page */
+#define PWGALLERY_RCKEY_INDEX_PAGE_SIZE    "index_page_size"
+/* RC key for number of parallel jobs */
+#define PWGALLERY_RCKEY_JOBS               "jobs"
+/* RC key for memory used by the thumbnails in the main window */
+#define PWGALLERY_RCKEY_THUMB_MEMORY       "thumbnail_memory"
+/* RC key for memory used by the images being made in parallel */
+#define PWGALLERY_RCKEY_MAKE_MEMORY        "make_memory"
+/* RC key for memory used by the images loaded for the slide show */
+#define PWGALLERY_RCKEY_SS_MEMORY          "slideshow_memory"
 
 /* Default image directory */
 #define PWGALLERY_DEFAULT_IMAGE_DIR        "file:///tmp"
@@ -131,6 +141,16 @@
 #define PWGALLERY_DEFAULT_REMOVE_EXIF      "true"
 /* Default image renameing value */
 #define PWGALLERY_DEFAULT_RENAME           "false"
+/* Default number of images per index page (0 for all on one page) */
+#define PWGALLERY_DEFAULT_INDEX_PAGE_SIZE  "0"
+/* Default number of parallel jobs (0 for one per CPU) */
+#define PWGALLERY_DEFAULT_JOBS             "0"
+/* Default memory used by the thumbnails in the main window (MB) */
+#define PWGALLERY_DEFAULT_THUMB_MEMORY     "32"
+/* Default memory used by the images being made in parallel (MB) */
+#define PWGALLERY_DEFAULT_MAKE_MEMORY      "1024"
+/* Default memory used by the images loaded for the slide show (MB) */
+#define PWGALLERY_DEFAULT_SS_MEMORY        "128"
 
 
 
@@ -149,20 +169,18 @@ struct data
     struct gallery *gal;               /* pointer to current gallery */
     struct image   *current_img;       /* Currently selected image */
     struct image   *current_ss_img;    /* Currently slideshowed image */
-    struct image   *ss_resize_img;     /* Currently resized ss image */
-    GCond          ss_data_cond;       /* Slideshow "new data" condition */
-    GMutex         ss_data_mutex;      /* Slideshow "new data" mutex */
     gboolean       ss_show_text;       /* Show description in slide show */
     gboolean       *text_edited;       /* Content of textview is changed*/
 
     gint           ss_timer;           /* Slide show timer */
     gint           ss_timer_interval;  /* Slide show timer interval */
-    GThread        *ss_thread;         /* Slide show loading thread */
-    gboolean       ss_stop;            /* Flag for loading thread to exit */
+    struct prefetch *ss_prefetch;      /* Slide show images being loaded */
 
     gboolean       use_gui;            /* do we want to show GUI */
     gboolean       arg_regen;          /* regen list of galleries (cmdline) */
+    gboolean       arg_watch;          /* watch list of galleries (cmdline) */
     gchar          *arg_new;           /* create new gallery (cmdline) */
+    gint           arg_jobs;           /* number of parallel jobs (cmdline) */
     GSList         *arg_files;         /* List of files */
 
     gchar          *img_dir;           /* image directory */
@@ -184,12 +202,22 @@ struct data
     gint           image_h4;           /* Default height of web images4 */
     gboolean       remove_exif;        /* Default value for remove exif info */
     gboolean       rename;             /* Default value for rename images */
+    gint           index_page_size;    /* Default images per index page */
+    gint           jobs;               /* Number of parallel jobs */
+    struct pool    *pool;              /* Worker pool for making galleries */
+    struct budget  *budget;            /* Memory for decoding while making */
+    gint           thumb_memory;       /* Memory for thumbnails in MB */
+    gint           make_memory;        /* Memory for making images in MB */
+    gint           ss_memory;          /* Memory for slide show in MB */
+    struct thumbview *thumbview;       /* Thumbnail list in the main window */
+    struct import  *import;            /* Images being added or NULL */
+    struct make    *make;              /* Gallery being made or NULL */
 
 };
 
 struct gallery
 {
-    GSList         *images;            /* list of images in the gallery */
+    struct model   *model;             /* images in the gallery */
     gchar          *uri;               /* uri to the gallery file */
     gchar          *name;              /* name of the current gal. */
     gchar          *desc;              /* description of the current gal. */
@@ -211,15 +239,15 @@ struct gallery
     gboolean       edited;             /* is the gallery edited */
     gboolean       remove_exif;        /* strip exif etc. info */
     gboolean       rename;             /* rename images */
+    gint           index_page_size;    /* images per index page, 0 for all */
+    struct manifest *manifest;         /* manifest while making */
 
 };
 
 struct image
 {
-    GtkWidget       *image;            /* pointer to image widget */
-    GtkWidget       *button;           /* pointer to button widget */
-    GdkPixbuf       *ss_pixbuf;        /* pointer to slide show pixbuf */
     GSList          *sizes;            /* List of image sizes */
+    gint            index;             /* place in the gallery model */
     gint            width;             /* original width of the image */
     gint            height;            /* original height of the image */
     gint            thumb_w;           /* thumbnail width */
@@ -236,6 +264,8 @@ struct image
     /* FIXME: add page gen int */
     gboolean        nomodify;          /* do not modify flag */
     struct exif     *exif;             /* pointer to exif data */
+    goffset         file_size;         /* size of the original or -1 */
+    glong           mtime;             /* mtime of the original or -1 */
 };
 
 struct image_size
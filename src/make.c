@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "main.h"
+#include "make.h"
+#include "gallery.h"
+#include "widgets.h"
+
+#include <glib.h>
+
+struct make
+{
+    struct data     *data;             /* the application */
+    struct data     snapshot;          /* data of the make, gal copied */
+    GThread         *thread;           /* thread making the gallery */
+    gint            cancel;            /* stop between images */
+    GMutex          mutex;             /* protects the fields below */
+    gfloat          frac;              /* progress to show */
+    gchar           *text;
+    guint           progress_id;       /* idle showing the progress or 0 */
+    guint           done_id;           /* idle ending the make or 0 */
+};
+
+static gpointer _thread(gpointer user_data);
+static gboolean _show_progress(gpointer user_data);
+static gboolean _done(gpointer user_data);
+static void _free(struct make *make);
+
+
+
+void
+make_start(struct data *data)
+{
+    struct make *make;
+
+    g_assert(data != NULL);
+    g_assert(data->gal != NULL);
+    g_assert(data->make == NULL);
+
+    g_debug("in make_start");
+
+    /* started here, the snapshot shares them */
+    gallery_get_pool(data);
+    gallery_get_budget(data);
+
+    make = g_new0(struct make, 1);
+    make->data = data;
+    g_mutex_init(&make->mutex);
+
+    make->snapshot = *data;
+    make->snapshot.gal = gallery_snapshot(data);
+    make->snapshot.make = make;
+
+    data->make = make;
+    widgets_show_make_cancel(data, TRUE);
+
+    make->thread = g_thread_new("make", _thread, make);
+}
+
+
+
+void
+make_cancel(struct data *data)
+{
+    g_assert(data != NULL);
+
+    if (data->make == NULL)
+        return;
+
+    g_debug("in make_cancel");
+
+    g_atomic_int_set(&data->make->cancel, 1);
+}
+
+
+
+void
+make_stop(struct data *data)
+{
+    struct make *make;
+
+    g_assert(data != NULL);
+
+    make = data->make;
+    if (make == NULL)
+        return;
+
+    g_debug("in make_stop");
+
+    g_atomic_int_set(&make->cancel, 1);
+    g_thread_join(make->thread);
+
+    /* the make ends here instead of in the main loop */
+    g_mutex_lock(&make->mutex);
+    if (make->progress_id != 0)
+        g_source_remove(make->progress_id);
+    if (make->done_id != 0)
+        g_source_remove(make->done_id);
+    g_mutex_unlock(&make->mutex);
+
+    _free(make);
+}
+
+
+
+gboolean
+make_is_cancelled(struct make *make)
+{
+    if (make == NULL)
+        return FALSE;
+
+    return g_atomic_int_get(&make->cancel) != 0;
+}
+
+
+
+void
+make_progress(struct make *make, gfloat frac, const gchar *text)
+{
+    g_assert(make != NULL);
+    g_assert(text != NULL);
+
+    /* only the latest progress is shown */
+    g_mutex_lock(&make->mutex);
+    make->frac = frac;
+    g_free(make->text);
+    make->text = g_strdup(text);
+    if (make->progress_id == 0)
+        make->progress_id = g_idle_add(_show_progress, make);
+    g_mutex_unlock(&make->mutex);
+}
+
+
+
+/**********************
+ *                    *
+ * Static functions   *
+ *                    *
+ **********************/
+
+
+/*
+ * Make the snapshot of the gallery and end the make in the main loop
+ */
+static gpointer
+_thread(gpointer user_data)
+{
+    struct make *make;
+
+    g_assert(user_data != NULL);
+    make = user_data;
+
+    gallery_build(&make->snapshot);
+
+    g_mutex_lock(&make->mutex);
+    make->done_id = g_idle_add(_done, make);
+    g_mutex_unlock(&make->mutex);
+
+    return NULL;
+}
+
+
+
+/*
+ * Show the latest progress of the make
+ */
+static gboolean
+_show_progress(gpointer user_data)
+{
+    struct make *make;
+    gfloat frac;
+    gchar *text;
+
+    g_assert(user_data != NULL);
+    make = user_data;
+
+    g_mutex_lock(&make->mutex);
+    make->progress_id = 0;
+    frac = make->frac;
+    text = make->text;
+    make->text = NULL;
+    g_mutex_unlock(&make->mutex);
+
+    /* may run the main loop */
+    if (text != NULL)
+        widgets_set_progress(make->data, frac, text);
+    g_free(text);
+
+    return FALSE;
+}
+
+
+
+/*
+ * The thread has finished, show the last progress and free the make
+ */
+static gboolean
+_done(gpointer user_data)
+{
+    struct make *make;
+
+    g_assert(user_data != NULL);
+    make = user_data;
+
+    g_debug("in _done");
+
+    g_thread_join(make->thread);
+
+    g_mutex_lock(&make->mutex);
+    make->done_id = 0;
+    if (make->progress_id != 0) {
+        g_source_remove(make->progress_id);
+        make->progress_id = 0;
+    }
+    g_mutex_unlock(&make->mutex);
+
+    /* the make is over before the main loop may run again */
+    make->data->make = NULL;
+    _show_progress(make);
+
+    _free(make);
+
+    return FALSE;
+}
+
+
+
+/*
+ * Free the make and its snapshot of the gallery
+ */
+static void
+_free(struct make *make)
+{
+    /* a new make may have been started while showing the progress */
+    if (make->data->make == make)
+        make->data->make = NULL;
+    if (make->data->make == NULL)
+        widgets_show_make_cancel(make->data, FALSE);
+
+    gallery_snapshot_free(make->snapshot.gal);
+    g_mutex_clear(&make->mutex);
+    g_free(make->text);
+    g_free(make);
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
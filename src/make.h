@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#ifndef PWGALLERY_MAKE_H
+#define PWGALLERY_MAKE_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "main.h"
+
+#include <glib.h>
+
+/*
+ * A gallery being made in a background thread. The make works on a
+ * snapshot of the gallery, so the gallery can be edited meanwhile.
+ * The progress and the end of the make are shown through the main
+ * loop.
+ */
+struct make;
+
+/*
+ * Start making the current gallery in the background
+ */
+void make_start(struct data *data);
+
+/*
+ * Cancel the running make, if any. The make stops between images.
+ */
+void make_cancel(struct data *data);
+
+/*
+ * Cancel the running make, if any, and wait for it to stop
+ */
+void make_stop(struct data *data);
+
+/*
+ * Check if the make is cancelled. A NULL make is never cancelled. Can
+ * be called in any thread.
+ */
+gboolean make_is_cancelled(struct make *make);
+
+/*
+ * Show the progress of the make in the main loop. Called in the thread
+ * making the gallery.
+ */
+void make_progress(struct make *make, gfloat frac, const gchar *text);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
@@ -0,0 +1,811 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "main.h"
+#include "manifest.h"
+#include "vfs.h"
+
+#include <glib.h>
+#include <string.h>                 /* strlen, strcmp, strncmp, strchr */
+#include <errno.h>                  /* errno */
+
+/* Keys of the inputs of an image output */
+#define MANIFEST_KEY_SOURCE       "source"
+#define MANIFEST_KEY_SOURCE_SIZE  "source_size"
+#define MANIFEST_KEY_SOURCE_MTIME "source_mtime"
+#define MANIFEST_KEY_ROTATE       "rotate"
+#define MANIFEST_KEY_GAMMA        "gamma"
+#define MANIFEST_KEY_NOMODIFY     "nomodify"
+#define MANIFEST_KEY_HEIGHT       "height"
+#define MANIFEST_KEY_THUMB_W      "thumb_w"
+#define MANIFEST_KEY_REMOVE_EXIF  "remove_exif"
+
+/* Keys of the results of an image output */
+#define MANIFEST_KEY_OUT_W        "out_w"
+#define MANIFEST_KEY_OUT_H        "out_h"
+#define MANIFEST_KEY_SIZE         "size"
+
+/* Key of the content of a written file */
+#define MANIFEST_KEY_CHECKSUM     "checksum"
+
+struct manifest
+{
+    struct data    *data;
+    gchar          *dir;               /* output directory */
+    gchar          *path;              /* manifest file in the cache */
+    gchar          *old_uri;           /* manifest of older versions */
+    gchar          *staging;           /* directory the files are made to */
+    GPtrArray      *staged_dirs;       /* directories made, by name */
+    GPtrArray      *staged;            /* files made, by name, in order */
+    GKeyFile       *old;               /* manifest of the previous make */
+    GKeyFile       *new;               /* manifest of this make */
+    gboolean       found;              /* previous manifest was found */
+    GHashTable     *sources;           /* stats of the originals */
+    GMutex         mutex;              /* lock for the above */
+};
+
+struct manifest_file
+{
+    struct manifest *manifest;
+    gchar          *uri;               /* file in the output directory */
+    gchar          *path;              /* file in the staging directory */
+    struct vfs_writer *writer;         /* staged file being written */
+    GChecksum      *checksum;          /* checksum of the content */
+    gboolean       failed;             /* writing failed */
+};
+
+struct manifest_source
+{
+    gboolean       found;              /* original exists */
+    goffset        size;               /* size of the original */
+    glong          mtime;              /* modification time */
+};
+
+static gchar *_path(const gchar *output_dir);
+static gboolean _load(struct manifest *manifest, const gchar *content,
+                      gsize len, const gchar *name);
+static gboolean _is_output_name(const gchar *name);
+static const gchar *_name(struct manifest *manifest, const gchar *uri);
+static gboolean _move_aside(struct manifest *manifest);
+static gchar *_group(struct manifest *manifest, const gchar *uri);
+static struct manifest_source *_source(struct manifest *manifest,
+                                       struct image *image);
+static void _set_inputs(struct manifest *manifest, const gchar *group,
+                        struct image *image,
+                        const struct magick_output *out);
+static gboolean _same_inputs(struct manifest *manifest, const gchar *group);
+static gboolean _changed(struct manifest *manifest, const gchar *uri,
+                         const gchar *checksum);
+
+
+
+struct manifest *
+manifest_load(struct data *data, const gchar *output_dir)
+{
+    struct manifest *manifest;
+
+    g_assert(data != NULL);
+    g_assert(output_dir != NULL);
+
+    g_debug("in manifest_load");
+
+    manifest = g_new0(struct manifest, 1);
+    manifest->data = data;
+    manifest->dir = g_strdup(output_dir);
+    manifest->path = _path(output_dir);
+    manifest->old_uri = g_strdup_printf("%s/%s", output_dir,
+                                        PWGALLERY_MANIFEST_FILE);
+    manifest->staging = g_strdup_printf("%s%s", output_dir,
+                                        PWGALLERY_MANIFEST_STAGING);
+    manifest->staged_dirs = g_ptr_array_new_with_free_func(g_free);
+    manifest->staged = g_ptr_array_new_with_free_func(g_free);
+    manifest->old = g_key_file_new();
+    manifest->new = g_key_file_new();
+    manifest->sources = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                              NULL, g_free);
+    g_mutex_init(&manifest->mutex);
+
+    if (g_file_test(manifest->path, G_FILE_TEST_IS_REGULAR)) {
+        gchar *content;
+        gsize len;
+
+        if (g_file_get_contents(manifest->path, &content, &len, NULL)) {
+            manifest->found = _load(manifest, content, len, manifest->path);
+            g_free(content);
+        }
+    } else if (vfs_is_file(data, manifest->old_uri) == TRUE) {
+        /* made with an older version, moved to the cache when saved */
+        guchar *content;
+        gsize len;
+
+        if (vfs_try_read_file(data, manifest->old_uri, &content, &len)) {
+            manifest->found = _load(manifest, (gchar*)content, len,
+                                    manifest->old_uri);
+            g_free(content);
+        }
+    }
+
+    /* left behind by a make that was interrupted */
+    if (vfs_is_dir(data, manifest->staging) == TRUE) {
+        g_debug("manifest_load: removing %s", manifest->staging);
+        vfs_remove_tree(data, manifest->staging);
+    }
+
+    /* if this fails, the make fails when writing to it */
+    vfs_try_mkdir(data, manifest->staging);
+
+    return manifest;
+}
+
+
+
+gboolean
+manifest_found(struct manifest *manifest)
+{
+    g_assert(manifest != NULL);
+
+    return manifest->found;
+}
+
+
+
+gboolean
+manifest_output_is_current(struct manifest *manifest,
+                           struct image *image,
+                           struct magick_output *out)
+{
+    gchar *group;
+    gboolean current = FALSE;
+
+    g_assert(manifest != NULL);
+    g_assert(image != NULL);
+    g_assert(out != NULL);
+
+    group = _group(manifest, out->uri);
+
+    g_mutex_lock(&manifest->mutex);
+    _set_inputs(manifest, group, image, out);
+    current = _source(manifest, image)->found &&
+        _same_inputs(manifest, group);
+    g_mutex_unlock(&manifest->mutex);
+
+    if (current && vfs_is_file(manifest->data, out->uri)) {
+        GError *error = NULL;
+        gint w, h, size;
+
+        current = FALSE;
+        g_mutex_lock(&manifest->mutex);
+        w = g_key_file_get_integer(manifest->old, group,
+                                   MANIFEST_KEY_OUT_W, &error);
+        if (error == NULL)
+            h = g_key_file_get_integer(manifest->old, group,
+                                       MANIFEST_KEY_OUT_H, &error);
+        if (error == NULL)
+            size = g_key_file_get_integer(manifest->old, group,
+                                          MANIFEST_KEY_SIZE, &error);
+        g_mutex_unlock(&manifest->mutex);
+
+        if (error == NULL) {
+            out->out_w = w;
+            out->out_h = h;
+            out->size = size;
+            current = TRUE;
+        } else {
+            g_error_free(error);
+        }
+    } else {
+        current = FALSE;
+    }
+
+    g_free(group);
+
+    return current;
+}
+
+
+
+void
+manifest_add_output(struct manifest *manifest,
+                    struct image *image,
+                    const struct magick_output *out)
+{
+    gchar *group;
+
+    g_assert(manifest != NULL);
+    g_assert(image != NULL);
+    g_assert(out != NULL);
+
+    group = _group(manifest, out->uri);
+
+    g_mutex_lock(&manifest->mutex);
+    _set_inputs(manifest, group, image, out);
+    g_key_file_set_integer(manifest->new, group, MANIFEST_KEY_OUT_W,
+                           out->out_w);
+    g_key_file_set_integer(manifest->new, group, MANIFEST_KEY_OUT_H,
+                           out->out_h);
+    g_key_file_set_integer(manifest->new, group, MANIFEST_KEY_SIZE,
+                           out->size);
+    g_mutex_unlock(&manifest->mutex);
+
+    g_free(group);
+}
+
+
+
+gboolean
+manifest_stage_dir(struct manifest *manifest, const gchar *uri)
+{
+    gchar *path;
+    gboolean ok;
+
+    g_assert(manifest != NULL);
+    g_assert(uri != NULL);
+
+    path = g_strdup_printf("%s/%s", manifest->staging, _name(manifest, uri));
+    ok = vfs_try_mkdir(manifest->data, path);
+    g_free(path);
+
+    if (ok) {
+        g_mutex_lock(&manifest->mutex);
+        g_ptr_array_add(manifest->staged_dirs,
+                        g_strdup(_name(manifest, uri)));
+        g_mutex_unlock(&manifest->mutex);
+    }
+
+    return ok;
+}
+
+
+
+gboolean
+manifest_stage_file(struct manifest *manifest, const gchar *uri,
+                    const guchar *content, gsize content_len)
+{
+    gchar *path;
+    gboolean ok;
+
+    g_assert(manifest != NULL);
+    g_assert(uri != NULL);
+    g_assert(content != NULL);
+
+    path = g_strdup_printf("%s/%s", manifest->staging, _name(manifest, uri));
+    ok = vfs_try_write_file(manifest->data, path, content, content_len);
+    g_free(path);
+
+    if (ok) {
+        g_mutex_lock(&manifest->mutex);
+        g_ptr_array_add(manifest->staged, g_strdup(_name(manifest, uri)));
+        g_mutex_unlock(&manifest->mutex);
+    }
+
+    return ok;
+}
+
+
+
+gboolean
+manifest_write_file(struct manifest *manifest, const gchar *uri,
+                    const guchar *content, gsize content_len)
+{
+    gchar *checksum;
+    gboolean ok = TRUE;
+
+    g_assert(manifest != NULL);
+    g_assert(uri != NULL);
+    g_assert(content != NULL);
+
+    checksum = g_compute_checksum_for_data(G_CHECKSUM_MD5,
+                                           content, content_len);
+
+    /* keep the old file untouched if the content is the same */
+    if (_changed(manifest, uri, checksum))
+        ok = manifest_stage_file(manifest, uri, content, content_len);
+
+    g_free(checksum);
+
+    return ok;
+}
+
+
+
+struct manifest_file *
+manifest_file_new(struct manifest *manifest, const gchar *uri)
+{
+    struct manifest_file *file;
+
+    g_assert(manifest != NULL);
+    g_assert(uri != NULL);
+
+    file = g_new0(struct manifest_file, 1);
+    file->manifest = manifest;
+    file->uri = g_strdup(uri);
+    file->path = g_strdup_printf("%s/%s", manifest->staging,
+                                 _name(manifest, uri));
+    file->writer = vfs_try_writer_new(manifest->data, file->path);
+    if (file->writer == NULL) {
+        g_free(file->path);
+        g_free(file->uri);
+        g_free(file);
+        return NULL;
+    }
+    file->checksum = g_checksum_new(G_CHECKSUM_MD5);
+
+    return file;
+}
+
+
+
+gboolean
+manifest_file_write(struct manifest_file *file, const guchar *content,
+                    gsize content_len)
+{
+    g_assert(file != NULL);
+
+    /* after a failure the rest is ignored */
+    if (file->failed)
+        return FALSE;
+
+    g_checksum_update(file->checksum, content, content_len);
+    if (!vfs_try_writer_write(file->writer, content, content_len))
+        file->failed = TRUE;
+
+    return !file->failed;
+}
+
+
+
+gboolean
+manifest_file_close(struct manifest_file *file)
+{
+    struct manifest *manifest;
+    gboolean ok;
+
+    g_assert(file != NULL);
+
+    manifest = file->manifest;
+
+    ok = vfs_writer_close(file->writer) && !file->failed;
+
+    if (ok && _changed(manifest, file->uri,
+                       g_checksum_get_string(file->checksum))) {
+        g_mutex_lock(&manifest->mutex);
+        g_ptr_array_add(manifest->staged,
+                        g_strdup(_name(manifest, file->uri)));
+        g_mutex_unlock(&manifest->mutex);
+    } else {
+        /* unchanged or failed, the staged copy is not moved in place */
+        vfs_unlink(manifest->data, file->path);
+    }
+
+    g_checksum_free(file->checksum);
+    g_free(file->path);
+    g_free(file->uri);
+    g_free(file);
+
+    return ok;
+}
+
+
+
+gboolean
+manifest_save(struct manifest *manifest)
+{
+    gchar **groups;
+    gchar *manifest_data;
+    gsize manifest_data_len;
+    gchar *dir;
+    GError *error = NULL;
+    gboolean ok;
+    gint i;
+
+    g_assert(manifest != NULL);
+
+    g_debug("in manifest_save");
+
+    if (!manifest->found ||
+        vfs_is_dir(manifest->data, manifest->dir) == FALSE) {
+        /* the staging directory becomes the whole gallery, and an old
+         * directory not made by pwgallery is kept aside. Its access
+         * rules are kept. */
+        if (vfs_is_dir(manifest->data, manifest->dir) == TRUE &&
+            (!vfs_copy_htaccess(manifest->data, manifest->dir,
+                                manifest->staging) ||
+             !_move_aside(manifest)))
+            return FALSE;
+        if (!vfs_try_rename(manifest->data, manifest->staging,
+                            manifest->dir))
+            return FALSE;
+    } else {
+        /* replace only the files made again */
+        for (i = 0; i < (gint)manifest->staged_dirs->len; i++) {
+            gchar *uri;
+
+            uri = g_strdup_printf("%s/%s", manifest->dir,
+                                  (gchar*)g_ptr_array_index(
+                                      manifest->staged_dirs, i));
+            ok = vfs_try_mkdir(manifest->data, uri);
+            g_free(uri);
+            if (!ok)
+                return FALSE;
+        }
+        for (i = 0; i < (gint)manifest->staged->len; i++) {
+            const gchar *name;
+            gchar *path, *uri;
+
+            name = g_ptr_array_index(manifest->staged, i);
+            path = g_strdup_printf("%s/%s", manifest->staging, name);
+            uri = g_strdup_printf("%s/%s", manifest->dir, name);
+            ok = vfs_try_replace(manifest->data, path, uri);
+            g_free(uri);
+            g_free(path);
+            if (!ok)
+                return FALSE;
+        }
+        vfs_remove_tree(manifest->data, manifest->staging);
+    }
+
+    /* remove the files of the previous make not made anymore */
+    groups = g_key_file_get_groups(manifest->old, NULL);
+    for (i = 0; groups[i] != NULL; i++) {
+        gchar *path, *uri;
+
+        if (g_key_file_has_group(manifest->new, groups[i])) {
+            continue;
+        }
+
+        /* the names come from a file that may have been edited, so
+         * never remove anything outside the output directory */
+        path = g_uri_unescape_string(groups[i], NULL);
+        if (path == NULL || !_is_output_name(path)) {
+            g_warning("Ignoring invalid manifest entry '%s'", groups[i]);
+            g_free(path);
+            continue;
+        }
+        uri = g_strdup_printf("%s/%s", manifest->dir, path);
+
+        if (vfs_is_file(manifest->data, uri)) {
+            g_debug("manifest_save: removing %s", uri);
+            vfs_unlink(manifest->data, uri);
+        }
+
+        g_free(uri);
+        g_free(path);
+    }
+    g_strfreev(groups);
+
+    manifest_data = g_key_file_to_data(manifest->new, &manifest_data_len,
+                                       NULL);
+
+    dir = g_path_get_dirname(manifest->path);
+    if (g_mkdir_with_parents(dir, 0700) != 0) {
+        /* FIXME: popup */
+        g_warning("Failed to create the manifest directory %s: %s", dir,
+                  g_strerror(errno));
+    } else if (!g_file_set_contents(manifest->path, manifest_data,
+                                    manifest_data_len, &error)) {
+        /* FIXME: popup */
+        g_warning("Failed to save the manifest %s: %s", manifest->path,
+                  error->message);
+        g_error_free(error);
+    } else if (vfs_is_file(manifest->data, manifest->old_uri)) {
+        /* don't leave the local paths of an older version published */
+        vfs_unlink(manifest->data, manifest->old_uri);
+    }
+    g_free(dir);
+    g_free(manifest_data);
+
+    return TRUE;
+}
+
+
+
+void
+manifest_discard(struct manifest *manifest)
+{
+    g_assert(manifest != NULL);
+
+    g_debug("in manifest_discard");
+
+    if (vfs_is_dir(manifest->data, manifest->staging) == TRUE)
+        vfs_remove_tree(manifest->data, manifest->staging);
+}
+
+
+
+void
+manifest_free(struct manifest *manifest)
+{
+    if (manifest == NULL)
+        return;
+
+    g_free(manifest->dir);
+    g_free(manifest->path);
+    g_free(manifest->old_uri);
+    g_free(manifest->staging);
+    g_ptr_array_free(manifest->staged_dirs, TRUE);
+    g_ptr_array_free(manifest->staged, TRUE);
+    g_key_file_free(manifest->old);
+    g_key_file_free(manifest->new);
+    g_hash_table_destroy(manifest->sources);
+    g_mutex_clear(&manifest->mutex);
+    g_free(manifest);
+}
+
+
+
+/**********************
+ *                    *
+ * Static functions   *
+ *                    *
+ **********************/
+
+
+/*
+ * Manifest file of an output directory in the cache, named by a
+ * checksum of the directory
+ */
+static gchar *
+_path(const gchar *output_dir)
+{
+    gchar *sum, *path;
+
+    sum = g_compute_checksum_for_string(G_CHECKSUM_MD5, output_dir, -1);
+    path = g_build_filename(g_get_user_cache_dir(), PWGALLERY_CACHE_DIR,
+                            PWGALLERY_MANIFEST_SUBDIR, sum, NULL);
+    g_free(sum);
+
+    return path;
+}
+
+
+
+/*
+ * Load the manifest of the previous make from the file content
+ */
+static gboolean
+_load(struct manifest *manifest, const gchar *content, gsize len,
+      const gchar *name)
+{
+    if (!g_key_file_load_from_data(manifest->old, content, len,
+                                   G_KEY_FILE_NONE, NULL)) {
+        /* make everything again */
+        g_warning("Ignoring broken manifest '%s'", name);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+
+/*
+ * Check that a name from the manifest is a relative path inside the
+ * output directory
+ */
+static gboolean
+_is_output_name(const gchar *name)
+{
+    gchar **parts;
+    gboolean valid = TRUE;
+    gint i;
+
+    if (name[0] == '\0' || name[0] == '/' || strchr(name, '\\') != NULL)
+        return FALSE;
+
+    parts = g_strsplit(name, "/", -1);
+    for (i = 0; parts[i] != NULL && valid; i++) {
+        valid = parts[i][0] != '\0' && strcmp(parts[i], ".") != 0 &&
+            strcmp(parts[i], "..") != 0;
+    }
+    g_strfreev(parts);
+
+    return valid;
+}
+
+
+
+/*
+ * Name of an output file: its path relative to the output directory
+ */
+static const gchar *
+_name(struct manifest *manifest, const gchar *uri)
+{
+    gsize dir_len;
+
+    dir_len = strlen(manifest->dir);
+
+    g_assert(strncmp(uri, manifest->dir, dir_len) == 0);
+    g_assert(uri[dir_len] == '/');
+
+    return uri + dir_len + 1;
+}
+
+
+
+/*
+ * Group name of an output file: its name escaped to be valid as a key
+ * file group.
+ */
+static gchar *
+_group(struct manifest *manifest, const gchar *uri)
+{
+    return g_uri_escape_string(_name(manifest, uri), "/", FALSE);
+}
+
+
+
+/*
+ * Record the checksum of a file to the new manifest and check if the
+ * content differs from the file made in the previous make
+ */
+static gboolean
+_changed(struct manifest *manifest, const gchar *uri, const gchar *checksum)
+{
+    gchar *group;
+    gchar *old_checksum;
+    gboolean changed = TRUE;
+
+    group = _group(manifest, uri);
+
+    g_mutex_lock(&manifest->mutex);
+    old_checksum = g_key_file_get_string(manifest->old, group,
+                                         MANIFEST_KEY_CHECKSUM, NULL);
+    g_key_file_set_string(manifest->new, group, MANIFEST_KEY_CHECKSUM,
+                          checksum);
+    g_mutex_unlock(&manifest->mutex);
+
+    if (old_checksum != NULL && strcmp(checksum, old_checksum) == 0 &&
+        vfs_is_file(manifest->data, uri)) {
+        g_debug("in _changed: %s not changed", uri);
+        changed = FALSE;
+    }
+
+    g_free(old_checksum);
+    g_free(group);
+
+    return changed;
+}
+
+
+
+/*
+ * Move the output directory aside to the first free name with a number
+ * appended
+ */
+static gboolean
+_move_aside(struct manifest *manifest)
+{
+    gchar *dir;
+    gboolean ok;
+    int i = 1;
+
+    do {
+        dir = g_strdup_printf("%s.%d", manifest->dir, i);
+        if (vfs_is_dir(manifest->data, dir) == FALSE) {
+            break;
+        }
+        g_free(dir);
+        ++i;
+    } while(1);
+
+    g_debug("manifest_save: moving %s to %s", manifest->dir, dir);
+    ok = vfs_try_rename(manifest->data, manifest->dir, dir);
+    g_free(dir);
+
+    return ok;
+}
+
+
+
+/*
+ * Size and modification time of the original. Stat only once per
+ * make.
+ */
+static struct manifest_source *
+_source(struct manifest *manifest, struct image *image)
+{
+    struct manifest_source *source;
+
+    source = g_hash_table_lookup(manifest->sources, image);
+    if (source == NULL) {
+        source = g_new0(struct manifest_source, 1);
+        source->found = vfs_stat(manifest->data, image->uri,
+                                 &source->size, &source->mtime);
+        g_hash_table_insert(manifest->sources, image, source);
+    }
+
+    return source;
+}
+
+
+
+/*
+ * Set the inputs of an image output to the new manifest
+ */
+static void
+_set_inputs(struct manifest *manifest, const gchar *group,
+            struct image *image, const struct magick_output *out)
+{
+    struct manifest_source *source;
+    GKeyFile *keyfile = manifest->new;
+
+    source = _source(manifest, image);
+
+    g_key_file_set_string(keyfile, group, MANIFEST_KEY_SOURCE, image->uri);
+    g_key_file_set_int64(keyfile, group, MANIFEST_KEY_SOURCE_SIZE,
+                         source->size);
+    g_key_file_set_int64(keyfile, group, MANIFEST_KEY_SOURCE_MTIME,
+                         source->mtime);
+    g_key_file_set_integer(keyfile, group, MANIFEST_KEY_ROTATE,
+                           image->rotate);
+    g_key_file_set_double(keyfile, group, MANIFEST_KEY_GAMMA, image->gamma);
+    g_key_file_set_boolean(keyfile, group, MANIFEST_KEY_NOMODIFY,
+                           image->nomodify);
+    g_key_file_set_integer(keyfile, group, MANIFEST_KEY_HEIGHT, out->height);
+    g_key_file_set_integer(keyfile, group, MANIFEST_KEY_THUMB_W,
+                           out->thumb_w);
+    g_key_file_set_boolean(keyfile, group, MANIFEST_KEY_REMOVE_EXIF,
+                           manifest->data->gal->remove_exif);
+}
+
+
+
+/*
+ * Compare the inputs in the new manifest to the previous one
+ */
+static gboolean
+_same_inputs(struct manifest *manifest, const gchar *group)
+{
+    const gchar *keys[] = {
+        MANIFEST_KEY_SOURCE, MANIFEST_KEY_SOURCE_SIZE,
+        MANIFEST_KEY_SOURCE_MTIME, MANIFEST_KEY_ROTATE, MANIFEST_KEY_GAMMA,
+        MANIFEST_KEY_NOMODIFY, MANIFEST_KEY_HEIGHT, MANIFEST_KEY_THUMB_W,
+        MANIFEST_KEY_REMOVE_EXIF, NULL
+    };
+    gboolean same = TRUE;
+    gint i;
+
+    for (i = 0; keys[i] != NULL && same; i++) {
+        gchar *old_value, *new_value;
+
+        old_value = g_key_file_get_value(manifest->old, group, keys[i], NULL);
+        new_value = g_key_file_get_value(manifest->new, group, keys[i], NULL);
+
+        same = old_value != NULL && new_value != NULL &&
+            strcmp(old_value, new_value) == 0;
+
+        g_free(old_value);
+        g_free(new_value);
+    }
+
+    return same;
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#ifndef PWGALLERY_MANIFEST_H
+#define PWGALLERY_MANIFEST_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "main.h"
+#include "magick.h"
+
+#include <glib.h>
+
+/* Directory of the manifests under PWGALLERY_CACHE_DIR */
+#define PWGALLERY_MANIFEST_SUBDIR "manifests"
+
+/* Name of the manifest file in the output directory in older versions */
+#define PWGALLERY_MANIFEST_FILE ".pwgallery-manifest"
+
+/* Suffix of the staging directory next to the output directory */
+#define PWGALLERY_MANIFEST_STAGING ".pwgallery-new"
+
+/*
+ * The manifest records the inputs of every file created to the output
+ * directory, so that only the files whose inputs have changed need to
+ * be made again. It names the originals by their local uris, so it is
+ * kept in the user's cache directory instead of the published output
+ * directory.
+ *
+ * The files are made to a staging directory and moved to the output
+ * directory only when the whole gallery has been made, so a cancelled
+ * or failed make leaves the previous gallery as it was.
+ */
+struct manifest;
+
+/*
+ * Load the manifest of the previous make to the output directory and
+ * start a new one.
+ */
+struct manifest *manifest_load(struct data *data, const gchar *output_dir);
+
+/*
+ * Check if the manifest of a previous make was found
+ */
+gboolean manifest_found(struct manifest *manifest);
+
+/*
+ * Check if the output exists and was made from the same inputs. If so,
+ * its out_* fields and size are set from the manifest.
+ */
+gboolean manifest_output_is_current(struct manifest *manifest,
+                                    struct image *image,
+                                    struct magick_output *out);
+
+/*
+ * Record a made or current output to the new manifest
+ */
+void manifest_add_output(struct manifest *manifest,
+                         struct image *image,
+                         const struct magick_output *out);
+
+/*
+ * Create a directory of the output directory to the staging directory.
+ * Returns FALSE on failure.
+ */
+gboolean manifest_stage_dir(struct manifest *manifest, const gchar *uri);
+
+/*
+ * Write a file of the output directory to the staging directory. Can
+ * be called in the worker threads. Returns FALSE on failure.
+ */
+gboolean manifest_stage_file(struct manifest *manifest, const gchar *uri,
+                             const guchar *content, gsize content_len);
+
+/*
+ * Write a file of the output directory to the staging directory,
+ * unless the content is the same as in the previous make. Can be
+ * called in the worker threads. Returns FALSE on failure.
+ */
+gboolean manifest_write_file(struct manifest *manifest, const gchar *uri,
+                             const guchar *content, gsize content_len);
+
+/*
+ * A file of the output directory streamed to the staging directory
+ */
+struct manifest_file;
+
+/*
+ * Start writing a file of the output directory to the staging
+ * directory in parts. Can be called in the worker threads. Returns
+ * NULL on failure.
+ */
+struct manifest_file *manifest_file_new(struct manifest *manifest,
+                                        const gchar *uri);
+
+/*
+ * Write the next part of the file. Returns FALSE on failure.
+ */
+gboolean manifest_file_write(struct manifest_file *file,
+                             const guchar *content, gsize content_len);
+
+/*
+ * Finish and free the file. If the content is the same as in the
+ * previous make, the staged copy is dropped and the old file is kept.
+ * Returns FALSE if the file could not be written.
+ */
+gboolean manifest_file_close(struct manifest_file *file);
+
+/*
+ * Move the staged files to the output directory, remove the files of
+ * the previous make not made anymore and save the new manifest. The
+ * first make to an existing directory not made by pwgallery moves it
+ * aside as a whole. Returns FALSE if the files could not be moved.
+ */
+gboolean manifest_save(struct manifest *manifest);
+
+/*
+ * Remove the staged files of a cancelled or failed make. The output
+ * directory is left as it was.
+ */
+void manifest_discard(struct manifest *manifest);
+
+/*
+ * Free the manifest
+ */
+void manifest_free(struct manifest *manifest);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "main.h"
+#include "model.h"
+#include "image.h"
+
+#include <glib.h>
+#include <string.h>                 /* memmove */
+
+/* Compare function of model_sort, passed through the sort */
+struct model_compare
+{
+    GCompareFunc   func;
+};
+
+static void _reindex(struct model *model, guint from, guint to);
+static gint _compare(gconstpointer a, gconstpointer b, gpointer user_data);
+
+
+
+struct model *
+model_new(void)
+{
+    struct model *model;
+
+    model = g_new0(struct model, 1);
+    model->images = g_ptr_array_new();
+    model->uris = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                        g_free, NULL);
+
+    return model;
+}
+
+
+
+void
+model_free(struct model *model)
+{
+    guint i;
+
+    if (model == NULL)
+        return;
+
+    g_debug("in model_free");
+
+    for (i = 0; i < model->images->len; i++) {
+        image_free(g_ptr_array_index(model->images, i));
+    }
+
+    g_ptr_array_free(model->images, TRUE);
+    g_hash_table_destroy(model->uris);
+    g_free(model);
+}
+
+
+
+guint
+model_length(const struct model *model)
+{
+    g_assert(model != NULL);
+
+    return model->images->len;
+}
+
+
+
+struct image *
+model_nth(const struct model *model, gint index)
+{
+    g_assert(model != NULL);
+
+    if (index < 0 || (guint)index >= model->images->len)
+        return NULL;
+
+    return g_ptr_array_index(model->images, index);
+}
+
+
+
+gint
+model_index(const struct model *model, const struct image *img)
+{
+    g_assert(model != NULL);
+    g_assert(img != NULL);
+
+    if (model_nth(model, img->index) != img)
+        return -1;
+
+    return img->index;
+}
+
+
+
+struct image *
+model_lookup(const struct model *model, const gchar *uri)
+{
+    g_assert(model != NULL);
+    g_assert(uri != NULL);
+
+    return g_hash_table_lookup(model->uris, uri);
+}
+
+
+
+void
+model_append(struct model *model, struct image *img)
+{
+    model_insert(model, img, model->images->len);
+}
+
+
+
+void
+model_insert(struct model *model, struct image *img, guint index)
+{
+    gpointer *pdata;
+    guint len;
+
+    g_assert(model != NULL);
+    g_assert(img != NULL);
+    g_assert(model_index(model, img) == -1);
+
+    len = model->images->len;
+    if (index > len)
+        index = len;
+
+    /* grow by one and open a slot at index */
+    g_ptr_array_add(model->images, img);
+    pdata = model->images->pdata;
+    memmove(&pdata[index + 1], &pdata[index], (len - index) * sizeof(gpointer));
+    pdata[index] = img;
+
+    _reindex(model, index, len + 1);
+
+    g_hash_table_replace(model->uris, g_strdup(img->uri), img);
+}
+
+
+
+void
+model_remove(struct model *model, struct image *img)
+{
+    gint index;
+
+    g_assert(model != NULL);
+    g_assert(img != NULL);
+
+    index = model_index(model, img);
+    g_assert(index != -1);
+
+    g_ptr_array_remove_index(model->images, index);
+    _reindex(model, index, model->images->len);
+    img->index = -1;
+
+    /* another image with the same uri may be the one in the table */
+    if (g_hash_table_lookup(model->uris, img->uri) == img)
+        g_hash_table_remove(model->uris, img->uri);
+}
+
+
+
+void
+model_move(struct model *model, struct image *img, guint index)
+{
+    gpointer *pdata;
+    guint from;
+
+    g_assert(model != NULL);
+    g_assert(img != NULL);
+    g_assert(model_index(model, img) != -1);
+
+    from = img->index;
+    if (index >= model->images->len)
+        index = model->images->len - 1;
+
+    if (index == from)
+        return;
+
+    /* shift the images in between by one */
+    pdata = model->images->pdata;
+    if (index < from) {
+        memmove(&pdata[index + 1], &pdata[index],
+                (from - index) * sizeof(gpointer));
+        pdata[index] = img;
+        _reindex(model, index, from + 1);
+    } else {
+        memmove(&pdata[from], &pdata[from + 1],
+                (index - from) * sizeof(gpointer));
+        pdata[index] = img;
+        _reindex(model, from, index + 1);
+    }
+}
+
+
+
+void
+model_sort(struct model *model, GCompareFunc compare)
+{
+    struct model_compare ctx;
+
+    g_assert(model != NULL);
+    g_assert(compare != NULL);
+
+    /* ISO C can't pass a function pointer as a gpointer */
+    ctx.func = compare;
+    g_ptr_array_sort_with_data(model->images, _compare, &ctx);
+    _reindex(model, 0, model->images->len);
+}
+
+
+
+void
+model_set_uri(struct model *model, struct image *img, gchar *uri)
+{
+    g_assert(model != NULL);
+    g_assert(img != NULL);
+    g_assert(uri != NULL);
+
+    if (g_hash_table_lookup(model->uris, img->uri) == img)
+        g_hash_table_remove(model->uris, img->uri);
+
+    g_free(img->uri);
+    img->uri = uri;
+
+    if (model_index(model, img) != -1)
+        g_hash_table_replace(model->uris, g_strdup(img->uri), img);
+}
+
+
+
+/**********************
+ *                    *
+ * Static functions   *
+ *                    *
+ **********************/
+
+
+/*
+ * Update the index of the images in [from, to)
+ */
+static void
+_reindex(struct model *model, guint from, guint to)
+{
+    guint i;
+
+    for (i = from; i < to; i++) {
+        struct image *img = g_ptr_array_index(model->images, i);
+        img->index = i;
+    }
+}
+
+
+
+/*
+ * Compare the images in the array with the compare function of the
+ * caller. Equal images keep their order: the index is updated only
+ * after the sort.
+ */
+static gint
+_compare(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    struct model_compare *ctx = user_data;
+    const struct image *img_a = *(struct image * const *)a;
+    const struct image *img_b = *(struct image * const *)b;
+    gint result;
+
+    result = ctx->func(img_a, img_b);
+    if (result == 0 && img_a->index != img_b->index)
+        result = img_a->index < img_b->index ? -1 : 1;
+
+    return result;
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
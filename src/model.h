@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#ifndef PWGALLERY_MODEL_H
+#define PWGALLERY_MODEL_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "main.h"
+
+#include <glib.h>
+
+/*
+ * The images of a gallery in order. Each image knows its place in the
+ * model (image->index), so finding the neighbours of an image doesn't
+ * need a search. The images can also be looked up by uri.
+ */
+struct model
+{
+    GPtrArray      *images;            /* struct image in gallery order */
+    GHashTable     *uris;              /* uri -> struct image */
+};
+
+/*
+ * Create an empty model
+ */
+struct model *model_new(void);
+
+/*
+ * Free the model and the images in it
+ */
+void model_free(struct model *model);
+
+/*
+ * Number of images in the model
+ */
+guint model_length(const struct model *model);
+
+/*
+ * Get the image at index, or NULL if index is out of range
+ */
+struct image *model_nth(const struct model *model, gint index);
+
+/*
+ * Get the index of the image, or -1 if it is not in the model
+ */
+gint model_index(const struct model *model, const struct image *img);
+
+/*
+ * Find an image by uri. If there are several images with the same
+ * uri, the last one added is returned.
+ */
+struct image *model_lookup(const struct model *model, const gchar *uri);
+
+/*
+ * Add an image to the end
+ */
+void model_append(struct model *model, struct image *img);
+
+/*
+ * Add an image before index. Index past the end appends.
+ */
+void model_insert(struct model *model, struct image *img, guint index);
+
+/*
+ * Remove an image from the model without freeing it
+ */
+void model_remove(struct model *model, struct image *img);
+
+/*
+ * Move an image to index. Index past the end moves to the end.
+ */
+void model_move(struct model *model, struct image *img, guint index);
+
+/*
+ * Sort the images. The compare function gets two struct images.
+ * Images that compare equal keep their order.
+ */
+void model_sort(struct model *model, GCompareFunc compare);
+
+/*
+ * Change the uri of an image in the model. Takes the uri.
+ */
+void model_set_uri(struct model *model, struct image *img, gchar *uri);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
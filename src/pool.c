@@ -0,0 +1,382 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "pool.h"
+
+#include <glib.h>
+
+/* How often (ms) the progress is updated while waiting for a batch */
+#define PWGALLERY_POOL_PROGRESS_INTERVAL 100
+
+/*
+ * Each worker has its own deque. The owner takes jobs from the head
+ * and idle workers steal from the tail of the others' deques, so a
+ * slow job never keeps the other workers waiting.
+ */
+struct pool_worker
+{
+    struct pool     *pool;             /* pool of the worker */
+    GThread         *thread;           /* worker thread */
+    GQueue          deque;             /* queued jobs of the worker */
+    GMutex          mutex;             /* protects the deque */
+    gint            index;             /* index of the worker in the pool */
+};
+
+struct pool
+{
+    struct pool_worker *workers;       /* array of workers */
+    gint            n_workers;         /* number of workers */
+    GMutex          mutex;             /* protects the fields below */
+    GCond           work_cond;         /* signalled when jobs are queued */
+    GCond           done_cond;         /* signalled when a job is finished */
+    gint            queued;            /* jobs waiting in the deques */
+    guint           next_worker;       /* round robin for outside pushes */
+    gboolean        stop;              /* workers exit when no jobs left */
+};
+
+struct pool_batch
+{
+    struct pool     *pool;             /* pool running the jobs */
+    gint            total;             /* jobs pushed to the batch */
+    gint            done;              /* jobs finished */
+    gboolean        failed;            /* some job returned FALSE */
+};
+
+struct pool_job
+{
+    pool_func       func;              /* function to run */
+    gpointer        user_data;         /* data for the function */
+    struct pool_batch *batch;          /* batch of the job */
+};
+
+/* worker of the current thread, NULL if not a worker */
+static GPrivate current_worker = G_PRIVATE_INIT(NULL);
+
+static gpointer _worker_thread(gpointer user_data);
+static struct pool_job *_take_job(struct pool_worker *worker);
+
+
+struct pool *
+pool_new(gint n_workers)
+{
+    struct pool *pool;
+    gint i;
+
+    if (n_workers <= 0)
+        n_workers = g_get_num_processors();
+
+    g_debug("in pool_new: %d workers", n_workers);
+
+    pool = g_new0(struct pool, 1);
+    g_mutex_init(&pool->mutex);
+    g_cond_init(&pool->work_cond);
+    g_cond_init(&pool->done_cond);
+
+    pool->n_workers = n_workers;
+    pool->workers = g_new0(struct pool_worker, n_workers);
+
+    for (i = 0; i < n_workers; i++) {
+        struct pool_worker *worker = &pool->workers[i];
+
+        worker->pool = pool;
+        worker->index = i;
+        g_queue_init(&worker->deque);
+        g_mutex_init(&worker->mutex);
+    }
+
+    /* start the threads only after all the deques are initialized */
+    for (i = 0; i < n_workers; i++) {
+        pool->workers[i].thread = g_thread_new("pool_worker",
+                                               _worker_thread,
+                                               &pool->workers[i]);
+    }
+
+    return pool;
+}
+
+
+
+void
+pool_free(struct pool *pool)
+{
+    gint i;
+
+    if (pool == NULL)
+        return;
+
+    g_debug("in pool_free");
+
+    g_mutex_lock(&pool->mutex);
+    pool->stop = TRUE;
+    g_cond_broadcast(&pool->work_cond);
+    g_mutex_unlock(&pool->mutex);
+
+    for (i = 0; i < pool->n_workers; i++) {
+        g_thread_join(pool->workers[i].thread);
+        g_mutex_clear(&pool->workers[i].mutex);
+    }
+
+    g_mutex_clear(&pool->mutex);
+    g_cond_clear(&pool->work_cond);
+    g_cond_clear(&pool->done_cond);
+    g_free(pool->workers);
+    g_free(pool);
+}
+
+
+
+gint
+pool_get_n_workers(struct pool *pool)
+{
+    g_assert(pool != NULL);
+
+    return pool->n_workers;
+}
+
+
+
+struct pool_batch *
+pool_batch_new(struct pool *pool)
+{
+    struct pool_batch *batch;
+
+    g_assert(pool != NULL);
+
+    batch = g_new0(struct pool_batch, 1);
+    batch->pool = pool;
+
+    return batch;
+}
+
+
+
+void
+pool_batch_free(struct pool_batch *batch)
+{
+    if (batch == NULL)
+        return;
+
+    g_assert(batch->done == batch->total);
+
+    g_free(batch);
+}
+
+
+
+void
+pool_push(struct pool_batch *batch, pool_func func, gpointer user_data)
+{
+    struct pool *pool;
+    struct pool_worker *worker;
+    struct pool_job *job;
+
+    g_assert(batch != NULL);
+    g_assert(func != NULL);
+
+    pool = batch->pool;
+
+    job = g_new0(struct pool_job, 1);
+    job->func = func;
+    job->user_data = user_data;
+    job->batch = batch;
+
+    /* Count the job before it can be taken so the batch can't look
+     * finished too early, and publish it under the pool lock so a
+     * worker can't take it before it is in queued. The pool lock is
+     * always taken before the deque locks. */
+    g_mutex_lock(&pool->mutex);
+    batch->total++;
+
+    worker = g_private_get(&current_worker);
+    if (worker != NULL && worker->pool == pool) {
+        /* jobs pushed by a job go to the head of the own deque */
+        g_mutex_lock(&worker->mutex);
+        g_queue_push_head(&worker->deque, job);
+        g_mutex_unlock(&worker->mutex);
+    } else {
+        /* others are spread to the workers round robin */
+        worker = &pool->workers[pool->next_worker++ % pool->n_workers];
+
+        g_mutex_lock(&worker->mutex);
+        g_queue_push_tail(&worker->deque, job);
+        g_mutex_unlock(&worker->mutex);
+    }
+
+    pool->queued++;
+    g_cond_signal(&pool->work_cond);
+    g_mutex_unlock(&pool->mutex);
+}
+
+
+
+gboolean
+pool_batch_wait(struct pool_batch *batch,
+                pool_progress_func progress,
+                gpointer user_data)
+{
+    struct pool *pool;
+    gint done = -1, total = 0;
+    gboolean failed;
+
+    g_assert(batch != NULL);
+
+    pool = batch->pool;
+
+    /* waiting for the pool in a worker would deadlock */
+    g_assert(g_private_get(&current_worker) == NULL);
+
+    g_mutex_lock(&pool->mutex);
+    while (batch->done < batch->total) {
+        gint64 end_time;
+
+        end_time = g_get_monotonic_time() + 
+            PWGALLERY_POOL_PROGRESS_INTERVAL * G_TIME_SPAN_MILLISECOND;
+        g_cond_wait_until(&pool->done_cond, &pool->mutex, end_time);
+
+        /* report progress without holding the lock */
+        if (progress != NULL && batch->done != done) {
+            done = batch->done;
+            total = batch->total;
+            g_mutex_unlock(&pool->mutex);
+            progress(done, total, user_data);
+            g_mutex_lock(&pool->mutex);
+        }
+    }
+    failed = batch->failed;
+    total = batch->total;
+    g_mutex_unlock(&pool->mutex);
+
+    /* the last jobs may have finished while reporting */
+    if (progress != NULL && done != total) {
+        progress(total, total, user_data);
+    }
+
+    return !failed;
+}
+
+
+
+/**********************
+ *                    *
+ * Static functions   *
+ *                    *
+ **********************/
+
+
+/*
+ * Worker thread running jobs until the pool is stopped
+ */
+static gpointer
+_worker_thread(gpointer user_data)
+{
+    struct pool_worker *worker;
+    struct pool *pool;
+
+    g_assert(user_data != NULL);
+
+    worker = user_data;
+    pool = worker->pool;
+
+    g_private_set(&current_worker, worker);
+
+    while (TRUE) {
+        struct pool_job *job;
+        gboolean ok;
+
+        job = _take_job(worker);
+
+        if (job == NULL) {
+            /* sleep until there is something to take */
+            g_mutex_lock(&pool->mutex);
+            while (pool->queued == 0 && !pool->stop) {
+                g_cond_wait(&pool->work_cond, &pool->mutex);
+            }
+            if (pool->queued == 0 && pool->stop) {
+                g_mutex_unlock(&pool->mutex);
+                break;
+            }
+            g_mutex_unlock(&pool->mutex);
+            continue;
+        }
+
+        g_mutex_lock(&pool->mutex);
+        pool->queued--;
+        g_mutex_unlock(&pool->mutex);
+
+        ok = job->func(job->user_data);
+
+        g_mutex_lock(&pool->mutex);
+        if (!ok)
+            job->batch->failed = TRUE;
+        job->batch->done++;
+        g_cond_broadcast(&pool->done_cond);
+        g_mutex_unlock(&pool->mutex);
+
+        g_free(job);
+    }
+
+    g_private_set(&current_worker, NULL);
+
+    return NULL;
+}
+
+
+
+/*
+ * Take a job from the own deque or steal one from the other workers
+ */
+static struct pool_job *
+_take_job(struct pool_worker *worker)
+{
+    struct pool *pool;
+    struct pool_job *job;
+    gint i;
+
+    pool = worker->pool;
+
+    g_mutex_lock(&worker->mutex);
+    job = g_queue_pop_head(&worker->deque);
+    g_mutex_unlock(&worker->mutex);
+
+    for (i = 1; job == NULL && i < pool->n_workers; i++) {
+        struct pool_worker *victim;
+
+        victim = &pool->workers[(worker->index + i) % pool->n_workers];
+
+        g_mutex_lock(&victim->mutex);
+        job = g_queue_pop_tail(&victim->deque);
+        g_mutex_unlock(&victim->mutex);
+    }
+
+    return job;
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+
+#ifndef PWGALLERY_POOL_H
+#define PWGALLERY_POOL_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <glib.h>
+
+/*
+ * A job run by the pool. Returns FALSE on failure.
+ */
+typedef gboolean (*pool_func)(gpointer user_data);
+
+/*
+ * Progress of a batch, called in the thread waiting for the batch.
+ */
+typedef void (*pool_progress_func)(gint done, gint total, gpointer user_data);
+
+struct pool;
+struct pool_batch;
+
+/*
+ * Create a pool of worker threads. If n_workers is 0, one worker per
+ * CPU is started.
+ */
+struct pool *pool_new(gint n_workers);
+
+/*
+ * Stop the workers and free the pool. Queued jobs are still run.
+ */
+void pool_free(struct pool *pool);
+
+/*
+ * Number of worker threads in the pool
+ */
+gint pool_get_n_workers(struct pool *pool);
+
+/*
+ * Start a new batch of jobs. Batches are used to wait for a set of
+ * jobs and to collect their results.
+ */
+struct pool_batch *pool_batch_new(struct pool *pool);
+
+/*
+ * Free a batch. All its jobs must be finished.
+ */
+void pool_batch_free(struct pool_batch *batch);
+
+/*
+ * Queue a job to the pool as a part of the batch. Can be called from
+ * the jobs too.
+ */
+void pool_push(struct pool_batch *batch, pool_func func, gpointer user_data);
+
+/*
+ * Wait until all the jobs of the batch are finished. The progress
+ * function, if given, is called from the calling thread whenever
+ * jobs have finished. Returns FALSE if any of the jobs failed.
+ */
+gboolean pool_batch_wait(struct pool_batch *batch,
+                         pool_progress_func progress,
+                         gpointer user_data);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
@@ -0,0 +1,467 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "main.h"
+#include "prefetch.h"
+#include "image.h"
+#include "model.h"
+#include "thumbcache.h"
+
+#include <glib.h>
+#include <gtk/gtk.h>
+
+/* Images kept loaded after and before the shown one */
+#define PWGALLERY_PREFETCH_AHEAD      5
+#define PWGALLERY_PREFETCH_BEHIND     5
+/* Most threads loading the images at once */
+#define PWGALLERY_PREFETCH_THREADS    4
+
+/* A thread loading one image at a time */
+struct prefetch_worker
+{
+    struct prefetch *prefetch;
+    GThread         *thread;
+    gint            loading;           /* index being loaded or -1 */
+    gint            cancel;            /* abandon the current load */
+};
+
+struct prefetch
+{
+    struct data     *data;
+    GPtrArray       *images;           /* images of the slide show */
+    GdkPixbuf       **frames;          /* loaded images or NULL */
+    gboolean        *failed;           /* images that can't be loaded */
+    gboolean        *loading;          /* images being loaded */
+    gint            screen_w;          /* size to scale the images to */
+    gint            screen_h;
+    guint64         budget;            /* memory for the loaded images */
+    guint64         bytes;             /* memory used by the loaded images */
+    guint64         reserved;          /* memory of the loads in flight */
+    gint            cursor;            /* index of the shown image */
+    gboolean        stop;              /* the threads exit */
+    struct prefetch_worker *workers;   /* loading threads */
+    gint            n_workers;
+    GMutex          mutex;             /* protects all the above */
+    GCond           wake;              /* cursor moved or stop */
+    GCond           loaded;            /* an image loaded or failed */
+};
+
+static gpointer _thread(gpointer user_data);
+static GdkPixbuf *_load(struct prefetch *prefetch, struct image *img,
+                        gint *cancel, gboolean *decoded);
+static void _make_room(struct prefetch *prefetch, gint index);
+static gint _next(struct prefetch *prefetch);
+static gboolean _in_window(struct prefetch *prefetch, gint index);
+static void _evict(struct prefetch *prefetch);
+static guint64 _frame_bytes(GdkPixbuf *pixbuf);
+static guint64 _load_bytes(struct prefetch *prefetch, struct image *img);
+
+
+
+struct prefetch *
+prefetch_new(struct data *data, gint screen_w, gint screen_h)
+{
+    struct prefetch *prefetch;
+    guint i;
+
+    g_assert(data != NULL);
+    g_assert(data->gal != NULL);
+
+    g_debug("in prefetch_new");
+
+    prefetch = g_new0(struct prefetch, 1);
+    prefetch->data = data;
+    prefetch->screen_w = screen_w;
+    prefetch->screen_h = screen_h;
+    prefetch->budget = (guint64)MAX(data->ss_memory, 0) * 1024 * 1024;
+    prefetch->cursor = 0;
+
+    /* the loading threads don't touch the model */
+    prefetch->images = g_ptr_array_new();
+    for (i = 0; i < model_length(data->gal->model); i++) {
+        g_ptr_array_add(prefetch->images, model_nth(data->gal->model, i));
+    }
+    prefetch->frames = g_new0(GdkPixbuf *, prefetch->images->len);
+    prefetch->failed = g_new0(gboolean, prefetch->images->len);
+    prefetch->loading = g_new0(gboolean, prefetch->images->len);
+
+    g_mutex_init(&prefetch->mutex);
+    g_cond_init(&prefetch->wake);
+    g_cond_init(&prefetch->loaded);
+
+    /* the workers wait for the lock until all are started */
+    prefetch->n_workers = CLAMP(g_get_num_processors(), 1,
+                                PWGALLERY_PREFETCH_THREADS);
+    prefetch->workers = g_new0(struct prefetch_worker, prefetch->n_workers);
+
+    g_mutex_lock(&prefetch->mutex);
+    for (i = 0; i < (guint)prefetch->n_workers; i++) {
+        struct prefetch_worker *worker = &prefetch->workers[i];
+
+        worker->prefetch = prefetch;
+        worker->loading = -1;
+        worker->thread = g_thread_new("prefetch", _thread, worker);
+    }
+    g_mutex_unlock(&prefetch->mutex);
+
+    return prefetch;
+}
+
+
+
+GdkPixbuf *
+prefetch_get(struct prefetch *prefetch, gint index)
+{
+    GdkPixbuf *pixbuf;
+
+    g_assert(prefetch != NULL);
+    g_assert(index >= 0 && (guint)index < prefetch->images->len);
+
+    g_debug("in prefetch_get: %d", index);
+
+    g_mutex_lock(&prefetch->mutex);
+
+    /* move the window, the image to show now goes first */
+    prefetch->cursor = index;
+    _make_room(prefetch, index);
+    g_cond_broadcast(&prefetch->wake);
+
+    while (prefetch->frames[index] == NULL && !prefetch->failed[index]) {
+        g_cond_wait(&prefetch->loaded, &prefetch->mutex);
+    }
+
+    pixbuf = prefetch->frames[index];
+    if (pixbuf != NULL)
+        g_object_ref(pixbuf);
+
+    g_mutex_unlock(&prefetch->mutex);
+
+    return pixbuf;
+}
+
+
+
+void
+prefetch_free(struct prefetch *prefetch)
+{
+    guint i;
+
+    if (prefetch == NULL)
+        return;
+
+    g_debug("in prefetch_free");
+
+    g_mutex_lock(&prefetch->mutex);
+    prefetch->stop = TRUE;
+    for (i = 0; i < (guint)prefetch->n_workers; i++) {
+        g_atomic_int_set(&prefetch->workers[i].cancel, 1);
+    }
+    g_cond_broadcast(&prefetch->wake);
+    g_mutex_unlock(&prefetch->mutex);
+
+    for (i = 0; i < (guint)prefetch->n_workers; i++) {
+        g_thread_join(prefetch->workers[i].thread);
+    }
+
+    for (i = 0; i < prefetch->images->len; i++) {
+        if (prefetch->frames[i] != NULL)
+            g_object_unref(prefetch->frames[i]);
+    }
+
+    g_mutex_clear(&prefetch->mutex);
+    g_cond_clear(&prefetch->wake);
+    g_cond_clear(&prefetch->loaded);
+    g_free(prefetch->frames);
+    g_free(prefetch->failed);
+    g_free(prefetch->loading);
+    g_free(prefetch->workers);
+    g_ptr_array_free(prefetch->images, TRUE);
+    g_free(prefetch);
+}
+
+
+
+/**********************
+ *                    *
+ * Static functions   *
+ *                    *
+ **********************/
+
+/*
+ * Load the images nearest to the shown one, sleep when the window is
+ * loaded until the shown image changes. Several of these run at once.
+ */
+static gpointer
+_thread(gpointer user_data)
+{
+    struct prefetch_worker *worker;
+    struct prefetch *prefetch;
+
+    g_assert(user_data != NULL);
+    worker = user_data;
+    prefetch = worker->prefetch;
+
+    g_mutex_lock(&prefetch->mutex);
+    while (!prefetch->stop) {
+        struct image *img;
+        GdkPixbuf *pixbuf;
+        gboolean decoded = FALSE;
+        guint64 reserved;
+        gint index;
+
+        _evict(prefetch);
+
+        index = _next(prefetch);
+        if (index == -1) {
+            g_cond_wait(&prefetch->wake, &prefetch->mutex);
+            continue;
+        }
+
+        /* counted in the budget until loaded, as if decoded at full
+         * size */
+        img = g_ptr_array_index(prefetch->images, index);
+        reserved = _load_bytes(prefetch, img);
+        prefetch->reserved += reserved;
+        prefetch->loading[index] = TRUE;
+        worker->loading = index;
+        g_atomic_int_set(&worker->cancel, 0);
+        g_mutex_unlock(&prefetch->mutex);
+
+        pixbuf = _load(prefetch, img, &worker->cancel, &decoded);
+
+        g_mutex_lock(&prefetch->mutex);
+        prefetch->loading[index] = FALSE;
+        worker->loading = -1;
+
+        /* the others may fit in the budget now */
+        prefetch->reserved -= reserved;
+        g_cond_broadcast(&prefetch->wake);
+
+        if (pixbuf == NULL) {
+            /* an abandoned load is tried again if needed */
+            if (!g_atomic_int_get(&worker->cancel))
+                prefetch->failed[index] = TRUE;
+        } else if (_in_window(prefetch, index)) {
+            prefetch->frames[index] = g_object_ref(pixbuf);
+            prefetch->bytes += _frame_bytes(pixbuf);
+        }
+
+        g_cond_broadcast(&prefetch->loaded);
+
+        /* save a decoded frame for the next time, after it is shown */
+        if (pixbuf != NULL && decoded) {
+            g_mutex_unlock(&prefetch->mutex);
+            thumbcache_store_frame(prefetch->data, img, prefetch->screen_w,
+                                   prefetch->screen_h, pixbuf);
+            g_mutex_lock(&prefetch->mutex);
+        }
+
+        if (pixbuf != NULL)
+            g_object_unref(pixbuf);
+    }
+    g_mutex_unlock(&prefetch->mutex);
+
+    return NULL;
+}
+
+
+
+/*
+ * Load an image from the frame cache, or decode it from the original.
+ * Called without the lock.
+ */
+static GdkPixbuf *
+_load(struct prefetch *prefetch, struct image *img, gint *cancel,
+      gboolean *decoded)
+{
+    GdkPixbuf *pixbuf;
+
+    pixbuf = thumbcache_lookup_frame(prefetch->data, img,
+                                     prefetch->screen_w, prefetch->screen_h);
+    if (pixbuf != NULL)
+        return pixbuf;
+
+    g_debug("%s: decoding %s", __func__, img->basefilename);
+    *decoded = TRUE;
+
+    return image_load_ss_pixbuf(prefetch->data, img, prefetch->screen_w,
+                                prefetch->screen_h, cancel);
+}
+
+
+
+/*
+ * Abandon the loads that fell out of the window. If the image to show
+ * now is not loaded and all the threads are busy, abandon also the
+ * load farthest from it.
+ */
+static void
+_make_room(struct prefetch *prefetch, gint index)
+{
+    struct prefetch_worker *farthest = NULL;
+    gboolean idle = FALSE;
+    gint i;
+
+    for (i = 0; i < prefetch->n_workers; i++) {
+        struct prefetch_worker *worker = &prefetch->workers[i];
+
+        if (worker->loading == -1) {
+            idle = TRUE;
+            continue;
+        }
+
+        if (!_in_window(prefetch, worker->loading)) {
+            g_atomic_int_set(&worker->cancel, 1);
+            idle = TRUE;
+            continue;
+        }
+
+        if (worker->loading != index &&
+            (farthest == NULL ||
+             ABS(worker->loading - index) > ABS(farthest->loading - index)))
+            farthest = worker;
+    }
+
+    if (prefetch->frames[index] == NULL && !prefetch->failed[index] &&
+        !prefetch->loading[index] && !idle && farthest != NULL)
+        g_atomic_int_set(&farthest->cancel, 1);
+}
+
+
+
+/*
+ * Next image to load: the shown one, then alternately the ones after
+ * and before it, nearest first. Other than the shown one are loaded
+ * only while the budget allows, counting the loads in flight. Returns
+ * -1 if nothing to load.
+ */
+static gint
+_next(struct prefetch *prefetch)
+{
+    gint n, d;
+
+    n = prefetch->images->len;
+
+    for (d = 0; d <= MAX(PWGALLERY_PREFETCH_AHEAD,
+                         PWGALLERY_PREFETCH_BEHIND); d++) {
+        gint candidates[2];
+        gint i;
+
+        candidates[0] = d <= PWGALLERY_PREFETCH_AHEAD ?
+            prefetch->cursor + d : -1;
+        candidates[1] = d > 0 && d <= PWGALLERY_PREFETCH_BEHIND ?
+            prefetch->cursor - d : -1;
+
+        for (i = 0; i < 2; i++) {
+            gint index = candidates[i];
+
+            if (index < 0 || index >= n)
+                continue;
+            if (prefetch->frames[index] != NULL || prefetch->failed[index] ||
+                prefetch->loading[index])
+                continue;
+            if (d > 0) {
+                guint64 bytes;
+
+                bytes = _load_bytes(prefetch,
+                                    g_ptr_array_index(prefetch->images, index));
+                if (prefetch->bytes + prefetch->reserved + bytes >
+                    prefetch->budget)
+                    return -1;
+            }
+
+            return index;
+        }
+    }
+
+    return -1;
+}
+
+
+
+/*
+ * Check if the image is in the window kept loaded
+ */
+static gboolean
+_in_window(struct prefetch *prefetch, gint index)
+{
+    return index >= prefetch->cursor - PWGALLERY_PREFETCH_BEHIND &&
+        index <= prefetch->cursor + PWGALLERY_PREFETCH_AHEAD;
+}
+
+
+
+/*
+ * Drop the loaded images out of the window
+ */
+static void
+_evict(struct prefetch *prefetch)
+{
+    guint i;
+
+    for (i = 0; i < prefetch->images->len; i++) {
+        if (prefetch->frames[i] == NULL || _in_window(prefetch, i))
+            continue;
+
+        g_debug("%s: dropping %d", __func__, i);
+        prefetch->bytes -= _frame_bytes(prefetch->frames[i]);
+        g_object_unref(prefetch->frames[i]);
+        prefetch->frames[i] = NULL;
+    }
+}
+
+
+
+/*
+ * Memory used by a loaded image
+ */
+static guint64
+_frame_bytes(GdkPixbuf *pixbuf)
+{
+    return (guint64)gdk_pixbuf_get_rowstride(pixbuf) *
+        gdk_pixbuf_get_height(pixbuf);
+}
+
+
+
+/*
+ * Memory an image may take while being loaded: the original decoded
+ * at full size if its size is known, otherwise a frame of the screen
+ */
+static guint64
+_load_bytes(struct prefetch *prefetch, struct image *img)
+{
+    if (img->width > 0 && img->height > 0)
+        return (guint64)img->width * img->height * 4;
+
+    return (guint64)prefetch->screen_w * prefetch->screen_h * 4;
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
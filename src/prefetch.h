@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#ifndef PWGALLERY_PREFETCH_H
+#define PWGALLERY_PREFETCH_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "main.h"
+
+#include <glib.h>
+#include <gtk/gtk.h>
+
+/*
+ * Loads the slide show images around the shown one in a few threads,
+ * from the frame cache of thumbcache when possible. A window of
+ * images on both sides of the shown one is kept loaded within
+ * data->ss_memory, the images falling out of the window are dropped
+ * and a load of one is abandoned.
+ */
+struct prefetch;
+
+/*
+ * Start loading the images of the gallery for a slide show on the
+ * given screen size
+ */
+struct prefetch *prefetch_new(struct data *data, gint screen_w, gint screen_h);
+
+/*
+ * Move to the image at index in the gallery and wait until it is
+ * loaded. Returns a new reference to the pixbuf or NULL if the image
+ * can't be loaded.
+ */
+GdkPixbuf *prefetch_get(struct prefetch *prefetch, gint index);
+
+/*
+ * Stop the loading and free the loaded images
+ */
+void prefetch_free(struct prefetch *prefetch);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "probe.h"
+
+#include <glib.h>
+#include <string.h>                 /* memcmp */
+
+/* Big and little endian integers from the header */
+#define BE16(p) (((p)[0] << 8) | (p)[1])
+#define BE32(p) (((guint32)(p)[0] << 24) | ((p)[1] << 16) | \
+                 ((p)[2] << 8) | (p)[3])
+#define LE16(p) (((p)[1] << 8) | (p)[0])
+
+static enum probe_result _probe_jpeg(const guchar *buf, gsize len,
+                                     gint *width, gint *height);
+static enum probe_result _probe_png(const guchar *buf, gsize len,
+                                    gint *width, gint *height);
+static enum probe_result _probe_gif(const guchar *buf, gsize len,
+                                    gint *width, gint *height);
+
+
+
+enum probe_result
+probe_size(const guchar *buf, gsize len, gint *width, gint *height)
+{
+    enum probe_result result;
+
+    g_assert(buf != NULL || len == 0);
+    g_assert(width != NULL);
+    g_assert(height != NULL);
+
+    /* enough to recognize all the formats */
+    if (len < 8)
+        return PROBE_NEED_MORE;
+
+    if (buf[0] == 0xFF && buf[1] == 0xD8) {
+        result = _probe_jpeg(buf, len, width, height);
+    } else if (memcmp(buf, "\x89PNG\r\n\x1a\n", 8) == 0) {
+        result = _probe_png(buf, len, width, height);
+    } else if (memcmp(buf, "GIF87a", 6) == 0 ||
+               memcmp(buf, "GIF89a", 6) == 0) {
+        result = _probe_gif(buf, len, width, height);
+    } else {
+        return PROBE_UNKNOWN;
+    }
+
+    /* don't trust a header claiming an empty image */
+    if (result == PROBE_FOUND && (*width <= 0 || *height <= 0))
+        return PROBE_UNKNOWN;
+
+    return result;
+}
+
+
+
+/**********************
+ *                    *
+ * Static functions   *
+ *                    *
+ **********************/
+
+
+/*
+ * Walk the JPEG markers until the start of frame
+ */
+static enum probe_result
+_probe_jpeg(const guchar *buf, gsize len, gint *width, gint *height)
+{
+    gsize pos = 2;
+
+    while (TRUE) {
+        guchar marker;
+
+        /* markers may be padded with any number of 0xFF */
+        if (pos >= len)
+            return PROBE_NEED_MORE;
+        if (buf[pos] != 0xFF)
+            return PROBE_UNKNOWN;
+        while (pos < len && buf[pos] == 0xFF)
+            ++pos;
+        if (pos >= len)
+            return PROBE_NEED_MORE;
+
+        marker = buf[pos++];
+
+        /* standalone markers without a length */
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8))
+            continue;
+
+        /* end of image or scan data before the frame header */
+        if (marker == 0xD9 || marker == 0xDA)
+            return PROBE_UNKNOWN;
+
+        if (pos + 2 > len)
+            return PROBE_NEED_MORE;
+
+        /* SOF0..SOF15, except DHT, JPG and DAC */
+        if (marker >= 0xC0 && marker <= 0xCF &&
+            marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            /* length, precision, height, width */
+            if (pos + 7 > len)
+                return PROBE_NEED_MORE;
+            *height = BE16(buf + pos + 3);
+            *width = BE16(buf + pos + 5);
+            return PROBE_FOUND;
+        }
+
+        /* skip the segment, the length includes itself */
+        if (BE16(buf + pos) < 2)
+            return PROBE_UNKNOWN;
+        pos += BE16(buf + pos);
+    }
+}
+
+
+
+/*
+ * The IHDR chunk is always the first one
+ */
+static enum probe_result
+_probe_png(const guchar *buf, gsize len, gint *width, gint *height)
+{
+    guint32 w, h;
+
+    /* signature, chunk length, "IHDR", width, height */
+    if (len < 24)
+        return PROBE_NEED_MORE;
+    if (memcmp(buf + 12, "IHDR", 4) != 0)
+        return PROBE_UNKNOWN;
+
+    w = BE32(buf + 16);
+    h = BE32(buf + 20);
+    if (w > G_MAXINT || h > G_MAXINT)
+        return PROBE_UNKNOWN;
+
+    *width = (gint)w;
+    *height = (gint)h;
+
+    return PROBE_FOUND;
+}
+
+
+
+/*
+ * The logical screen size follows the signature
+ */
+static enum probe_result
+_probe_gif(const guchar *buf, gsize len, gint *width, gint *height)
+{
+    if (len < 10)
+        return PROBE_NEED_MORE;
+
+    *width = LE16(buf + 6);
+    *height = LE16(buf + 8);
+
+    return PROBE_FOUND;
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
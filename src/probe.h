@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#ifndef PWGALLERY_PROBE_H
+#define PWGALLERY_PROBE_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <glib.h>
+
+/* Give up probing if the size is not found in this many bytes */
+#define PWGALLERY_PROBE_MAX_LEN            (1024 * 1024)
+
+/*
+ * Result of probing the header of an image
+ */
+enum probe_result
+{
+    PROBE_FOUND,                       /* width and height are set */
+    PROBE_NEED_MORE,                   /* more data needed */
+    PROBE_UNKNOWN                      /* unknown format or broken file */
+};
+
+/*
+ * Find the width and height of a JPEG, PNG or GIF image from the
+ * beginning of the file without decoding any pixels.
+ */
+enum probe_result probe_size(const guchar *buf, gsize len,
+                             gint *width, gint *height);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
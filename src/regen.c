@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "main.h"
+#include "regen.h"
+#include "gallery.h"
+#include "pool.h"
+#include "vfs.h"
+#include "xml.h"
+#include "model.h"
+
+#include <glib.h>
+#include <string.h>                  /* memset */
+
+/* The galleries to make, shared by the threads making them */
+struct regen
+{
+    struct data     *data;             /* the application */
+    GPtrArray       *uris;             /* galleries to make */
+    GPtrArray       *opened;           /* the galleries opened or NULL */
+    gchar           **errors;          /* why a gallery failed or NULL */
+    guint           next;              /* next gallery to take */
+    GHashTable      *building;         /* output directories being made */
+    GMutex          mutex;             /* protects next and building */
+    GCond           built;             /* a gallery was made */
+};
+
+static gboolean _run(struct regen *regen);
+static gpointer _thread(gpointer user_data);
+static gchar *_regen(struct regen *regen, const gchar *uri);
+static gchar *_build(struct regen *regen, struct data *data);
+
+
+
+gboolean
+regen_galleries(struct data *data, GSList *uris)
+{
+    struct regen regen;
+    GSList       *list;
+
+    g_assert(data != NULL);
+
+    g_debug("in regen_galleries");
+
+    memset(&regen, 0, sizeof(regen));
+    regen.data = data;
+    regen.uris = g_ptr_array_new();
+    for (list = uris; list != NULL; list = list->next) {
+        g_ptr_array_add(regen.uris, list->data);
+    }
+
+    return _run(&regen);
+}
+
+
+
+gboolean
+regen_opened(struct data *data, GSList *galleries)
+{
+    struct regen regen;
+    GSList       *list;
+
+    g_assert(data != NULL);
+
+    g_debug("in regen_opened");
+
+    memset(&regen, 0, sizeof(regen));
+    regen.data = data;
+    regen.uris = g_ptr_array_new();
+    regen.opened = g_ptr_array_new();
+    for (list = galleries; list != NULL; list = list->next) {
+        struct data *gal_data = list->data;
+
+        g_ptr_array_add(regen.uris, gal_data->gal->uri);
+        g_ptr_array_add(regen.opened, gal_data);
+    }
+
+    return _run(&regen);
+}
+
+
+
+/**********************
+ *                    *
+ * Static functions   *
+ *                    *
+ **********************/
+
+
+/*
+ * Make the galleries in threads of their own and print a summary.
+ * Frees the arrays of regen.
+ */
+static gboolean
+_run(struct regen *regen)
+{
+    GThread      **threads;
+    guint        n_threads, n_failed = 0;
+    guint        i;
+    struct data  *data = regen->data;
+
+    regen->errors = g_new0(gchar *, regen->uris->len);
+    regen->building = g_hash_table_new(g_str_hash, g_str_equal);
+    g_mutex_init(&regen->mutex);
+    g_cond_init(&regen->built);
+
+    if (regen->uris->len == 0) {
+        g_ptr_array_free(regen->uris, TRUE);
+        if (regen->opened != NULL)
+            g_ptr_array_free(regen->opened, TRUE);
+        g_free(regen->errors);
+        g_hash_table_destroy(regen->building);
+        g_mutex_clear(&regen->mutex);
+        g_cond_clear(&regen->built);
+        return TRUE;
+    }
+
+    /* Shared by all the galleries, started before the threads. The
+     * parser must be initialized in one thread. */
+    gallery_get_budget(data);
+    xmlInitParser();
+
+    /* a gallery thread mostly waits for the pool, so one per worker
+     * keeps the next galleries opening while the images are made */
+    n_threads = MIN((guint)pool_get_n_workers(gallery_get_pool(data)),
+                    regen->uris->len);
+    threads = g_new0(GThread *, n_threads);
+    for (i = 0; i < n_threads; i++) {
+        threads[i] = g_thread_new("regen", _thread, regen);
+    }
+    for (i = 0; i < n_threads; i++) {
+        g_thread_join(threads[i]);
+    }
+    g_free(threads);
+
+    /* summary */
+    for (i = 0; i < regen->uris->len; i++) {
+        if (regen->errors[i] == NULL)
+            continue;
+
+        g_print(_("Failed: %s: %s\n"),
+                (gchar *)g_ptr_array_index(regen->uris, i), regen->errors[i]);
+        g_free(regen->errors[i]);
+        n_failed++;
+    }
+    g_print(_("%u galleries made, %u failed\n"), regen->uris->len - n_failed,
+            n_failed);
+
+    g_ptr_array_free(regen->uris, TRUE);
+    if (regen->opened != NULL)
+        g_ptr_array_free(regen->opened, TRUE);
+    g_free(regen->errors);
+    g_hash_table_destroy(regen->building);
+    g_mutex_clear(&regen->mutex);
+    g_cond_clear(&regen->built);
+
+    return n_failed == 0;
+}
+
+
+
+/*
+ * Make galleries until none is left
+ */
+static gpointer
+_thread(gpointer user_data)
+{
+    struct regen *regen;
+
+    g_assert(user_data != NULL);
+    regen = user_data;
+
+    while (TRUE) {
+        guint index;
+
+        g_mutex_lock(&regen->mutex);
+        index = regen->next++;
+        g_mutex_unlock(&regen->mutex);
+
+        if (index >= regen->uris->len)
+            break;
+
+        /* each index is written by one thread only */
+        if (regen->opened != NULL)
+            regen->errors[index] = _build(regen,
+                                          g_ptr_array_index(regen->opened,
+                                                            index));
+        else
+            regen->errors[index] = _regen(regen,
+                                          g_ptr_array_index(regen->uris,
+                                                            index));
+    }
+
+    return NULL;
+}
+
+
+
+/*
+ * Open and make one gallery in its own copy of the data. Returns NULL
+ * or the reason of the failure.
+ */
+static gchar *
+_regen(struct regen *regen, const gchar *uri)
+{
+    struct data data;
+    gchar       *error = NULL;
+
+    g_debug("in _regen: %s", uri);
+
+    /* The copy shares with the other threads only
+     * - the settings from the configrc and the command line, which are
+     *   only read while making, and
+     * - the pool and the budget, set up by _run before the threads and
+     *   safe to use from any thread.
+     * The gallery, its images and its make are its own. The GUI fields
+     * are not used without the GUI. */
+    data = *regen->data;
+    data.gal = NULL;
+    data.import = NULL;
+    data.make = NULL;
+    data.current_img = NULL;
+    data.current_ss_img = NULL;
+    data.ss_prefetch = NULL;
+    data.thumbview = NULL;
+
+    gallery_init(&data);
+
+    if (!gallery_open_uri(&data, (gchar *)uri)) {
+        error = g_strdup(_("Failed to read the gallery"));
+    } else {
+        error = _build(regen, &data);
+    }
+
+    gallery_free(&data);
+
+    return error;
+}
+
+
+
+/*
+ * Make an opened gallery. Galleries with the same output directory are
+ * made one after another, since each make starts by clearing the
+ * staging directory next to it. Returns NULL or the reason of the
+ * failure.
+ */
+static gchar *
+_build(struct regen *regen, struct data *data)
+{
+    const gchar *output_dir;
+    gboolean    ok;
+
+    g_debug("in _build: %s", data->gal->uri);
+
+    if (model_length(data->gal->model) == 0) {
+        return g_strdup(_("No images in the gallery"));
+    } else if (!vfs_is_file(data, data->gal->templ_index) ||
+        !vfs_is_file(data, data->gal->templ_indeximg)) {
+        return g_strdup(_("One of the templates not found"));
+    } else if (data->gal->dir_name[0] == '\0') {
+        return g_strdup(_("Gallery directory not specified"));
+    }
+
+    output_dir = data->gal->output_dir;
+
+    g_mutex_lock(&regen->mutex);
+    while (g_hash_table_contains(regen->building, output_dir)) {
+        g_cond_wait(&regen->built, &regen->mutex);
+    }
+    g_hash_table_add(regen->building, (gpointer)output_dir);
+    g_mutex_unlock(&regen->mutex);
+
+    ok = gallery_build(data);
+
+    g_mutex_lock(&regen->mutex);
+    g_hash_table_remove(regen->building, output_dir);
+    g_cond_broadcast(&regen->built);
+    g_mutex_unlock(&regen->mutex);
+
+    if (!ok)
+        return g_strdup(_("Making the gallery failed"));
+
+    return NULL;
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
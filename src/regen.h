@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#ifndef PWGALLERY_REGEN_H
+#define PWGALLERY_REGEN_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "main.h"
+
+#include <glib.h>
+
+/*
+ * Make the galleries of the given uris without the GUI. Several
+ * galleries are opened and made at once, each with its own gallery
+ * state, and their images share the worker pool. A failing gallery
+ * doesn't stop the others. A summary is printed at the end. Returns
+ * FALSE if any gallery failed.
+ */
+gboolean regen_galleries(struct data *data, GSList *uris);
+
+/*
+ * Make galleries opened already, each in its own copy of the data, like
+ * regen_galleries. The galleries are left open.
+ */
+gboolean regen_opened(struct data *data, GSList *galleries);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "main.h"
+#include "template.h"
+#include "vfs.h"
+
+#include <glib.h>
+#include <string.h>                 /* strlen, strncmp, memcpy */
+
+/* All tags start with this */
+#define TEMPLATE_TAG_START "<<"
+
+/*
+ * Part of a template: either literal text or a slot for a tag value
+ */
+struct template_segment
+{
+    gint           tag;                /* index of the tag or -1 */
+    gsize          start;              /* start of literal text */
+    gsize          len;                /* length of literal text */
+};
+
+struct template
+{
+    gchar          *text;              /* the template text */
+    GArray         *segments;          /* struct template_segment */
+    gsize          literal_len;        /* length of all literal text */
+    gint           n_tags;             /* number of tags */
+};
+
+static void _add_literal(struct template *templ, gsize start, gsize len);
+
+
+
+struct template *
+template_compile(const gchar *text, const gchar **tags)
+{
+    struct template *templ;
+    gsize *tag_lens;
+    gsize literal_start = 0, pos = 0, len;
+    gint i;
+
+    g_assert(text != NULL);
+    g_assert(tags != NULL);
+
+    g_debug("in template_compile");
+
+    templ = g_new0(struct template, 1);
+    templ->text = g_strdup(text);
+    templ->segments = g_array_new(FALSE, FALSE,
+                                  sizeof(struct template_segment));
+
+    while (tags[templ->n_tags] != NULL)
+        templ->n_tags++;
+
+    tag_lens = g_new(gsize, templ->n_tags);
+    for (i = 0; i < templ->n_tags; i++)
+        tag_lens[i] = strlen(tags[i]);
+
+    /* split the text to literals and tags in one pass */
+    len = strlen(text);
+    while (pos < len) {
+        gchar *p;
+        gint tag = -1;
+
+        p = strstr(templ->text + pos, TEMPLATE_TAG_START);
+        if (p == NULL)
+            break;
+        pos = p - templ->text;
+
+        for (i = 0; i < templ->n_tags; i++) {
+            if (strncmp(p, tags[i], tag_lens[i]) == 0) {
+                tag = i;
+                break;
+            }
+        }
+
+        /* not one of ours, keep as it is */
+        if (tag == -1) {
+            ++pos;
+            continue;
+        }
+
+        _add_literal(templ, literal_start, pos - literal_start);
+
+        {
+            struct template_segment seg = { tag, 0, 0 };
+            g_array_append_val(templ->segments, seg);
+        }
+
+        pos += tag_lens[tag];
+        literal_start = pos;
+    }
+    _add_literal(templ, literal_start, len - literal_start);
+
+    g_free(tag_lens);
+
+    return templ;
+}
+
+
+
+struct template *
+template_load(struct data *data, const gchar *uri, const gchar **tags)
+{
+    struct template *templ;
+    guchar *templ_data;
+    gsize templ_len;
+
+    g_assert(data != NULL);
+    g_assert(uri != NULL);
+
+    /* read template to memory */
+    if (!vfs_try_read_file(data, uri, &templ_data, &templ_len))
+        return NULL;
+
+    templ = template_compile((gchar*)templ_data, tags);
+    g_free(templ_data);
+
+    return templ;
+}
+
+
+
+void
+template_render(const struct template *templ, GString *out,
+                const gchar **values)
+{
+    gsize *value_lens;
+    gsize total, old_len;
+    gchar *dst;
+    guint i;
+
+    g_assert(templ != NULL);
+    g_assert(out != NULL);
+    g_assert(values != NULL);
+
+    /* measure the page first to grow the buffer only once */
+    value_lens = g_newa(gsize, templ->n_tags);
+    for (i = 0; i < (guint)templ->n_tags; i++) {
+        value_lens[i] = values[i] != NULL ? strlen(values[i]) : 0;
+    }
+
+    total = templ->literal_len;
+    for (i = 0; i < templ->segments->len; i++) {
+        struct template_segment *seg;
+
+        seg = &g_array_index(templ->segments, struct template_segment, i);
+        if (seg->tag != -1)
+            total += value_lens[seg->tag];
+    }
+
+    old_len = out->len;
+    g_string_set_size(out, old_len + total);
+    dst = out->str + old_len;
+
+    /* copy literals and values in place */
+    for (i = 0; i < templ->segments->len; i++) {
+        struct template_segment *seg;
+
+        seg = &g_array_index(templ->segments, struct template_segment, i);
+        if (seg->tag == -1) {
+            memcpy(dst, templ->text + seg->start, seg->len);
+            dst += seg->len;
+        } else if (value_lens[seg->tag] > 0) {
+            memcpy(dst, values[seg->tag], value_lens[seg->tag]);
+            dst += value_lens[seg->tag];
+        }
+    }
+}
+
+
+
+gint
+template_render_part(const struct template *templ, GString *out,
+                     const gchar **values, guint *position)
+{
+    g_assert(templ != NULL);
+    g_assert(out != NULL);
+    g_assert(values != NULL);
+    g_assert(position != NULL);
+
+    while (*position < templ->segments->len) {
+        struct template_segment *seg;
+
+        seg = &g_array_index(templ->segments, struct template_segment,
+                             *position);
+        (*position)++;
+
+        if (seg->tag == -1) {
+            g_string_append_len(out, templ->text + seg->start, seg->len);
+        } else if (values[seg->tag] == NULL) {
+            return seg->tag;
+        } else {
+            g_string_append(out, values[seg->tag]);
+        }
+    }
+
+    return -1;
+}
+
+
+
+void
+template_free(struct template *templ)
+{
+    if (templ == NULL)
+        return;
+
+    g_free(templ->text);
+    g_array_free(templ->segments, TRUE);
+    g_free(templ);
+}
+
+
+
+/**********************
+ *                    *
+ * Static functions   *
+ *                    *
+ **********************/
+
+
+/*
+ * Add a literal segment, if not empty
+ */
+static void
+_add_literal(struct template *templ, gsize start, gsize len)
+{
+    struct template_segment seg;
+
+    if (len == 0)
+        return;
+
+    seg.tag = -1;
+    seg.start = start;
+    seg.len = len;
+    g_array_append_val(templ->segments, seg);
+
+    templ->literal_len += len;
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
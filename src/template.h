@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#ifndef PWGALLERY_TEMPLATE_H
+#define PWGALLERY_TEMPLATE_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "main.h"
+
+#include <glib.h>
+
+/*
+ * A page template compiled to literal text and tag slots. Compiled
+ * templates are not modified while rendering, so the same template
+ * can be rendered in several threads at the same time.
+ */
+struct template;
+
+/*
+ * Compile a template. Tags is a NULL terminated list of the tags to
+ * be replaced, other text is kept as it is.
+ */
+struct template *template_compile(const gchar *text, const gchar **tags);
+
+/*
+ * Read and compile a template file. Returns NULL if it can't be read.
+ */
+struct template *template_load(struct data *data, const gchar *uri,
+                               const gchar **tags);
+
+/*
+ * Render the template to the end of out. Values are given in the
+ * order of the tags the template was compiled with.
+ */
+void template_render(const struct template *templ, GString *out,
+                     const gchar **values);
+
+/*
+ * Render the template to the end of out until a tag whose value is
+ * NULL. Returns that tag and keeps the place in position, so that the
+ * caller can write the tag's content itself and continue rendering.
+ * Position must be 0 on the first call. Returns -1 when done.
+ */
+gint template_render_part(const struct template *templ, GString *out,
+                          const gchar **values, guint *position);
+
+/*
+ * Free a compiled template
+ */
+void template_free(struct template *templ);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
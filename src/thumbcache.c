@@ -0,0 +1,473 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "main.h"
+#include "thumbcache.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>             /* g_stat, g_unlink, g_utime */
+#include <gtk/gtk.h>
+#include <stdlib.h>                  /* qsort */
+
+/* Directory of the thumbnails under PWGALLERY_CACHE_DIR */
+#define THUMBCACHE_SUBDIR                "thumbnails"
+/* Directory of the slide show frames under the same */
+#define THUMBCACHE_FRAME_SUBDIR          "frames"
+/* JPEG quality of the saved slide show frames */
+#define THUMBCACHE_FRAME_QUALITY         "90"
+/* Size of the thumbnails and the frames kept, in bytes */
+#define THUMBCACHE_MAX_SIZE              (512 * 1024 * 1024)
+/* Size the cache is pruned to when over THUMBCACHE_MAX_SIZE */
+#define THUMBCACHE_PRUNE_SIZE            (THUMBCACHE_MAX_SIZE / 4 * 3)
+/* Files stored between checking the size of the cache */
+#define THUMBCACHE_PRUNE_INTERVAL        64
+
+/* A file of the cache, when pruning */
+struct cache_file {
+    gchar  *path;
+    gint64 size;
+    time_t used;                       /* newer of atime and mtime */
+};
+
+/* files stored in this process, to check the size now and then */
+static gint _stores;
+/* set while pruning, so that only one thread prunes at a time */
+static gint _pruning;
+
+static gchar *_dir(const gchar *subdir);
+static gchar *_path(const gchar *subdir, const gchar *key, const gchar *ext);
+static gchar *_thumb_path(struct image *img);
+static gchar *_frame_path(struct image *img, gint screen_w, gint screen_h);
+static gboolean _mkdir(const gchar *subdir);
+static void _touch(const gchar *path);
+static void _stored(void);
+static gpointer _prune_thread(gpointer user_data);
+static void _prune(void);
+static void _list(const gchar *subdir, GArray *files, gint64 *total);
+static gint _compare_used(gconstpointer a, gconstpointer b);
+
+
+
+GdkPixbuf *
+thumbcache_lookup(struct data *data, struct image *img)
+{
+    GdkPixbuf *pixbuf;
+    gchar     *path;
+
+    g_assert(data != NULL);
+    g_assert(img != NULL);
+
+    /* a changed original can't be noticed without the size and mtime */
+    if (img->file_size == -1 || img->mtime == -1)
+        return NULL;
+
+    path = _thumb_path(img);
+    pixbuf = gdk_pixbuf_new_from_file(path, NULL);
+    if (pixbuf != NULL)
+        _touch(path);
+
+    g_debug("in %s: %s: %s", __func__, img->uri,
+            pixbuf != NULL ? "found" : "not found");
+
+    g_free(path);
+
+    return pixbuf;
+}
+
+
+
+void
+thumbcache_store(struct data *data, struct image *img, GdkPixbuf *pixbuf)
+{
+    gchar  *path, *buf;
+    gsize  len;
+    GError *error = NULL;
+
+    g_assert(data != NULL);
+    g_assert(img != NULL);
+    g_assert(pixbuf != NULL);
+
+    g_debug("in %s: %s", __func__, img->uri);
+
+    if (img->file_size == -1 || img->mtime == -1)
+        return;
+
+    if (!_mkdir(THUMBCACHE_SUBDIR))
+        return;
+
+    if (!gdk_pixbuf_save_to_buffer(pixbuf, &buf, &len, "png", &error,
+                                   NULL)) {
+        g_warning("Failed to save the thumbnail of %s: %s", img->uri,
+                  error->message);
+        g_error_free(error);
+        return;
+    }
+
+    /* written to a temporary file and renamed, so that a partial
+     * thumbnail is never read */
+    path = _thumb_path(img);
+    if (!g_file_set_contents(path, buf, len, &error)) {
+        g_warning("Failed to save the thumbnail of %s: %s", img->uri,
+                  error->message);
+        g_error_free(error);
+    } else {
+        _stored();
+    }
+
+    g_free(path);
+    g_free(buf);
+}
+
+
+
+GdkPixbuf *
+thumbcache_lookup_frame(struct data *data, struct image *img,
+                        gint screen_w, gint screen_h)
+{
+    GdkPixbuf *pixbuf;
+    gchar     *path;
+
+    g_assert(data != NULL);
+    g_assert(img != NULL);
+
+    if (img->file_size == -1 || img->mtime == -1)
+        return NULL;
+
+    path = _frame_path(img, screen_w, screen_h);
+    pixbuf = gdk_pixbuf_new_from_file(path, NULL);
+    if (pixbuf != NULL)
+        _touch(path);
+
+    g_debug("in %s: %s: %s", __func__, img->uri,
+            pixbuf != NULL ? "found" : "not found");
+
+    g_free(path);
+
+    return pixbuf;
+}
+
+
+
+void
+thumbcache_store_frame(struct data *data, struct image *img,
+                       gint screen_w, gint screen_h, GdkPixbuf *pixbuf)
+{
+    gchar  *path, *buf;
+    gsize  len;
+    GError *error = NULL;
+
+    g_assert(data != NULL);
+    g_assert(img != NULL);
+    g_assert(pixbuf != NULL);
+
+    g_debug("in %s: %s", __func__, img->uri);
+
+    /* frames are saved as JPEG, that has no alpha channel */
+    if (img->file_size == -1 || img->mtime == -1 ||
+        gdk_pixbuf_get_has_alpha(pixbuf))
+        return;
+
+    if (!_mkdir(THUMBCACHE_FRAME_SUBDIR))
+        return;
+
+    if (!gdk_pixbuf_save_to_buffer(pixbuf, &buf, &len, "jpeg", &error,
+                                   "quality", THUMBCACHE_FRAME_QUALITY,
+                                   NULL)) {
+        g_warning("Failed to save the slide show frame of %s: %s",
+                  img->uri, error->message);
+        g_error_free(error);
+        return;
+    }
+
+    path = _frame_path(img, screen_w, screen_h);
+    if (!g_file_set_contents(path, buf, len, &error)) {
+        g_warning("Failed to save the slide show frame of %s: %s",
+                  img->uri, error->message);
+        g_error_free(error);
+    } else {
+        _stored();
+    }
+
+    g_free(path);
+    g_free(buf);
+}
+
+
+
+/**********************
+ *                    *
+ * Static functions   *
+ *                    *
+ **********************/
+
+
+/*
+ * Get a directory of the cache
+ */
+static gchar *
+_dir(const gchar *subdir)
+{
+    return g_build_filename(g_get_user_cache_dir(), PWGALLERY_CACHE_DIR,
+                            subdir, NULL);
+}
+
+
+
+/*
+ * Create a directory of the cache, if it doesn't exist yet
+ */
+static gboolean
+_mkdir(const gchar *subdir)
+{
+    gchar *dir;
+
+    dir = _dir(subdir);
+    if (g_mkdir_with_parents(dir, 0700) != 0) {
+        g_warning("Failed to create the cache directory %s", dir);
+        g_free(dir);
+        return FALSE;
+    }
+    g_free(dir);
+
+    return TRUE;
+}
+
+
+
+/*
+ * Get a file in a directory of the cache. The name is a checksum of
+ * the key.
+ */
+static gchar *
+_path(const gchar *subdir, const gchar *key, const gchar *ext)
+{
+    gchar *sum, *name, *dir, *path;
+
+    sum = g_compute_checksum_for_string(G_CHECKSUM_MD5, key, -1);
+    name = g_strdup_printf("%s.%s", sum, ext);
+
+    dir = _dir(subdir);
+    path = g_build_filename(dir, name, NULL);
+
+    g_free(dir);
+    g_free(name);
+    g_free(sum);
+
+    return path;
+}
+
+
+
+/*
+ * Get the file of the thumbnail of the image, keyed by everything the
+ * thumbnail depends on
+ */
+static gchar *
+_thumb_path(struct image *img)
+{
+    gchar *key, *path;
+
+    key = g_strdup_printf("%s\n%" G_GINT64_FORMAT "\n%ld\n%d\n%d",
+                          img->uri, (gint64)img->file_size, img->mtime,
+                          img->rotate, PWGALLERY_THUMB_W);
+    path = _path(THUMBCACHE_SUBDIR, key, "png");
+    g_free(key);
+
+    return path;
+}
+
+
+
+/*
+ * Get the file of the slide show frame of the image on a screen of
+ * the given size
+ */
+static gchar *
+_frame_path(struct image *img, gint screen_w, gint screen_h)
+{
+    gchar *key, *path;
+
+    key = g_strdup_printf("%s\n%" G_GINT64_FORMAT "\n%ld\n%d\n%dx%d",
+                          img->uri, (gint64)img->file_size, img->mtime,
+                          img->rotate, screen_w, screen_h);
+    path = _path(THUMBCACHE_FRAME_SUBDIR, key, "jpg");
+    g_free(key);
+
+    return path;
+}
+
+
+
+/*
+ * Mark a file of the cache used now. The access time alone is not
+ * kept up to date on filesystems mounted with noatime.
+ */
+static void
+_touch(const gchar *path)
+{
+    if (g_utime(path, NULL) != 0)
+        g_debug("in %s: failed to touch %s", __func__, path);
+}
+
+
+
+/*
+ * Count a stored file and prune the cache every
+ * THUMBCACHE_PRUNE_INTERVAL files, beginning from the first one. The
+ * cache is pruned in a thread of its own, since listing it can take a
+ * while and the files are stored from the main loop too.
+ */
+static void
+_stored(void)
+{
+    if (g_atomic_int_add(&_stores, 1) % THUMBCACHE_PRUNE_INTERVAL != 0)
+        return;
+
+    /* another thread is pruning already */
+    if (!g_atomic_int_compare_and_exchange(&_pruning, 0, 1))
+        return;
+
+    g_thread_unref(g_thread_new("thumbcache_prune", _prune_thread, NULL));
+}
+
+
+
+/*
+ * Thread pruning the cache once
+ */
+static gpointer
+_prune_thread(gpointer user_data)
+{
+    _prune();
+
+    g_atomic_int_set(&_pruning, 0);
+
+    return NULL;
+}
+
+
+
+/*
+ * Remove the least recently used thumbnails and frames while the cache
+ * is larger than THUMBCACHE_MAX_SIZE, down to THUMBCACHE_PRUNE_SIZE so
+ * that the next stores don't prune again. The manifests of the made
+ * galleries are never removed.
+ */
+static void
+_prune(void)
+{
+    GArray *files;
+    gint64 total = 0;
+    guint  i;
+
+    files = g_array_new(FALSE, FALSE, sizeof(struct cache_file));
+
+    _list(THUMBCACHE_SUBDIR, files, &total);
+    _list(THUMBCACHE_FRAME_SUBDIR, files, &total);
+
+    g_debug("in %s: %u files, %" G_GINT64_FORMAT " bytes", __func__,
+            files->len, total);
+
+    if (total > THUMBCACHE_MAX_SIZE) {
+        qsort(files->data, files->len, sizeof(struct cache_file),
+              _compare_used);
+
+        for (i = 0; i < files->len && total > THUMBCACHE_PRUNE_SIZE; i++) {
+            struct cache_file *file;
+
+            file = &g_array_index(files, struct cache_file, i);
+            if (g_unlink(file->path) == 0)
+                total -= file->size;
+        }
+    }
+
+    for (i = 0; i < files->len; i++) {
+        g_free(g_array_index(files, struct cache_file, i).path);
+    }
+    g_array_free(files, TRUE);
+}
+
+
+
+/*
+ * Add the files of a directory of the cache to files and their sizes
+ * to total
+ */
+static void
+_list(const gchar *subdir, GArray *files, gint64 *total)
+{
+    const gchar *name;
+    gchar       *dir;
+    GDir        *gdir;
+
+    dir = _dir(subdir);
+    gdir = g_dir_open(dir, 0, NULL);
+    if (gdir == NULL) {
+        g_free(dir);
+        return;
+    }
+
+    while ((name = g_dir_read_name(gdir)) != NULL) {
+        struct cache_file file;
+        GStatBuf          st;
+
+        file.path = g_build_filename(dir, name, NULL);
+        if (g_stat(file.path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            g_free(file.path);
+            continue;
+        }
+        file.size = st.st_size;
+        file.used = MAX(st.st_atime, st.st_mtime);
+
+        g_array_append_val(files, file);
+        *total += file.size;
+    }
+
+    g_dir_close(gdir);
+    g_free(dir);
+}
+
+
+
+/*
+ * Order the files of the cache from the least recently used
+ */
+static gint
+_compare_used(gconstpointer a, gconstpointer b)
+{
+    const struct cache_file *fa = a;
+    const struct cache_file *fb = b;
+
+    if (fa->used != fb->used)
+        return fa->used < fb->used ? -1 : 1;
+    return 0;
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
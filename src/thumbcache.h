@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#ifndef PWGALLERY_THUMBCACHE_H
+#define PWGALLERY_THUMBCACHE_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "main.h"
+
+#include <glib.h>
+#include <gtk/gtk.h>
+
+/*
+ * The thumbnails of the thumbnail list are saved under the user's
+ * cache directory, so that they are not decoded again from the
+ * originals when a gallery is opened the next time. A thumbnail is
+ * found by the uri, size, mtime and rotation of the image, so a
+ * changed or rotated image gets a new one.
+ */
+
+/*
+ * Get the saved thumbnail of the image, or NULL if not found
+ */
+GdkPixbuf *thumbcache_lookup(struct data *data, struct image *img);
+
+/*
+ * Save a thumbnail of the image. Can be called in the worker threads.
+ */
+void thumbcache_store(struct data *data, struct image *img,
+                      GdkPixbuf *pixbuf);
+
+/*
+ * The slide show frames, scaled to the screen and rotated, are saved
+ * in the same cache. They are found also by the screen size.
+ */
+
+/*
+ * Get the saved slide show frame of the image, or NULL if not found
+ */
+GdkPixbuf *thumbcache_lookup_frame(struct data *data, struct image *img,
+                                   gint screen_w, gint screen_h);
+
+/*
+ * Save a slide show frame of the image. Can be called in any thread.
+ */
+void thumbcache_store_frame(struct data *data, struct image *img,
+                            gint screen_w, gint screen_h, GdkPixbuf *pixbuf);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
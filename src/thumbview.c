@@ -0,0 +1,765 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "main.h"
+#include "thumbview.h"
+#include "image.h"
+#include "gallery.h"
+#include "model.h"
+#include "pool.h"
+
+#include <glib.h>
+#include <gtk/gtk.h>
+
+/* Columns of the list store */
+enum {
+    THUMBVIEW_COLUMN_IMAGE,            /* struct image */
+    THUMBVIEW_N_COLUMNS
+};
+
+/* Size of a row in the list */
+#define THUMBVIEW_ROW_SIZE \
+    (PWGALLERY_THUMB_W + 2 * PWGALLERY_THUMBNAIL_BORDER_WIDTH)
+
+struct thumb
+{
+    struct image   *image;             /* NULL if forgotten while loading */
+    GdkPixbuf      *pixbuf;            /* NULL until decoded or if failed */
+    GList          *link;              /* link in the lru or pending queue */
+    gboolean       loading;            /* being decoded in the pool */
+};
+
+struct thumbview
+{
+    GtkTreeView    *view;
+    GtkListStore   *store;
+    GHashTable     *thumbs;            /* struct image -> struct thumb */
+    GQueue         lru;                /* decoded, most recently shown first */
+    GQueue         pending;            /* waiting to be decoded */
+    gsize          bytes;              /* memory used by the decoded ones */
+    guint          idle_id;            /* idle source starting jobs or 0 */
+    gint           loading;            /* thumbnails being decoded */
+    gboolean       updating;           /* selection changed by us */
+    struct pool_batch *batch;          /* decoding jobs, once started */
+    GMutex         mutex;              /* protects the fields below */
+    GQueue         loaded;             /* finished struct thumb_job */
+    guint          loaded_id;          /* idle source taking them or 0 */
+};
+
+/* A thumbnail decoded in a worker from a copy of the image */
+struct thumb_job
+{
+    struct thumbview *tv;
+    struct data    *data;
+    struct thumb   *thumb;             /* thumbnail being loaded */
+    struct image   *image;             /* copy of the image to decode */
+    GdkPixbuf      *pixbuf;            /* result, NULL if failed */
+};
+
+static void _cell_data(GtkTreeViewColumn *column, GtkCellRenderer *renderer,
+                       GtkTreeModel *model, GtkTreeIter *iter,
+                       gpointer user_data);
+static gboolean _load_pending(gpointer user_data);
+static gboolean _load_job(gpointer user_data);
+static gboolean _loaded(gpointer user_data);
+static gboolean _get_iter(struct thumbview *tv, gint index,
+                          GtkTreeIter *iter);
+static void _evict(struct data *data);
+static gboolean _is_visible(struct thumbview *tv, struct image *img);
+static void _row_changed(struct thumbview *tv, struct image *img);
+static void _thumb_free(struct thumbview *tv, struct thumb *thumb);
+static void _selection_changed(GtkTreeSelection *selection,
+                               gpointer user_data);
+static void _row_activated(GtkTreeView *view, GtkTreePath *path,
+                           GtkTreeViewColumn *column, gpointer user_data);
+
+
+
+void
+thumbview_init(struct data *data)
+{
+    struct thumbview  *tv;
+    GtkTreeViewColumn *column;
+    GtkCellRenderer   *renderer;
+    GtkTreeSelection  *selection;
+    GdkColor          color;
+
+    g_assert(data != NULL);
+
+    if (!data->use_gui) {
+        return;
+    }
+
+    g_debug("in thumbview_init");
+
+    tv = g_new0(struct thumbview, 1);
+    tv->view = GTK_TREE_VIEW(gtk_builder_get_object(data->builder,
+                                                    "treeview_thumbs"));
+    g_assert(tv->view != NULL);
+
+    tv->store = gtk_list_store_new(THUMBVIEW_N_COLUMNS, G_TYPE_POINTER);
+    tv->thumbs = g_hash_table_new(g_direct_hash, g_direct_equal);
+    g_queue_init(&tv->lru);
+    g_queue_init(&tv->pending);
+    g_queue_init(&tv->loaded);
+    g_mutex_init(&tv->mutex);
+
+    color.pixel = 0;
+    color.red   = 10000;
+    color.green = 20000;
+    color.blue  = 50000;
+
+    /* All rows have the same size, so only the visible rows need to
+     * be looked at when drawing or scrolling. */
+    renderer = gtk_cell_renderer_pixbuf_new();
+    gtk_cell_renderer_set_fixed_size(renderer, THUMBVIEW_ROW_SIZE,
+                                     THUMBVIEW_ROW_SIZE);
+    g_object_set(renderer, "cell-background-gdk", &color, NULL);
+
+    column = gtk_tree_view_column_new();
+    gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+    gtk_tree_view_column_set_fixed_width(column, THUMBVIEW_ROW_SIZE);
+    gtk_tree_view_column_pack_start(column, renderer, TRUE);
+    gtk_tree_view_column_set_cell_data_func(column, renderer,
+                                            _cell_data, data, NULL);
+    gtk_tree_view_append_column(tv->view, column);
+
+    gtk_tree_view_set_fixed_height_mode(tv->view, TRUE);
+    gtk_tree_view_set_model(tv->view, GTK_TREE_MODEL(tv->store));
+
+    selection = gtk_tree_view_get_selection(tv->view);
+    gtk_tree_selection_set_mode(selection, GTK_SELECTION_SINGLE);
+    g_signal_connect(selection, "changed",
+                     G_CALLBACK(_selection_changed), data);
+    g_signal_connect(tv->view, "row-activated",
+                     G_CALLBACK(_row_activated), data);
+
+    data->thumbview = tv;
+}
+
+
+
+void
+thumbview_free(struct data *data)
+{
+    struct thumbview *tv;
+
+    g_assert(data != NULL);
+
+    tv = data->thumbview;
+    if (tv == NULL) {
+        return;
+    }
+
+    g_debug("in thumbview_free");
+
+    /* drop the thumbnails still being decoded, not shown anymore */
+    if (tv->batch != NULL) {
+        pool_batch_wait(tv->batch, NULL, NULL);
+        pool_batch_free(tv->batch);
+    }
+    if (tv->loaded_id != 0) {
+        g_source_remove(tv->loaded_id);
+    }
+    while (!g_queue_is_empty(&tv->loaded)) {
+        struct thumb_job *job = g_queue_pop_head(&tv->loaded);
+
+        job->thumb->loading = FALSE;
+        if (job->thumb->image == NULL)
+            g_free(job->thumb);
+        if (job->pixbuf != NULL)
+            g_object_unref(job->pixbuf);
+        image_free(job->image);
+        g_free(job);
+    }
+
+    thumbview_clear(data);
+
+    if (tv->idle_id != 0) {
+        g_source_remove(tv->idle_id);
+    }
+    g_mutex_clear(&tv->mutex);
+    g_hash_table_destroy(tv->thumbs);
+    g_object_unref(tv->store);
+    g_free(tv);
+
+    data->thumbview = NULL;
+}
+
+
+
+void
+thumbview_update(struct data *data)
+{
+    struct thumbview *tv;
+    GtkTreePath      *path;
+
+    g_assert(data != NULL);
+
+    if (!data->use_gui) {
+        return;
+    }
+
+    tv = data->thumbview;
+    g_assert(tv != NULL);
+
+    g_debug("in thumbview_update");
+
+    tv->updating = TRUE;
+
+    /* select and scroll to the current image */
+    if (data->current_img != NULL) {
+        path = gtk_tree_path_new_from_indices(
+            model_index(data->gal->model, data->current_img), -1);
+        gtk_tree_view_set_cursor(tv->view, path, NULL, FALSE);
+        gtk_tree_view_scroll_to_cell(tv->view, path, NULL, FALSE, 0, 0);
+        gtk_tree_path_free(path);
+    }
+
+    tv->updating = FALSE;
+}
+
+
+
+void
+thumbview_append(struct data *data, struct image *img)
+{
+    g_assert(data != NULL);
+    g_assert(img != NULL);
+
+    if (!data->use_gui) {
+        return;
+    }
+
+    g_assert(data->thumbview != NULL);
+
+    gtk_list_store_insert_with_values(data->thumbview->store, NULL, -1,
+                                      THUMBVIEW_COLUMN_IMAGE, img, -1);
+}
+
+
+
+void
+thumbview_move(struct data *data, struct image *img, gint from)
+{
+    struct thumbview *tv;
+    GtkTreeIter      iter, position;
+
+    g_assert(data != NULL);
+    g_assert(img != NULL);
+
+    if (!data->use_gui) {
+        return;
+    }
+
+    tv = data->thumbview;
+    g_assert(tv != NULL);
+
+    if (from == img->index ||
+        !_get_iter(tv, from, &iter) || !_get_iter(tv, img->index, &position))
+        return;
+
+    /* the rows in between shift by one, like in the gallery */
+    tv->updating = TRUE;
+    if (img->index < from)
+        gtk_list_store_move_before(tv->store, &iter, &position);
+    else
+        gtk_list_store_move_after(tv->store, &iter, &position);
+    tv->updating = FALSE;
+}
+
+
+
+void
+thumbview_reorder(struct data *data)
+{
+    struct thumbview *tv;
+    struct image     *img;
+    GtkTreeIter      iter;
+    gint             *new_order;
+    gint             n, i = 0;
+
+    g_assert(data != NULL);
+
+    if (!data->use_gui) {
+        return;
+    }
+
+    tv = data->thumbview;
+    g_assert(tv != NULL);
+
+    g_debug("in thumbview_reorder");
+
+    n = model_length(data->gal->model);
+    g_assert(gtk_tree_model_iter_n_children(GTK_TREE_MODEL(tv->store),
+                                            NULL) == n);
+    if (n == 0)
+        return;
+
+    /* the rows keep their images, only their places change */
+    new_order = g_new(gint, n);
+    gtk_tree_model_get_iter_first(GTK_TREE_MODEL(tv->store), &iter);
+    do {
+        gtk_tree_model_get(GTK_TREE_MODEL(tv->store), &iter,
+                           THUMBVIEW_COLUMN_IMAGE, &img, -1);
+        new_order[img->index] = i++;
+    } while (gtk_tree_model_iter_next(GTK_TREE_MODEL(tv->store), &iter));
+
+    tv->updating = TRUE;
+    gtk_list_store_reorder(tv->store, new_order);
+    tv->updating = FALSE;
+
+    g_free(new_order);
+}
+
+
+
+void
+thumbview_forget(struct data *data, struct image *img)
+{
+    struct thumbview *tv;
+    struct thumb     *thumb;
+    GtkTreeIter      iter;
+
+    g_assert(data != NULL);
+    g_assert(img != NULL);
+
+    if (!data->use_gui) {
+        return;
+    }
+
+    tv = data->thumbview;
+    g_assert(tv != NULL);
+
+    if (_get_iter(tv, img->index, &iter)) {
+        tv->updating = TRUE;
+        gtk_list_store_remove(tv->store, &iter);
+        tv->updating = FALSE;
+    }
+
+    thumb = g_hash_table_lookup(tv->thumbs, img);
+    if (thumb != NULL) {
+        g_hash_table_remove(tv->thumbs, img);
+        _thumb_free(tv, thumb);
+    }
+}
+
+
+
+void
+thumbview_clear(struct data *data)
+{
+    struct thumbview *tv;
+    GHashTableIter   iter;
+    gpointer         value;
+
+    g_assert(data != NULL);
+
+    if (!data->use_gui) {
+        return;
+    }
+
+    tv = data->thumbview;
+    g_assert(tv != NULL);
+
+    g_debug("in thumbview_clear");
+
+    tv->updating = TRUE;
+    gtk_list_store_clear(tv->store);
+    tv->updating = FALSE;
+
+    g_hash_table_iter_init(&iter, tv->thumbs);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        _thumb_free(tv, value);
+    }
+    g_hash_table_remove_all(tv->thumbs);
+
+    g_assert(tv->bytes == 0);
+}
+
+
+
+/**********************
+ *                    *
+ * Static functions   *
+ *                    *
+ **********************/
+
+
+/*
+ * Set the thumbnail of a row being drawn. A thumbnail not decoded yet
+ * is queued for decoding and the row is drawn empty until then.
+ */
+static void
+_cell_data(GtkTreeViewColumn *column, GtkCellRenderer *renderer,
+           GtkTreeModel *model, GtkTreeIter *iter, gpointer user_data)
+{
+    struct data      *data;
+    struct thumbview *tv;
+    struct thumb     *thumb;
+    struct image     *img;
+
+    g_assert(user_data != NULL);
+
+    data = user_data;
+    tv = data->thumbview;
+
+    gtk_tree_model_get(model, iter, THUMBVIEW_COLUMN_IMAGE, &img, -1);
+
+    thumb = g_hash_table_lookup(tv->thumbs, img);
+    if (thumb == NULL) {
+        thumb = g_new0(struct thumb, 1);
+        thumb->image = img;
+        g_hash_table_insert(tv->thumbs, img, thumb);
+
+        g_queue_push_tail(&tv->pending, thumb);
+        thumb->link = g_queue_peek_tail_link(&tv->pending);
+
+        /* decode between redraws, not while drawing */
+        if (tv->idle_id == 0) {
+            tv->idle_id = g_idle_add(_load_pending, data);
+        }
+    } else if (thumb->pixbuf != NULL) {
+        /* shown now, move to the front of the lru */
+        g_queue_unlink(&tv->lru, thumb->link);
+        g_queue_push_head_link(&tv->lru, thumb->link);
+    }
+
+    g_object_set(renderer, "pixbuf", thumb->pixbuf, NULL);
+}
+
+
+
+/*
+ * Start decoding the pending thumbnails on the worker pool, no more at
+ * once than there are workers, so that the rows scrolled away before
+ * their turn are skipped
+ */
+static gboolean
+_load_pending(gpointer user_data)
+{
+    struct data      *data;
+    struct thumbview *tv;
+    struct thumb     *thumb;
+    gint             n_workers;
+
+    g_assert(user_data != NULL);
+
+    data = user_data;
+    tv = data->thumbview;
+
+    /* the pool is set up from the settings loaded after the window */
+    if (tv->batch == NULL)
+        tv->batch = pool_batch_new(gallery_get_pool(data));
+    n_workers = pool_get_n_workers(gallery_get_pool(data));
+
+    while (tv->loading < n_workers &&
+           (thumb = g_queue_pop_head(&tv->pending)) != NULL) {
+        struct thumb_job *job;
+
+        thumb->link = NULL;
+
+        /* scrolled away while waiting, decoded again when shown */
+        if (!_is_visible(tv, thumb->image)) {
+            g_hash_table_remove(tv->thumbs, thumb->image);
+            _thumb_free(tv, thumb);
+            continue;
+        }
+
+        /* the job has a copy, the image may change meanwhile */
+        job = g_new0(struct thumb_job, 1);
+        job->tv = tv;
+        job->data = data;
+        job->thumb = thumb;
+        job->image = image_copy(data, thumb->image);
+
+        thumb->loading = TRUE;
+        tv->loading++;
+        pool_push(tv->batch, _load_job, job);
+    }
+
+    tv->idle_id = 0;
+    return FALSE;
+}
+
+
+
+/*
+ * Decode a thumbnail in a worker thread and hand it to the main loop
+ */
+static gboolean
+_load_job(gpointer user_data)
+{
+    struct thumb_job *job;
+    struct thumbview *tv;
+
+    g_assert(user_data != NULL);
+
+    job = user_data;
+    tv = job->tv;
+
+    job->pixbuf = image_load_thumbnail(job->data, job->image);
+
+    g_mutex_lock(&tv->mutex);
+    g_queue_push_tail(&tv->loaded, job);
+    if (tv->loaded_id == 0) {
+        tv->loaded_id = g_idle_add(_loaded, job->data);
+    }
+    g_mutex_unlock(&tv->mutex);
+
+    return TRUE;
+}
+
+
+
+/*
+ * Show the thumbnails decoded in the workers and start the next ones
+ */
+static gboolean
+_loaded(gpointer user_data)
+{
+    struct data      *data;
+    struct thumbview *tv;
+    struct thumb_job *job;
+    GQueue           loaded;
+
+    g_assert(user_data != NULL);
+
+    data = user_data;
+    tv = data->thumbview;
+
+    g_mutex_lock(&tv->mutex);
+    loaded = tv->loaded;
+    g_queue_init(&tv->loaded);
+    tv->loaded_id = 0;
+    g_mutex_unlock(&tv->mutex);
+
+    while ((job = g_queue_pop_head(&loaded)) != NULL) {
+        struct thumb *thumb = job->thumb;
+
+        thumb->loading = FALSE;
+        tv->loading--;
+
+        if (thumb->image == NULL) {
+            /* the image was removed meanwhile */
+            if (job->pixbuf != NULL)
+                g_object_unref(job->pixbuf);
+            g_free(thumb);
+        } else if (job->pixbuf != NULL) {
+            thumb->pixbuf = job->pixbuf;
+            g_queue_push_head(&tv->lru, thumb);
+            thumb->link = g_queue_peek_head_link(&tv->lru);
+            tv->bytes += gdk_pixbuf_get_rowstride(thumb->pixbuf) *
+                gdk_pixbuf_get_height(thumb->pixbuf);
+            _row_changed(tv, thumb->image);
+        }
+        /* a failed thumbnail is kept empty and not tried again */
+
+        image_free(job->image);
+        g_free(job);
+    }
+
+    _evict(data);
+
+    if (!g_queue_is_empty(&tv->pending) && tv->idle_id == 0) {
+        tv->idle_id = g_idle_add(_load_pending, data);
+    }
+
+    return FALSE;
+}
+
+
+
+/*
+ * Drop the least recently shown thumbnails until they fit in the
+ * memory budget. The thumbnails on the screen are always kept.
+ */
+static void
+_evict(struct data *data)
+{
+    struct thumbview *tv;
+    struct thumb     *thumb;
+    gsize            budget;
+
+    tv = data->thumbview;
+    budget = (gsize)MAX(data->thumb_memory, 0) * 1024 * 1024;
+
+    while (tv->bytes > budget) {
+        thumb = g_queue_peek_tail(&tv->lru);
+        if (thumb == NULL || _is_visible(tv, thumb->image))
+            break;
+
+        g_debug("in %s: dropping %s", __func__, thumb->image->uri);
+
+        g_hash_table_remove(tv->thumbs, thumb->image);
+        _thumb_free(tv, thumb);
+    }
+}
+
+
+
+/*
+ * Check if the row of the image is on the screen
+ */
+static gboolean
+_is_visible(struct thumbview *tv, struct image *img)
+{
+    GtkTreePath *start, *end;
+    gboolean    visible;
+
+    if (!gtk_tree_view_get_visible_range(tv->view, &start, &end))
+        return FALSE;
+
+    visible = img->index >= gtk_tree_path_get_indices(start)[0] &&
+        img->index <= gtk_tree_path_get_indices(end)[0];
+
+    gtk_tree_path_free(start);
+    gtk_tree_path_free(end);
+
+    return visible;
+}
+
+
+
+/*
+ * Redraw the row of the image. The rows are in the gallery order.
+ */
+static void
+_row_changed(struct thumbview *tv, struct image *img)
+{
+    GtkTreePath *path;
+    GtkTreeIter iter;
+
+    path = gtk_tree_path_new_from_indices(img->index, -1);
+    if (gtk_tree_model_get_iter(GTK_TREE_MODEL(tv->store), &iter, path)) {
+        gtk_tree_model_row_changed(GTK_TREE_MODEL(tv->store), path, &iter);
+    }
+    gtk_tree_path_free(path);
+}
+
+
+
+/*
+ * Get the row at the index. Returns FALSE if there is no such row.
+ */
+static gboolean
+_get_iter(struct thumbview *tv, gint index, GtkTreeIter *iter)
+{
+    if (index < 0)
+        return FALSE;
+
+    return gtk_tree_model_iter_nth_child(GTK_TREE_MODEL(tv->store), iter,
+                                         NULL, index);
+}
+
+
+
+/*
+ * Free a thumbnail and remove it from the queue it is in. It must be
+ * removed from the hash table by the caller. A thumbnail being decoded
+ * is freed when the decoding is finished.
+ */
+static void
+_thumb_free(struct thumbview *tv, struct thumb *thumb)
+{
+    if (thumb->loading) {
+        thumb->image = NULL;
+        return;
+    }
+
+    if (thumb->pixbuf != NULL) {
+        tv->bytes -= gdk_pixbuf_get_rowstride(thumb->pixbuf) *
+            gdk_pixbuf_get_height(thumb->pixbuf);
+        g_queue_delete_link(&tv->lru, thumb->link);
+        g_object_unref(thumb->pixbuf);
+    } else if (thumb->link != NULL) {
+        g_queue_delete_link(&tv->pending, thumb->link);
+    }
+
+    g_free(thumb);
+}
+
+
+
+/*
+ * User selected an image from the list
+ */
+static void
+_selection_changed(GtkTreeSelection *selection, gpointer user_data)
+{
+    struct data      *data;
+    struct image     *img;
+    GtkTreeModel     *model;
+    GtkTreeIter      iter;
+
+    g_assert(user_data != NULL);
+
+    data = user_data;
+
+    /* ignore the selection done by thumbview_update */
+    if (data->thumbview->updating)
+        return;
+
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter))
+        return;
+
+    gtk_tree_model_get(model, &iter, THUMBVIEW_COLUMN_IMAGE, &img, -1);
+
+    gallery_image_selected(data, img);
+}
+
+
+
+/*
+ * User double clicked an image or pressed enter on it
+ */
+static void
+_row_activated(GtkTreeView *view, GtkTreePath *path,
+               GtkTreeViewColumn *column, gpointer user_data)
+{
+    struct data      *data;
+    struct image     *img;
+    GtkTreeIter      iter;
+
+    g_assert(user_data != NULL);
+
+    data = user_data;
+
+    if (!gtk_tree_model_get_iter(GTK_TREE_MODEL(data->thumbview->store),
+                                 &iter, path))
+        return;
+
+    gtk_tree_model_get(GTK_TREE_MODEL(data->thumbview->store), &iter,
+                       THUMBVIEW_COLUMN_IMAGE, &img, -1);
+
+    gallery_image_activated(data, img);
+}
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#ifndef PWGALLERY_THUMBVIEW_H
+#define PWGALLERY_THUMBVIEW_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "main.h"
+
+#include <glib.h>
+
+/*
+ * The thumbnail list of the main window. Only the rows on the screen
+ * are drawn, and their thumbnails are decoded on the worker pool when
+ * they are first shown. The decoded thumbnails are kept until they use
+ * more memory than data->thumb_memory, the least recently shown ones
+ * are dropped first. The rows are kept in the gallery order by the
+ * functions below, each changing only the rows affected.
+ */
+struct thumbview;
+
+/*
+ * Set up the thumbnail list of the main window
+ */
+void thumbview_init(struct data *data);
+
+/*
+ * Free the thumbnail list
+ */
+void thumbview_free(struct data *data);
+
+/*
+ * Select the current image and scroll to it
+ */
+void thumbview_update(struct data *data);
+
+/*
+ * Add a row for an image appended to the gallery
+ */
+void thumbview_append(struct data *data, struct image *img);
+
+/*
+ * Move the row of an image moved in the gallery from the given index
+ */
+void thumbview_move(struct data *data, struct image *img, gint from);
+
+/*
+ * Reorder the rows after the gallery was sorted
+ */
+void thumbview_reorder(struct data *data);
+
+/*
+ * Remove the row of an image and drop its thumbnail before the image
+ * is removed from the gallery
+ */
+void thumbview_forget(struct data *data, struct image *img);
+
+/*
+ * Empty the list and drop all thumbnails before the images are freed
+ */
+void thumbview_clear(struct data *data);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
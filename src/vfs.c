@@ -28,6 +28,35 @@
 #include <libgnomevfs/gnome-vfs.h>
 #include <stdlib.h>                 /* EXIT_FAILURE */
 #include <string.h>                 /* strncmp */
+#include <fcntl.h>                  /* open */
+#include <unistd.h>                 /* fsync, read, close */
+#include <errno.h>                  /* errno */
+#include <sys/stat.h>               /* fstat */
+
+struct vfs_reader
+{
+    gchar          *uri;               /* uri being read */
+    GnomeVFSHandle *handle;            /* handle to the uri */
+};
+
+struct vfs_writer
+{
+    gchar          *uri;               /* uri being written */
+    GnomeVFSHandle *handle;            /* handle to the uri */
+};
+
+struct vfs_view
+{
+    guchar         *content;           /* content read to memory */
+    gsize          len;                /* length of the content */
+};
+
+static void _stat_info(GnomeVFSFileInfo *info, goffset *size, glong *mtime);
+static GnomeVFSResult _create(struct data *data, const gchar *uri,
+                              GnomeVFSHandle **handle);
+static GnomeVFSResult _write(GnomeVFSHandle *handle, const guchar *content,
+                             gsize content_len);
+static gboolean _read_local(const gchar *path, guchar **content, gsize *len);
 
 gboolean
 vfs_is_file(struct data *data, const gchar *uri)
@@ -106,6 +135,18 @@ vfs_is_dir(struct data *data, const gchar *uri)
 
 void
 vfs_mkdir(struct data *data, const gchar *uri)
+{
+    if (vfs_try_mkdir(data, uri) == FALSE) {
+        /* FIXME: show popup */
+        g_warning("Exiting because failed to make directory '%s'", uri);
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+
+gboolean
+vfs_try_mkdir(struct data *data, const gchar *uri)
 {
     GnomeVFSResult result;
     
@@ -119,19 +160,36 @@ vfs_mkdir(struct data *data, const gchar *uri)
                                       GNOME_VFS_PERM_GROUP_EXEC |
                                       GNOME_VFS_PERM_OTHER_READ |
                                       GNOME_VFS_PERM_OTHER_EXEC);
+
+    /* made already by another thread */
+    if (result == GNOME_VFS_ERROR_FILE_EXISTS && vfs_is_dir(data, uri))
+        return TRUE;
+
     if (result != GNOME_VFS_OK) {
-        /* FIXME: show popup */
-        g_warning("Exiting because failed to make directory '%s': %s", 
+        g_warning("Failed to make directory '%s': %s", 
                   uri, gnome_vfs_result_to_string(result));
-        exit(EXIT_FAILURE);
+        return FALSE;
     }
 
+    return TRUE;
 }
 
 
 
 void
 vfs_copy(struct data *data, const gchar *src, const gchar *dst)
+{
+    if (vfs_try_copy(data, src, dst) == FALSE) {
+        /* FIXME: show popup */
+        g_warning("Exiting because failed to copy %s -> %s", src, dst);
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+
+gboolean
+vfs_try_copy(struct data *data, const gchar *src, const gchar *dst)
 {
     GnomeVFSResult result;
     GnomeVFSURI *src_uri, *dst_uri;
@@ -159,18 +217,31 @@ vfs_copy(struct data *data, const gchar *src, const gchar *dst)
     gnome_vfs_uri_unref(dst_uri);
 
     if (result != GNOME_VFS_OK) {
-        /* FIXME: show popup */
-        g_warning("Exiting because failed to xfer %s -> %s: %s", 
+        g_warning("Failed to xfer %s -> %s: %s", 
                   src, dst, gnome_vfs_result_to_string(result));
-        exit(EXIT_FAILURE);
+        return FALSE;
     }
 
+    return TRUE;
 }
 
 
 
 void
 vfs_rename(struct data *data, const gchar *from, const gchar *to)
+{
+    if (vfs_try_rename(data, from, to) == FALSE) {
+        /* FIXME: show popup */
+        g_warning("Exiting because failed to rename uri '%s' ->'%s'", 
+                  from, to);
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+
+gboolean
+vfs_try_rename(struct data *data, const gchar *from, const gchar *to)
 {
     GnomeVFSResult result;
     
@@ -181,21 +252,57 @@ vfs_rename(struct data *data, const gchar *from, const gchar *to)
     result = gnome_vfs_move(from, to, FALSE);
 
     if (result != GNOME_VFS_OK) {
-        /* FIXME: show popup */
-        g_warning("Exiting because failed to rename uri '%s' ->'%s': %s", 
+        g_warning("Failed to rename uri '%s' ->'%s': %s", 
                   from, to, gnome_vfs_result_to_string(result));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+
+void
+vfs_replace(struct data *data, const gchar *from, const gchar *to)
+{
+    if (vfs_try_replace(data, from, to) == FALSE) {
+        /* FIXME: show popup */
+        g_warning("Exiting because failed to replace uri '%s' ->'%s'", 
+                  from, to);
         exit(EXIT_FAILURE);
     }
+}
+
 
 
+gboolean
+vfs_try_replace(struct data *data, const gchar *from, const gchar *to)
+{
+    GnomeVFSResult result;
+    
+    g_assert(data != NULL);
+    g_assert(from != NULL);
+    g_assert(to != NULL);
+
+    /* a rename within the same directory replaces atomically */
+    result = gnome_vfs_move(from, to, TRUE);
+
+    if (result != GNOME_VFS_OK) {
+        g_warning("Failed to replace uri '%s' ->'%s': %s", 
+                  from, to, gnome_vfs_result_to_string(result));
+        return FALSE;
+    }
+
+    return TRUE;
 }
 
 
 
-void
+gboolean
 vfs_copy_htaccess(struct data *data, const gchar *from, const gchar *to)
 {
     gchar *src, *dst;
+    gboolean ok = TRUE;
 
     g_assert(data != NULL);
     g_assert(from != NULL);
@@ -205,11 +312,13 @@ vfs_copy_htaccess(struct data *data, const gchar *from, const gchar *to)
     dst = g_strdup_printf("%s/.htaccess", to);
 
     if (vfs_is_file(data, src)) {
-        vfs_copy(data, src, dst);
+        ok = vfs_try_copy(data, src, dst);
     }
 
     g_free(src);
     g_free(dst);
+
+    return ok;
 }
 
 
@@ -217,6 +326,19 @@ vfs_copy_htaccess(struct data *data, const gchar *from, const gchar *to)
 void
 vfs_read_file(struct data *data, const gchar *uri, guchar **content,
               gsize *content_len)
+{
+    if (vfs_try_read_file(data, uri, content, content_len) == FALSE) {
+        /* FIXME: show popup */
+        g_warning("Exiting because failed to read entire file '%s'", uri);
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+
+gboolean
+vfs_try_read_file(struct data *data, const gchar *uri, guchar **content,
+                  gsize *content_len)
 {
     GnomeVFSResult result;
     int file_size;
@@ -228,14 +350,166 @@ vfs_read_file(struct data *data, const gchar *uri, guchar **content,
 
     result = gnome_vfs_read_entire_file(uri, &file_size, (gchar **)content);
     if (result != GNOME_VFS_OK) {
-        /* FIXME: show popup */
-        g_warning("Exiting because failed to read entire file '%s': %s", 
+        g_warning("Failed to read entire file '%s': %s", 
                   uri, gnome_vfs_result_to_string(result));
-        exit(EXIT_FAILURE);
+        return FALSE;
     }
 
     /* -1 because of NULL termination */
     *content_len = file_size - 1;
+
+    return TRUE;
+}
+
+
+
+struct vfs_view *
+vfs_view_new(struct data *data, const gchar *uri)
+{
+    struct vfs_view *view;
+    GnomeVFSResult result;
+    gchar *path;
+    int file_size;
+
+    g_assert(data != NULL);
+    g_assert(uri != NULL);
+
+    view = g_new0(struct vfs_view, 1);
+
+    /* Read to memory, not mapped: a mapped file truncated while in use,
+     * like a photo rewritten in place by an editor, would crash the
+     * process with SIGBUS. A local file is read with a single read to
+     * a buffer of its size instead of the growing gnome-vfs buffer. */
+    path = gnome_vfs_get_local_path_from_uri(uri);
+    if (path != NULL) {
+        gboolean ok;
+
+        ok = _read_local(path, &view->content, &view->len);
+        g_free(path);
+        if (!ok) {
+            g_free(view);
+            return NULL;
+        }
+
+        g_debug("in vfs_view_new: %s: %lu bytes", uri, (gulong)view->len);
+
+        return view;
+    }
+
+    result = gnome_vfs_read_entire_file(uri, &file_size,
+                                        (gchar **)&view->content);
+    if (result != GNOME_VFS_OK) {
+        /* FIXME: show popup */
+        g_warning("Failed to read file '%s': %s",
+                  uri, gnome_vfs_result_to_string(result));
+        g_free(view);
+        return NULL;
+    }
+
+    /* the NULL termination is not included in the size */
+    view->len = file_size;
+
+    g_debug("in vfs_view_new: %s: %lu bytes", uri, (gulong)view->len);
+
+    return view;
+}
+
+
+
+const guchar *
+vfs_view_get_data(struct vfs_view *view)
+{
+    g_assert(view != NULL);
+
+    return view->content;
+}
+
+
+
+gsize
+vfs_view_get_len(struct vfs_view *view)
+{
+    g_assert(view != NULL);
+
+    return view->len;
+}
+
+
+
+void
+vfs_view_release(struct vfs_view *view)
+{
+    if (view == NULL)
+        return;
+
+    g_free(view->content);
+    g_free(view);
+}
+
+
+
+struct vfs_reader *
+vfs_reader_new(struct data *data, const gchar *uri)
+{
+    struct vfs_reader *reader;
+    GnomeVFSResult result;
+
+    g_assert(data != NULL);
+    g_assert(uri != NULL);
+
+    reader = g_new0(struct vfs_reader, 1);
+    reader->uri = g_strdup(uri);
+
+    result = gnome_vfs_open(&reader->handle, uri, GNOME_VFS_OPEN_READ);
+    if (result != GNOME_VFS_OK) {
+        g_warning("Failed to open uri '%s': %s", 
+                  uri, gnome_vfs_result_to_string(result));
+        g_free(reader->uri);
+        g_free(reader);
+        return NULL;
+    }
+
+    return reader;
+}
+
+
+
+gssize
+vfs_reader_read(struct vfs_reader *reader, guchar *buf, gsize len)
+{
+    GnomeVFSResult result;
+    GnomeVFSFileSize bytes_read;
+
+    g_assert(reader != NULL);
+    g_assert(buf != NULL);
+
+    do {
+        result = gnome_vfs_read(reader->handle, buf, len, &bytes_read);
+    } while (result == GNOME_VFS_ERROR_INTERRUPTED);
+
+    if (result == GNOME_VFS_ERROR_EOF)
+        return 0;
+
+    if (result != GNOME_VFS_OK) {
+        /* FIXME: show popup */
+        g_warning("Failed to read file '%s': %s", 
+                  reader->uri, gnome_vfs_result_to_string(result));
+        return -1;
+    }
+
+    return (gssize)bytes_read;
+}
+
+
+
+void
+vfs_reader_close(struct vfs_reader *reader)
+{
+    g_assert(reader != NULL);
+
+    gnome_vfs_close(reader->handle);
+    g_free(reader->uri);
+    g_free(reader);
 }
 
 
@@ -244,29 +518,315 @@ void
 vfs_write_file(struct data *data, const gchar *uri, const guchar *content,
                gsize content_len)
 {
-    gchar *dir;
-    GnomeVFSURI *vfsuri;
-    GnomeVFSResult result;
+    if (vfs_try_write_file(data, uri, content, content_len) == FALSE) {
+        /* FIXME: show popup */
+        g_warning("Exiting because failed to write file '%s'", uri);
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+
+gboolean
+vfs_try_write_file(struct data *data, const gchar *uri,
+                   const guchar *content, gsize content_len)
+{
     GnomeVFSHandle *handle;
-    GnomeVFSFileSize bytes_written;
-    GnomeVFSFileSize bytes_written_total = 0;
+    GnomeVFSResult result;
 
     g_assert(data != NULL);
     g_assert(uri != NULL);
     g_assert(content != NULL);
     g_assert(content_len != 0);
 
+    result = _create(data, uri, &handle);
+    if (result == GNOME_VFS_OK) {
+        result = _write(handle, content, content_len);
+        gnome_vfs_close(handle);
+    }
+
+    if (result != GNOME_VFS_OK) {
+        g_warning("Failed to write file '%s': %s", 
+                  uri, gnome_vfs_result_to_string(result));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+
+struct vfs_writer *
+vfs_writer_new(struct data *data, const gchar *uri)
+{
+    struct vfs_writer *writer;
+
+    writer = vfs_try_writer_new(data, uri);
+    if (writer == NULL) {
+        /* FIXME: show popup */
+        g_warning("Exiting because failed to create uri '%s'", uri);
+        exit(EXIT_FAILURE);
+    }
+
+    return writer;
+}
+
+
+
+struct vfs_writer *
+vfs_try_writer_new(struct data *data, const gchar *uri)
+{
+    struct vfs_writer *writer;
+    GnomeVFSResult result;
+
+    g_assert(data != NULL);
+    g_assert(uri != NULL);
+
+    writer = g_new0(struct vfs_writer, 1);
+    writer->uri = g_strdup(uri);
+
+    /* open uri */
+    result = _create(data, uri, &writer->handle);
+    if (result != GNOME_VFS_OK) {
+        g_warning("Failed to create uri '%s': %s", 
+                  uri, gnome_vfs_result_to_string(result));
+        g_free(writer->uri);
+        g_free(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+
+
+void
+vfs_writer_write(struct vfs_writer *writer, const guchar *content,
+                 gsize content_len)
+{
+    if (!vfs_try_writer_write(writer, content, content_len)) {
+        /* FIXME: show popup */
+        g_warning("Exiting because failed to write file '%s'",
+                  writer->uri);
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+
+gboolean
+vfs_try_writer_write(struct vfs_writer *writer, const guchar *content,
+                     gsize content_len)
+{
+    GnomeVFSResult result;
+
+    g_assert(writer != NULL);
+    g_assert(content != NULL || content_len == 0);
+
+    result = _write(writer->handle, content, content_len);
+    if (result != GNOME_VFS_OK) {
+        g_warning("Failed to write file '%s': %s", 
+                  writer->uri, gnome_vfs_result_to_string(result));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+
+gboolean
+vfs_writer_close(struct vfs_writer *writer)
+{
+    GnomeVFSResult result;
+    gchar *path;
+    gboolean ok = TRUE;
+
+    g_assert(writer != NULL);
+
+    /* a delayed write error shows only when synced or closed */
+    path = gnome_vfs_get_local_path_from_uri(writer->uri);
+    if (path != NULL) {
+        int fd;
+
+        fd = open(path, O_RDONLY);
+        if (fd == -1 || fsync(fd) != 0) {
+            g_warning("Failed to sync file '%s': %s", writer->uri,
+                      g_strerror(errno));
+            ok = FALSE;
+        }
+        if (fd != -1)
+            close(fd);
+        g_free(path);
+    }
+
+    result = gnome_vfs_close(writer->handle);
+    if (result != GNOME_VFS_OK) {
+        g_warning("Failed to close file '%s': %s", writer->uri,
+                  gnome_vfs_result_to_string(result));
+        ok = FALSE;
+    }
+
+    g_free(writer->uri);
+    g_free(writer);
+
+    return ok;
+}
+
+
+
+gboolean
+vfs_stat(struct data *data, const gchar *uri, goffset *size, glong *mtime)
+{
+    GnomeVFSFileInfo *info;
+    GnomeVFSResult result;
+
+    g_assert(data != NULL);
+    g_assert(uri != NULL);
+
+    info = gnome_vfs_file_info_new();
+
+    result = gnome_vfs_get_file_info(uri, info, 
+                                     GNOME_VFS_FILE_INFO_DEFAULT | 
+                                     GNOME_VFS_FILE_INFO_FOLLOW_LINKS);
+    if (result != GNOME_VFS_OK) {
+        gnome_vfs_file_info_unref(info);
+        return FALSE;
+    }
+
+    _stat_info(info, size, mtime);
+
+    gnome_vfs_file_info_unref(info);
+
+    return TRUE;
+}
+
+
+
+gboolean
+vfs_stat_handle(struct data *data, GnomeVFSHandle *handle,
+                goffset *size, glong *mtime)
+{
+    GnomeVFSFileInfo *info;
+    GnomeVFSResult result;
+
+    g_assert(data != NULL);
+    g_assert(handle != NULL);
+
+    info = gnome_vfs_file_info_new();
+
+    result = gnome_vfs_get_file_info_from_handle(handle, info, 
+                                                 GNOME_VFS_FILE_INFO_DEFAULT);
+    if (result != GNOME_VFS_OK) {
+        gnome_vfs_file_info_unref(info);
+        return FALSE;
+    }
+
+    _stat_info(info, size, mtime);
+
+    gnome_vfs_file_info_unref(info);
+
+    return TRUE;
+}
+
+
+
+void
+vfs_unlink(struct data *data, const gchar *uri)
+{
+    GnomeVFSResult result;
+
+    g_assert(data != NULL);
+    g_assert(uri != NULL);
+
+    result = gnome_vfs_unlink(uri);
+
+    if (result != GNOME_VFS_OK) {
+        /* FIXME: show popup */
+        g_warning("Failed to remove uri '%s': %s", 
+                  uri, gnome_vfs_result_to_string(result));
+    }
+}
+
+
+
+void
+vfs_remove_tree(struct data *data, const gchar *uri)
+{
+    GnomeVFSResult result;
+    GnomeVFSURI *vfsuri;
+    GList *uris;
+
+    g_assert(data != NULL);
+    g_assert(uri != NULL);
+
+    vfsuri = gnome_vfs_uri_new(uri);
+    g_assert(vfsuri != NULL);
+    uris = g_list_append(NULL, vfsuri);
+
+    result = gnome_vfs_xfer_delete_list(uris,
+                                        GNOME_VFS_XFER_ERROR_MODE_ABORT,
+                                        GNOME_VFS_XFER_RECURSIVE,
+                                        NULL,
+                                        NULL);
+
+    g_list_free(uris);
+    gnome_vfs_uri_unref(vfsuri);
+
+    if (result != GNOME_VFS_OK) {
+        /* FIXME: show popup */
+        g_warning("Failed to remove directory '%s': %s", 
+                  uri, gnome_vfs_result_to_string(result));
+    }
+}
+
+
+
+/**********************
+ *                    *
+ * Static functions   *
+ *                    *
+ **********************/
+
+
+/*
+ * Get the size and mtime from the file info, -1 if not known
+ */
+static void
+_stat_info(GnomeVFSFileInfo *info, goffset *size, glong *mtime)
+{
+    if (size != NULL) {
+        *size = (info->valid_fields & GNOME_VFS_FILE_INFO_FIELDS_SIZE) ?
+            (goffset)info->size : -1;
+    }
+    if (mtime != NULL) {
+        *mtime = (info->valid_fields & GNOME_VFS_FILE_INFO_FIELDS_MTIME) ?
+            (glong)info->mtime : -1;
+    }
+}
+
+
+
+/*
+ * Create the uri for writing, and its directory if needed
+ */
+static GnomeVFSResult
+_create(struct data *data, const gchar *uri, GnomeVFSHandle **handle)
+{
+    gchar *dir;
+    GnomeVFSURI *vfsuri;
+    GnomeVFSResult result;
+
     vfsuri = gnome_vfs_uri_new(uri);
 
     /* make dir if needed */
     dir = gnome_vfs_uri_extract_dirname(vfsuri);
     if (vfs_is_dir(data, dir) == FALSE) {
-        vfs_mkdir(data, dir);
+        vfs_try_mkdir(data, dir);
     }       
     g_free(dir);
 
-    /* open uri */
-    result = gnome_vfs_create_uri(&handle, vfsuri,
+    result = gnome_vfs_create_uri(handle, vfsuri,
                                   GNOME_VFS_OPEN_WRITE | 
                                   GNOME_VFS_OPEN_TRUNCATE,
                                   FALSE,
@@ -274,34 +834,88 @@ vfs_write_file(struct data *data, const gchar *uri, const guchar *content,
                                   GNOME_VFS_PERM_USER_WRITE |
                                   GNOME_VFS_PERM_GROUP_READ |
                                   GNOME_VFS_PERM_OTHER_READ);
-    if (result != GNOME_VFS_OK) {
-        /* FIXME: show popup */
-        g_warning("Exiting because failed to create uri '%s': %s", 
-                  uri, gnome_vfs_result_to_string(result));
-        exit(EXIT_FAILURE);
-    }
+    gnome_vfs_uri_unref(vfsuri);
+
+    return result;
+}
+
+
+
+/*
+ * Write all of the content to the handle
+ */
+static GnomeVFSResult
+_write(GnomeVFSHandle *handle, const guchar *content, gsize content_len)
+{
+    GnomeVFSResult result;
+    GnomeVFSFileSize bytes_written;
+    GnomeVFSFileSize bytes_written_total = 0;
 
-    /* write file */
     while (bytes_written_total < content_len) {
-        result = gnome_vfs_write(handle, content, 
+        result = gnome_vfs_write(handle, 
+                                 content + bytes_written_total, 
                                  content_len - bytes_written_total,
                                  &bytes_written);
-        if (result != GNOME_VFS_OK &&
-            result != GNOME_VFS_ERROR_INTERRUPTED) {
-            /* FIXME: show popup */
-            g_warning("Exiting because failed to write file '%s': %s", 
-                      uri, gnome_vfs_result_to_string(result));
-            exit(EXIT_FAILURE);
-        }
+        if (result == GNOME_VFS_ERROR_INTERRUPTED)
+            continue;
+        if (result != GNOME_VFS_OK)
+            return result;
      
         bytes_written_total += bytes_written;
     }
 
-    gnome_vfs_close(handle);
-    gnome_vfs_uri_unref(vfsuri);
+    return GNOME_VFS_OK;
 }
 
 
+
+/*
+ * Read a whole local file to a buffer of its size. A file shrinking
+ * meanwhile gives the part read, one growing only the original size.
+ */
+static gboolean
+_read_local(const gchar *path, guchar **content, gsize *len)
+{
+    struct stat st;
+    gsize done = 0;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) != 0) {
+        /* FIXME: show popup */
+        g_warning("Failed to read file '%s': %s", path, g_strerror(errno));
+        if (fd != -1)
+            close(fd);
+        return FALSE;
+    }
+
+    *content = g_malloc(MAX(st.st_size, 1));
+    while (done < (gsize)st.st_size) {
+        ssize_t n;
+
+        n = read(fd, *content + done, st.st_size - done);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1) {
+            /* FIXME: show popup */
+            g_warning("Failed to read file '%s': %s", path,
+                      g_strerror(errno));
+            g_free(*content);
+            *content = NULL;
+            close(fd);
+            return FALSE;
+        }
+        if (n == 0)
+            break;
+        done += n;
+    }
+    close(fd);
+
+    *len = done;
+
+    return TRUE;
+}
+
 /* Emacs indentatation information
    Local Variables:
    indent-tabs-mode:nil
@@ -27,6 +27,7 @@
 #include "main.h"
 
 #include <glib.h>
+#include <libgnomevfs/gnome-vfs.h>
 
 /*
  * Check if uri is found and is a file
@@ -44,37 +45,184 @@ gboolean vfs_is_image(struct data *data, const gchar *uri);
 gboolean vfs_is_dir(struct data *data, const gchar *uri);
 
 /*
- * Make directory
+ * Make directory. Exits on failure.
  */
 void vfs_mkdir(struct data *data, const gchar *uri);
 
 /*
- * Copy file
+ * Make directory. An existing directory is not an error. Returns
+ * FALSE on failure.
+ */
+gboolean vfs_try_mkdir(struct data *data, const gchar *uri);
+
+/*
+ * Copy file. Exits on failure.
  */
 void vfs_copy(struct data *data, const gchar *src, const gchar *dst);
 
 /*
- * Rename URI
+ * Copy file. Returns FALSE on failure.
+ */
+gboolean vfs_try_copy(struct data *data, const gchar *src, const gchar *dst);
+
+/*
+ * Rename URI. Exits on failure.
  */
 void vfs_rename(struct data *data, const gchar *from, const gchar *to);
 
 /*
- * Copy htaccess file from 'from' directory to 'to' directory
+ * Rename URI. Returns FALSE on failure.
+ */
+gboolean vfs_try_rename(struct data *data, const gchar *from,
+                        const gchar *to);
+
+/*
+ * Rename URI over an existing one. Exits on failure.
+ */
+void vfs_replace(struct data *data, const gchar *from, const gchar *to);
+
+/*
+ * Rename URI over an existing one. Returns FALSE on failure.
+ */
+gboolean vfs_try_replace(struct data *data, const gchar *from,
+                         const gchar *to);
+
+/*
+ * Copy htaccess file from 'from' directory to 'to' directory, if there
+ * is one. Returns FALSE if it could not be copied.
  */
-void vfs_copy_htaccess(struct data *data, const gchar *from, const gchar *to);
+gboolean vfs_copy_htaccess(struct data *data, const gchar *from,
+                           const gchar *to);
 
 /*
- * Read a whole uri to buffer
+ * Read a whole uri to buffer. Exits on failure.
  */
 void vfs_read_file(struct data *data, const gchar *uri, guchar **content,
                    gsize *content_len);
 
 /*
- * Write data to given uri
+ * Read a whole uri to buffer. Returns FALSE on failure.
+ */
+gboolean vfs_try_read_file(struct data *data, const gchar *uri,
+                           guchar **content, gsize *content_len);
+
+/*
+ * A read-only view of a whole uri read to memory. The data is
+ * borrowed from the view and valid until it is released.
+ */
+struct vfs_view;
+
+/*
+ * Get a view of the uri. Returns NULL if it can't be read.
+ */
+struct vfs_view *vfs_view_new(struct data *data, const gchar *uri);
+
+/*
+ * Get the content of the view
+ */
+const guchar *vfs_view_get_data(struct vfs_view *view);
+
+/*
+ * Get the length of the content
+ */
+gsize vfs_view_get_len(struct vfs_view *view);
+
+/*
+ * Release the view and its content
+ */
+void vfs_view_release(struct vfs_view *view);
+
+/*
+ * A file being read in parts
+ */
+struct vfs_reader;
+
+/*
+ * Open the uri for reading in parts. Returns NULL on failure.
+ */
+struct vfs_reader *vfs_reader_new(struct data *data, const gchar *uri);
+
+/*
+ * Read the next part of the file to buf. Returns the number of bytes
+ * read, 0 at the end of the file or -1 on error.
+ */
+gssize vfs_reader_read(struct vfs_reader *reader, guchar *buf, gsize len);
+
+/*
+ * Close the file
+ */
+void vfs_reader_close(struct vfs_reader *reader);
+
+/*
+ * Write data to given uri. Exits on failure.
  */
 void vfs_write_file(struct data *data, const gchar *uri, const guchar *content,
                     gsize content_len);
 
+/*
+ * Write data to given uri. Returns FALSE on failure.
+ */
+gboolean vfs_try_write_file(struct data *data, const gchar *uri,
+                            const guchar *content, gsize content_len);
+
+/*
+ * A file being written in parts
+ */
+struct vfs_writer;
+
+/*
+ * Create the uri for writing in parts. Exits on failure.
+ */
+struct vfs_writer *vfs_writer_new(struct data *data, const gchar *uri);
+
+/*
+ * Create the uri for writing in parts. Returns NULL on failure.
+ */
+struct vfs_writer *vfs_try_writer_new(struct data *data, const gchar *uri);
+
+/*
+ * Write next part of the file. Exits on failure.
+ */
+void vfs_writer_write(struct vfs_writer *writer, const guchar *content,
+                      gsize content_len);
+
+/*
+ * Write next part of the file. Returns FALSE on failure.
+ */
+gboolean vfs_try_writer_write(struct vfs_writer *writer,
+                              const guchar *content, gsize content_len);
+
+/*
+ * Close the file. A local file is synced to the disk first, so that it
+ * can safely replace another file. Returns FALSE if the file could not
+ * be written completely.
+ */
+gboolean vfs_writer_close(struct vfs_writer *writer);
+
+/*
+ * Get size and modification time of the uri. Returns FALSE if the
+ * uri is not found. Unknown values are set to -1.
+ */
+gboolean vfs_stat(struct data *data, const gchar *uri, goffset *size,
+                  glong *mtime);
+
+/*
+ * Get size and modification time of an open file. Returns FALSE on
+ * error. Unknown values are set to -1.
+ */
+gboolean vfs_stat_handle(struct data *data, GnomeVFSHandle *handle,
+                         goffset *size, glong *mtime);
+
+/*
+ * Remove a file. Failing is not fatal.
+ */
+void vfs_unlink(struct data *data, const gchar *uri);
+
+/*
+ * Remove a directory and everything in it. Failing is not fatal.
+ */
+void vfs_remove_tree(struct data *data, const gchar *uri);
+
 #endif
 
 /* Emacs indentatation information
@@ -0,0 +1,616 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "main.h"
+#include "watch.h"
+#include "gallery.h"
+#include "model.h"
+#include "image.h"
+#include "regen.h"
+
+#include <glib.h>
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+#include <sys/inotify.h>            /* inotify */
+#include <unistd.h>                 /* read, close */
+#include <errno.h>                  /* errno */
+#include <string.h>                 /* strerror */
+
+/* Changes that can affect a gallery */
+#define PWGALLERY_WATCH_EVENTS  (IN_CLOSE_WRITE | IN_MOVED_TO | \
+                                 IN_MOVED_FROM | IN_DELETE | IN_ATTRIB)
+
+/* The gallery file changed, open the gallery again */
+#define PWGALLERY_WATCH_REOPEN  (1 << 0)
+/* An image or a template changed, check the images again */
+#define PWGALLERY_WATCH_REFRESH (1 << 1)
+
+struct watch
+{
+    struct data     *data;
+    int             fd;                /* inotify instance */
+    gchar           *gal_dir;          /* new galleries found here or NULL */
+    GHashTable      *dirs;             /* watch descriptor -> directory */
+    GHashTable      *watched;          /* watched directories */
+    GHashTable      *files;            /* file -> galleries using it */
+    GHashTable      *galleries;        /* uri -> opened gallery or NULL */
+    GHashTable      *dirty;            /* uri -> what changed, to make */
+    guint           timer;             /* making the dirty galleries or 0 */
+    GMainLoop       *loop;             /* runs until watching fails */
+    gboolean        failed;            /* reading the changes failed */
+};
+
+static void _add_gallery(struct watch *watch, const gchar *uri);
+static GSList *_list_gal_dir(struct watch *watch);
+static struct data *_reopen(struct watch *watch, const gchar *uri);
+static gboolean _refresh(struct data *data);
+static void _close(struct data *data);
+static void _add_file(struct watch *watch, const gchar *uri,
+                      const gchar *gal_uri);
+static void _forget(struct watch *watch, const gchar *gal_uri);
+static gboolean _read_events(GIOChannel *source, GIOCondition condition,
+                             gpointer user_data);
+static void _changed(struct watch *watch, const gchar *path);
+static void _changed_all(struct watch *watch);
+static void _mark(struct watch *watch, const gchar *uri, gint what);
+static gboolean _make_dirty(gpointer user_data);
+static gchar *_local_path(const gchar *uri);
+
+
+
+gboolean
+watch_galleries(struct data *data, GSList *uris)
+{
+    struct watch watch;
+    GIOChannel   *channel;
+    GSList       *list;
+
+    g_assert(data != NULL);
+
+    g_debug("in watch_galleries");
+
+    memset(&watch, 0, sizeof(watch));
+    watch.data = data;
+    watch.fd = inotify_init();
+    if (watch.fd == -1) {
+        g_warning("Failed to start watching: %s", strerror(errno));
+        return FALSE;
+    }
+
+    watch.dirs = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+    watch.watched = g_hash_table_new(g_str_hash, g_str_equal);
+    watch.files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                        (GDestroyNotify)g_hash_table_destroy);
+    watch.galleries = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                            g_free, (GDestroyNotify)_close);
+    watch.dirty = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                        g_free, NULL);
+
+    if (uris != NULL) {
+        for (list = uris; list != NULL; list = list->next) {
+            _add_gallery(&watch, list->data);
+        }
+    } else {
+        GSList *found;
+
+        /* all galleries in the gallery directory, also the new ones */
+        watch.gal_dir = _local_path(data->gal_dir);
+        _add_file(&watch, data->gal_dir, NULL);
+
+        found = _list_gal_dir(&watch);
+        for (list = found; list != NULL; list = list->next) {
+            _add_gallery(&watch, list->data);
+        }
+        g_slist_free_full(found, g_free);
+    }
+
+    g_print(_("Watching %u galleries\n"), g_hash_table_size(watch.galleries));
+
+    /* runs until killed or the changes can't be read */
+    channel = g_io_channel_unix_new(watch.fd);
+    g_io_add_watch(channel, G_IO_IN, _read_events, &watch);
+    watch.loop = g_main_loop_new(NULL, FALSE);
+    g_main_loop_run(watch.loop);
+
+    if (watch.timer != 0)
+        g_source_remove(watch.timer);
+    g_main_loop_unref(watch.loop);
+    g_io_channel_unref(channel);
+    close(watch.fd);
+    g_hash_table_destroy(watch.dirs);
+    g_hash_table_destroy(watch.watched);
+    g_hash_table_destroy(watch.files);
+    g_hash_table_destroy(watch.galleries);
+    g_hash_table_destroy(watch.dirty);
+    g_free(watch.gal_dir);
+
+    return !watch.failed;
+}
+
+
+
+/**********************
+ *                    *
+ * Static functions   *
+ *                    *
+ **********************/
+
+
+/*
+ * Start watching a gallery
+ */
+static void
+_add_gallery(struct watch *watch, const gchar *uri)
+{
+    if (g_hash_table_lookup_extended(watch->galleries, uri, NULL, NULL))
+        return;
+
+    g_debug("in _add_gallery: %s", uri);
+
+    _reopen(watch, uri);
+}
+
+
+
+/*
+ * Get the uris of the galleries in the gallery directory
+ */
+static GSList *
+_list_gal_dir(struct watch *watch)
+{
+    GSList      *uris = NULL;
+    GDir        *dir;
+    const gchar *name;
+
+    if (watch->gal_dir == NULL)
+        return NULL;
+
+    dir = g_dir_open(watch->gal_dir, 0, NULL);
+    while (dir != NULL && (name = g_dir_read_name(dir)) != NULL) {
+        gchar *path, *uri;
+
+        if (!g_str_has_suffix(name, ".xml"))
+            continue;
+
+        path = g_build_filename(watch->gal_dir, name, NULL);
+        uri = g_filename_to_uri(path, NULL, NULL);
+        if (uri != NULL)
+            uris = g_slist_prepend(uris, uri);
+        g_free(path);
+    }
+    if (dir != NULL)
+        g_dir_close(dir);
+
+    return g_slist_reverse(uris);
+}
+
+
+
+/*
+ * Open the gallery and keep it open in its own copy of the data, like
+ * in regen, so that only the changed images are read again between the
+ * makes. Watch the files it is made of: the gallery file, the images
+ * and the templates. Returns NULL if the gallery can't be read; its
+ * file is still watched.
+ */
+static struct data *
+_reopen(struct watch *watch, const gchar *uri)
+{
+    struct data *data;
+    guint i;
+
+    g_debug("in _reopen: %s", uri);
+
+    _forget(watch, uri);
+    _add_file(watch, uri, uri);
+
+    data = g_new(struct data, 1);
+    *data = *watch->data;
+    data->gal = NULL;
+    data->import = NULL;
+    data->make = NULL;
+    data->current_img = NULL;
+
+    gallery_init(data);
+    if (!gallery_open_uri(data, (gchar *)uri)) {
+        g_warning("Failed to read the gallery %s", uri);
+        _close(data);
+        data = NULL;
+    } else {
+        for (i = 0; i < model_length(data->gal->model); i++) {
+            _add_file(watch, model_nth(data->gal->model, i)->uri, uri);
+        }
+        _add_file(watch, data->gal->templ_index, uri);
+        _add_file(watch, data->gal->templ_indeximg, uri);
+        _add_file(watch, data->gal->templ_indexgen, uri);
+        _add_file(watch, data->gal->templ_image, uri);
+        _add_file(watch, data->gal->templ_gen, uri);
+    }
+
+    /* closes the previously opened gallery */
+    g_hash_table_replace(watch->galleries, g_strdup(uri), data);
+
+    return data;
+}
+
+
+
+/*
+ * Check the images of an opened gallery again. Only the images whose
+ * size or modification time changed are read. Returns FALSE if some
+ * image can't be opened anymore.
+ */
+static gboolean
+_refresh(struct data *data)
+{
+    guint i;
+
+    for (i = 0; i < model_length(data->gal->model); i++) {
+        if (!image_open_saved(data, model_nth(data->gal->model, i)))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+
+/*
+ * Close a gallery opened by _reopen
+ */
+static void
+_close(struct data *data)
+{
+    if (data == NULL)
+        return;
+
+    gallery_free(data);
+    g_free(data);
+}
+
+
+
+/*
+ * Mark a file as used by the gallery and watch its directory. With a
+ * NULL gallery only the file itself, a directory, is watched.
+ */
+static void
+_add_file(struct watch *watch, const gchar *uri, const gchar *gal_uri)
+{
+    GHashTable *users;
+    gchar      *path, *dir;
+
+    if (uri == NULL || uri[0] == '\0')
+        return;
+
+    /* only local files can be watched */
+    path = _local_path(uri);
+    if (path == NULL)
+        return;
+
+    dir = gal_uri != NULL ? g_path_get_dirname(path) : g_strdup(path);
+    if (!g_hash_table_lookup_extended(watch->watched, dir, NULL, NULL)) {
+        int wd;
+
+        wd = inotify_add_watch(watch->fd, dir, PWGALLERY_WATCH_EVENTS);
+        if (wd == -1) {
+            g_warning("Failed to watch %s: %s", dir, strerror(errno));
+            g_free(dir);
+        } else {
+            g_debug("%s: watching %s", __func__, dir);
+            /* the directory is owned by dirs */
+            g_hash_table_insert(watch->dirs, GINT_TO_POINTER(wd), dir);
+            g_hash_table_insert(watch->watched, dir, NULL);
+        }
+    } else {
+        g_free(dir);
+    }
+
+    if (gal_uri == NULL) {
+        g_free(path);
+        return;
+    }
+
+    users = g_hash_table_lookup(watch->files, path);
+    if (users == NULL) {
+        users = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        g_hash_table_insert(watch->files, path, users);
+    } else {
+        g_free(path);
+    }
+    g_hash_table_insert(users, g_strdup(gal_uri), NULL);
+}
+
+
+
+/*
+ * Forget the files used by the gallery, before scanning it again. The
+ * directories stay watched.
+ */
+static void
+_forget(struct watch *watch, const gchar *gal_uri)
+{
+    GHashTableIter iter;
+    gpointer       value;
+
+    g_hash_table_iter_init(&iter, watch->files);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        GHashTable *users = value;
+
+        g_hash_table_remove(users, gal_uri);
+        if (g_hash_table_size(users) == 0)
+            g_hash_table_iter_remove(&iter);
+    }
+}
+
+
+
+/*
+ * Read the changes from inotify
+ */
+static gboolean
+_read_events(GIOChannel *source, GIOCondition condition, gpointer user_data)
+{
+    struct watch *watch;
+    gchar        buf[4096]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    ssize_t      len, i;
+
+    g_assert(user_data != NULL);
+    watch = user_data;
+
+    len = read(watch->fd, buf, sizeof(buf));
+    if (len <= 0) {
+        if (len == -1 && errno == EINTR)
+            return TRUE;
+        g_warning("Failed to read the changes: %s",
+                  len == 0 ? "end of file" : strerror(errno));
+
+        /* nothing would be noticed anymore, stop watching */
+        watch->failed = TRUE;
+        g_main_loop_quit(watch->loop);
+        return FALSE;
+    }
+
+    for (i = 0; i < len;
+         i += sizeof(struct inotify_event) +
+             ((struct inotify_event *)&buf[i])->len) {
+        struct inotify_event *event = (struct inotify_event *)&buf[i];
+        const gchar *dir;
+        gchar *path;
+
+        /* changes were lost, anything may have changed */
+        if (event->mask & IN_Q_OVERFLOW) {
+            g_warning("Too many changes at once, making all galleries");
+            _changed_all(watch);
+            continue;
+        }
+
+        if (event->len == 0)
+            continue;
+
+        dir = g_hash_table_lookup(watch->dirs, GINT_TO_POINTER(event->wd));
+        if (dir == NULL)
+            continue;
+
+        path = g_build_filename(dir, event->name, NULL);
+        _changed(watch, path);
+        g_free(path);
+    }
+
+    return TRUE;
+}
+
+
+
+/*
+ * A file in a watched directory changed. Mark the galleries using it,
+ * and wait a while for more changes before making them.
+ */
+static void
+_changed(struct watch *watch, const gchar *path)
+{
+    GHashTable     *users;
+    GHashTableIter iter;
+    gpointer       key;
+    gboolean       dirty = FALSE;
+
+    users = g_hash_table_lookup(watch->files, path);
+    if (users != NULL) {
+        g_hash_table_iter_init(&iter, users);
+        while (g_hash_table_iter_next(&iter, &key, NULL)) {
+            gchar *gal_path = _local_path(key);
+
+            /* the gallery file itself or a file it uses */
+            if (gal_path != NULL && strcmp(gal_path, path) == 0)
+                _mark(watch, key, PWGALLERY_WATCH_REOPEN);
+            else
+                _mark(watch, key, PWGALLERY_WATCH_REFRESH);
+            g_free(gal_path);
+            dirty = TRUE;
+        }
+    }
+
+    /* a new gallery in the gallery directory */
+    if (users == NULL && watch->gal_dir != NULL &&
+        g_str_has_suffix(path, ".xml")) {
+        gchar *dir = g_path_get_dirname(path);
+
+        if (strcmp(dir, watch->gal_dir) == 0) {
+            gchar *uri = g_filename_to_uri(path, NULL, NULL);
+
+            if (uri != NULL) {
+                _mark(watch, uri, PWGALLERY_WATCH_REOPEN);
+                g_free(uri);
+                dirty = TRUE;
+            }
+        }
+        g_free(dir);
+    }
+
+    if (!dirty)
+        return;
+
+    g_debug("%s: %s", __func__, path);
+
+    if (watch->timer != 0)
+        g_source_remove(watch->timer);
+    watch->timer = g_timeout_add(PWGALLERY_WATCH_DELAY, _make_dirty, watch);
+}
+
+
+
+/*
+ * Changes were lost. Open all the galleries again and make them, and
+ * look for new galleries in the gallery directory.
+ */
+static void
+_changed_all(struct watch *watch)
+{
+    GHashTableIter iter;
+    gpointer       key;
+    GSList         *found, *list;
+
+    g_hash_table_iter_init(&iter, watch->galleries);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        _mark(watch, key, PWGALLERY_WATCH_REOPEN);
+    }
+
+    found = _list_gal_dir(watch);
+    for (list = found; list != NULL; list = list->next) {
+        _mark(watch, list->data, PWGALLERY_WATCH_REOPEN);
+    }
+    g_slist_free_full(found, g_free);
+
+    if (watch->timer != 0)
+        g_source_remove(watch->timer);
+    watch->timer = g_timeout_add(PWGALLERY_WATCH_DELAY, _make_dirty, watch);
+}
+
+
+
+/*
+ * Mark a gallery to be made, adding to what changed in it already
+ */
+static void
+_mark(struct watch *watch, const gchar *uri, gint what)
+{
+    gint dirty;
+
+    dirty = GPOINTER_TO_INT(g_hash_table_lookup(watch->dirty, uri));
+    g_hash_table_insert(watch->dirty, g_strdup(uri),
+                        GINT_TO_POINTER(dirty | what));
+}
+
+
+
+/*
+ * Make the changed galleries. A gallery is opened again only if its
+ * file changed, otherwise only its changed images are read again.
+ */
+static gboolean
+_make_dirty(gpointer user_data)
+{
+    struct watch   *watch;
+    GHashTableIter iter;
+    gpointer       key, value;
+    GSList         *galleries = NULL;
+
+    g_assert(user_data != NULL);
+    watch = user_data;
+
+    watch->timer = 0;
+
+    g_hash_table_iter_init(&iter, watch->dirty);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        const gchar *uri = key;
+        gint        what = GPOINTER_TO_INT(value);
+        gchar       *path;
+        struct data *data = NULL;
+        gboolean    opened;
+
+        /* a deleted gallery is only forgotten */
+        path = _local_path(uri);
+        if (path != NULL && !g_file_test(path, G_FILE_TEST_EXISTS)) {
+            _forget(watch, uri);
+            g_hash_table_remove(watch->galleries, uri);
+            g_free(path);
+            continue;
+        }
+        g_free(path);
+
+        opened = g_hash_table_lookup_extended(watch->galleries, uri, NULL,
+                                              (gpointer *)&data);
+        if (!opened || data == NULL || (what & PWGALLERY_WATCH_REOPEN) ||
+            !_refresh(data)) {
+            data = _reopen(watch, uri);
+        }
+
+        if (data != NULL)
+            galleries = g_slist_prepend(galleries, data);
+    }
+    g_hash_table_remove_all(watch->dirty);
+
+    /* only the changed outputs are made, thanks to the manifests */
+    regen_opened(watch->data, galleries);
+    g_slist_free(galleries);
+
+    return FALSE;
+}
+
+
+
+/*
+ * Get the local file of an uri, or NULL if not local. Plain paths are
+ * accepted too.
+ */
+static gchar *
+_local_path(const gchar *uri)
+{
+    if (g_path_is_absolute(uri))
+        return g_strdup(uri);
+
+    return g_filename_from_uri(uri, NULL, NULL);
+}
+
+#else /* HAVE_SYS_INOTIFY_H */
+
+gboolean
+watch_galleries(struct data *data, GSList *uris)
+{
+    g_warning("Watching the galleries is not supported on this system");
+
+    return FALSE;
+}
+
+#endif /* HAVE_SYS_INOTIFY_H */
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2006 Tuomas Kulve <tuomas@kulve.fi>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ */
+
+#ifndef PWGALLERY_WATCH_H
+#define PWGALLERY_WATCH_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "main.h"
+
+#include <glib.h>
+
+/* Time to wait for more changes before making the galleries, in ms */
+#define PWGALLERY_WATCH_DELAY              2000
+
+/*
+ * Watch the given galleries, or all galleries in data->gal_dir if
+ * none given, and make them again when the gallery file, one of its
+ * images or templates change. The manifest of each gallery keeps the
+ * makes incremental. Runs until killed. Returns FALSE if watching is
+ * not possible or the changes can't be read anymore.
+ */
+gboolean watch_galleries(struct data *data, GSList *uris);
+
+#endif
+
+/* Emacs indentatation information
+   Local Variables:
+   indent-tabs-mode:nil
+   tab-width:4
+   c-set-offset:4
+   c-basic-offset:4
+   End: 
+*/
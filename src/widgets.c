@@ -24,112 +24,26 @@
 #include "main.h"
 #include "widgets.h"
 #include "configrc.h"
+#include "thumbview.h"
 
 #include <glib.h>
 #include <gtk/gtk.h>
-#include <string.h>     /* memset */
+
+static void _show_button(struct data *data, const gchar *name,
+                         gboolean show);
 
 void
 widgets_update_table(struct data *data) 
 {
-    gint             listlen, current_no;
-    gint             i;
-    GSList           *list;
-	GtkWidget        *table;
-    GtkWidget        *scrolledwindow;
-    GtkAdjustment    *adjust;
-    GValue           value;
-    gdouble          t;
+    g_assert(data);
 
     if (!data->use_gui) {
         return;
     }
 
-    memset(&value, 0, sizeof(value));
-
-    g_assert(data);
-    
-    table = GTK_WIDGET(gtk_builder_get_object(data->builder, "table_thumb"));
-	g_assert(table != NULL);
-
-    listlen = g_slist_length(data->gal->images);
-
-    if (data->current_img != NULL)
-        current_no = g_slist_index(data->gal->images, data->current_img);
-    else
-        current_no = 0;
-
-    g_debug("in widgets_update_table, listlen: %d, current: %d",
-            listlen, current_no);
+    g_debug("in widgets_update_table");
 
-    if (listlen == 0)
-        return; /* nothing to todo */
-
-    gtk_widget_hide(GTK_WIDGET(table));
-    gtk_table_resize(GTK_TABLE(table), listlen, 1);
-
-    list = data->gal->images;
-
-    for( i = 0; i < listlen; ++i )
-    {
-        struct image *img;
-
-        img = list->data;
-        
-        /* FIXME: what if the current position is used already? */
-        /* remove button from gtktable before adding it again */
-        if( gtk_widget_get_parent(img->button) != NULL)
-            gtk_container_remove(GTK_CONTAINER(table), img->button);
-        
-        gtk_table_attach_defaults(GTK_TABLE(table), img->button,
-                                  0, 1, i, i + 1);
-        
-        list = list->next;
-    }
-    /* get adjustment */
-    scrolledwindow = 
-        GTK_WIDGET(gtk_builder_get_object(data->builder, "scrolledwindow_thumbnails"));
-	g_assert(scrolledwindow != NULL);
-    
-    adjust = gtk_scrolled_window_get_vadjustment(
-        GTK_SCROLLED_WINDOW(scrolledwindow));
-    g_assert(adjust);
-
-
-    /* scroll where we should be */
-    {
-        gint x;
-        gint y;
-        gint width;
-        gint height;
-        gint depth;
-        
-        t =
-            (gdouble)((current_no) / (gdouble)listlen) * 
-            ((adjust->upper - adjust->page_size ) - adjust->lower);
-    
-        
-        struct image *img =
-            g_slist_nth_data(data->gal->images, current_no);
-        
-        gdk_window_get_geometry(GDK_WINDOW(GTK_WIDGET(img->button)->window),
-                                &x,
-                                &y,
-                                &width,
-                                &height,
-                                &depth);
-        
-    
-        /* scroll thumbnails according to selected image */    
-        g_debug("in widgets_update_table: t: %.2f, wx: %d, %.2f, %.2f,%.2f",
-                t, 
-                -1 * y,
-                adjust->lower, adjust->upper, adjust->page_size);
-
-        gtk_adjustment_set_value(adjust, (gdouble)(-1 * y));
-
-    }
-    gtk_widget_show(table);
+    thumbview_update(data);
 }
 
 
@@ -189,6 +103,26 @@ widgets_set_status(struct data *data, const gchar *text)
 
 
 
+void
+widgets_show_cancel(struct data *data, gboolean show)
+{
+	g_assert(data != NULL);
+
+    _show_button(data, "button_import_cancel", show);
+}
+
+
+
+void
+widgets_show_make_cancel(struct data *data, gboolean show)
+{
+	g_assert(data != NULL);
+
+    _show_button(data, "button_make_cancel", show);
+}
+
+
+
 gchar *
 widgets_image_get_text(struct data *data)
 {
@@ -242,6 +176,7 @@ widgets_prefs_show(struct data *data)
     GtkWidget *spinbutton_pref_image_h4 = NULL;
     GtkWidget *togglebutton_pref_hideexif = NULL;
     GtkWidget *togglebutton_pref_rename = NULL;
+    GtkWidget *spinbutton_pref_index_page_size = NULL;
     gint result;
 
 	g_assert(data != NULL);
@@ -317,6 +252,8 @@ widgets_prefs_show(struct data *data)
         GTK_WIDGET(gtk_builder_get_object(data->builder, "togglebutton_pref_hideexif"));
     togglebutton_pref_rename = 
         GTK_WIDGET(gtk_builder_get_object(data->builder, "togglebutton_pref_rename"));
+    spinbutton_pref_index_page_size = 
+        GTK_WIDGET(gtk_builder_get_object(data->builder, "spinbutton_pref_index_page_size"));
 
     /* Set values */
     gtk_file_chooser_set_uri(
@@ -363,6 +300,8 @@ widgets_prefs_show(struct data *data)
                                  data->remove_exif);
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(togglebutton_pref_rename),
                                  data->rename);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(spinbutton_pref_index_page_size),
+                              (gdouble)data->index_page_size);
 
     /* show dialog (in a loop because of help dialog) */
     do
@@ -462,6 +401,9 @@ widgets_prefs_show(struct data *data)
     data->rename = gtk_toggle_button_get_active(
         GTK_TOGGLE_BUTTON(togglebutton_pref_rename));
 
+    data->index_page_size = gtk_spin_button_get_value(
+        GTK_SPIN_BUTTON(spinbutton_pref_index_page_size));
+
     /* save to disk */
     configrc_save(data);
 
@@ -492,6 +434,7 @@ widgets_gal_settings_show(struct data *data)
     GtkWidget *filechooserbutton_gal_templ_gen;
     GtkWidget *togglebutton_gal_hideexif;
     GtkWidget *togglebutton_gal_rename;
+    GtkWidget *spinbutton_gal_index_page_size;
 
     GtkTextIter end_iter;
     GtkTextIter start_iter;
@@ -558,6 +501,8 @@ widgets_gal_settings_show(struct data *data)
         GTK_WIDGET(gtk_builder_get_object(data->builder, "togglebutton_gal_hideexif"));
     togglebutton_gal_rename = 
         GTK_WIDGET(gtk_builder_get_object(data->builder, "togglebutton_gal_rename"));
+    spinbutton_gal_index_page_size = 
+        GTK_WIDGET(gtk_builder_get_object(data->builder, "spinbutton_gal_index_page_size"));
 
 
     /* Set values */
@@ -607,6 +552,8 @@ widgets_gal_settings_show(struct data *data)
                                  data->gal->remove_exif);
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(togglebutton_gal_rename),
                                  data->gal->rename);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(spinbutton_gal_index_page_size),
+                              (gdouble)data->gal->index_page_size);
 
     /* show dialog (in a loop because of help dialog) */
     do
@@ -708,6 +655,9 @@ widgets_gal_settings_show(struct data *data)
     data->gal->rename = gtk_toggle_button_get_active(
         GTK_TOGGLE_BUTTON(togglebutton_gal_rename));
 
+    data->gal->index_page_size = gtk_spin_button_get_value(
+        GTK_SPIN_BUTTON(spinbutton_gal_index_page_size));
+
     /* gallery (settings) has been now edited */
     data->gal->edited = TRUE;
 }
@@ -884,6 +834,36 @@ widgets_set_image_information(struct data *data, struct image *img)
     }
 }
 
+
+
+/**********************
+ *                    *
+ * Static functions   *
+ *                    *
+ **********************/
+
+
+/*
+ * Show or hide a button of the main window
+ */
+static void
+_show_button(struct data *data, const gchar *name, gboolean show)
+{
+	GtkWidget *button;
+
+    if (!data->use_gui) {
+        return;
+    }
+
+	button = GTK_WIDGET(gtk_builder_get_object(data->builder, name));
+	g_assert(button != NULL);
+
+    if (show)
+        gtk_widget_show(button);
+    else
+        gtk_widget_hide(button);
+}
+
 /* Emacs indentatation information
    Local Variables:
    indent-tabs-mode:nil
@@ -29,7 +29,7 @@
 
 
 /* 
- * Update thumbnail gtk table
+ * Update the thumbnail list
  */
 void widgets_update_table(struct data *data);
 
@@ -50,6 +50,16 @@ void widgets_set_image_information(struct data *data, struct image *img);
  */
 void widgets_set_status(struct data *data, const gchar *text);
 
+/*
+ * Show or hide the button cancelling adding images
+ */
+void widgets_show_cancel(struct data *data, gboolean show);
+
+/*
+ * Show or hide the button cancelling making the gallery
+ */
+void widgets_show_make_cancel(struct data *data, gboolean show);
+
 /* 
  * Get image description text. Returns newly allocated text. This
  * function must not be called if current image is not selected.
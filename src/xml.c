@@ -25,358 +25,424 @@
 #include "main.h"
 #include "image.h"
 #include "gallery.h"
+#include "vfs.h"
+#include "model.h"
 
 #include <glib.h>
 #include <string.h> // strlen
 
 #include <libxml/parser.h>
-
-
-static void parse_gal_settings(struct data *data, xmlNodePtr node);
-static struct image *parse_image_settings(struct data *data, xmlNodePtr node);
-static struct image *parse_gen_settings(struct data *data, xmlNodePtr node);
+#include <libxml/xmlreader.h>
+#include <libxml/xmlwriter.h>
+
+
+static void parse_gal_settings(struct data *data, xmlTextReaderPtr reader);
+static struct image *parse_image(struct data *data, xmlTextReaderPtr reader);
+static void parse_image_settings(struct data *data, struct image *img,
+                                 xmlTextReaderPtr reader);
+static void parse_image_meta(struct data *data, struct image *img,
+                             xmlTextReaderPtr reader);
+static gboolean _next_child(xmlTextReaderPtr reader, int depth);
+static gchar *_read_value(xmlTextReaderPtr reader);
+static int _reader_read(void *context, char *buffer, int len);
+static int _reader_close(void *context);
+static int _writer_write(void *context, const char *buffer, int len);
+static int _writer_close(void *context);
+
+/* The gallery file being written, for the output callbacks */
+struct xml_output
+{
+    struct vfs_writer *writer;         /* the file */
+    gboolean          failed;          /* closing the file failed */
+};
 
 /*
- * Create xml content for the gallery ready to be written to disk.
+ * Write the gallery xml to the uri while it is created
  */
-guchar *
-xml_gal_write(struct data *data, gsize *len)
+gboolean
+xml_gal_write(struct data *data, const gchar *uri)
 {
-    xmlDocPtr doc;
-    xmlNodePtr gallery, settings, pages, page, page_settings;
-    xmlChar *xmlbuff;
-    gchar tmp_setting[256];
-    int bufsize;
-    GSList *list;
+    xmlOutputBufferPtr out;
+    xmlTextWriterPtr writer;
+    struct xml_output output;
+    guint i;
+    int rc = 0;
 
     g_assert(data != NULL);
-    g_assert(len != NULL);
+    g_assert(uri != NULL);
 
     g_debug("in xml_gal_write");
 
     /* CHECKME: extra block to help emacs with indenting.. */
     { LIBXML_TEST_VERSION };
 
-    /* create new xml with pwgallery as the root element */
-    doc = xmlNewDoc(BAD_CAST "1.0");
-    gallery = xmlNewNode(NULL, BAD_CAST "pwgallery");
-    xmlDocSetRootElement(doc, gallery);
-
-    /* add settings node under pwgallery node */
-    settings = xmlNewNode(NULL, BAD_CAST "settings");
-    xmlAddChild(gallery, settings);
-
-    /* add settings under the settings node */
-    xmlNewChild(settings, NULL, BAD_CAST "version",
-                BAD_CAST VERSION);
-    xmlNewTextChild(settings, NULL, BAD_CAST "name",
-                    BAD_CAST data->gal->name);
-    xmlNewTextChild(settings, NULL, BAD_CAST "dir_name",
-                    BAD_CAST data->gal->dir_name);
-    xmlNewTextChild(settings, NULL, BAD_CAST "desc",
-                    BAD_CAST data->gal->desc);
-    xmlNewChild(settings, NULL, BAD_CAST "output_dir",
-                BAD_CAST data->gal->base_dir);
-    xmlNewChild(settings, NULL, BAD_CAST "page_gen_prog",
-                BAD_CAST data->gal->page_gen_prog);
-    xmlNewChild(settings, NULL, BAD_CAST "templ_index",
-                BAD_CAST data->gal->templ_index);
-    xmlNewChild(settings, NULL, BAD_CAST "templ_indeximg",
-                BAD_CAST data->gal->templ_indeximg);
-    xmlNewChild(settings, NULL, BAD_CAST "templ_indexgen",
-                BAD_CAST data->gal->templ_indexgen);
-    xmlNewChild(settings, NULL, BAD_CAST "templ_image",
-                BAD_CAST data->gal->templ_image);
-    xmlNewChild(settings, NULL, BAD_CAST "templ_gen",
-                BAD_CAST data->gal->templ_gen);
-    
-    
-    g_snprintf(tmp_setting, 256, "%d", data->gal->page_gen);
-    xmlNewChild(settings, NULL, BAD_CAST "page_gen", BAD_CAST tmp_setting);
-
-    g_snprintf(tmp_setting, 256, "%d", data->gal->thumb_w);
-    xmlNewChild(settings, NULL, BAD_CAST "thumb_w", BAD_CAST tmp_setting);
-
-    g_snprintf(tmp_setting, 256, "%d", data->gal->image_h);
-    xmlNewChild(settings, NULL, BAD_CAST "image_h", BAD_CAST tmp_setting);
-
-    g_snprintf(tmp_setting, 256, "%d", data->gal->image_h2);
-    xmlNewChild(settings, NULL, BAD_CAST "image_h2", BAD_CAST tmp_setting);
-
-    g_snprintf(tmp_setting, 256, "%d", data->gal->image_h3);
-    xmlNewChild(settings, NULL, BAD_CAST "image_h3", BAD_CAST tmp_setting);
+    output.writer = vfs_writer_new(data, uri);
+    output.failed = FALSE;
+    out = xmlOutputBufferCreateIO(_writer_write, _writer_close, &output,
+                                  NULL);
+    if (out == NULL) {
+        /* FIXME: popup */
+        g_warning("xml_gal_write: Failed to create output buffer");
+        vfs_writer_close(output.writer);
+        return FALSE;
+    }
 
-    g_snprintf(tmp_setting, 256, "%d", data->gal->image_h4);
-    xmlNewChild(settings, NULL, BAD_CAST "image_h4", BAD_CAST tmp_setting);
+    writer = xmlNewTextWriter(out);
+    if (writer == NULL) {
+        /* FIXME: popup */
+        g_warning("xml_gal_write: Failed to create writer");
+        xmlOutputBufferClose(out);
+        return FALSE;
+    }
+    xmlTextWriterSetIndent(writer, 1);
+
+    /* pwgallery as the root element */
+    rc |= xmlTextWriterStartDocument(writer, NULL, NULL, NULL);
+    rc |= xmlTextWriterStartElement(writer, BAD_CAST "pwgallery");
+
+    /* settings */
+    rc |= xmlTextWriterStartElement(writer, BAD_CAST "settings");
+
+    rc |= xmlTextWriterWriteElement(writer, BAD_CAST "version",
+                                    BAD_CAST VERSION);
+    rc |= xmlTextWriterWriteElement(writer, BAD_CAST "name",
+                                    BAD_CAST data->gal->name);
+    rc |= xmlTextWriterWriteElement(writer, BAD_CAST "dir_name",
+                                    BAD_CAST data->gal->dir_name);
+    rc |= xmlTextWriterWriteElement(writer, BAD_CAST "desc",
+                                    BAD_CAST data->gal->desc);
+    rc |= xmlTextWriterWriteElement(writer, BAD_CAST "output_dir",
+                                    BAD_CAST data->gal->base_dir);
+    rc |= xmlTextWriterWriteElement(writer, BAD_CAST "page_gen_prog",
+                                    BAD_CAST data->gal->page_gen_prog);
+    rc |= xmlTextWriterWriteElement(writer, BAD_CAST "templ_index",
+                                    BAD_CAST data->gal->templ_index);
+    rc |= xmlTextWriterWriteElement(writer, BAD_CAST "templ_indeximg",
+                                    BAD_CAST data->gal->templ_indeximg);
+    rc |= xmlTextWriterWriteElement(writer, BAD_CAST "templ_indexgen",
+                                    BAD_CAST data->gal->templ_indexgen);
+    rc |= xmlTextWriterWriteElement(writer, BAD_CAST "templ_image",
+                                    BAD_CAST data->gal->templ_image);
+    rc |= xmlTextWriterWriteElement(writer, BAD_CAST "templ_gen",
+                                    BAD_CAST data->gal->templ_gen);
+
+    rc |= xmlTextWriterWriteFormatElement(writer, BAD_CAST "page_gen",
+                                          "%d", data->gal->page_gen);
+    rc |= xmlTextWriterWriteFormatElement(writer, BAD_CAST "thumb_w",
+                                          "%d", data->gal->thumb_w);
+    rc |= xmlTextWriterWriteFormatElement(writer, BAD_CAST "image_h",
+                                          "%d", data->gal->image_h);
+    rc |= xmlTextWriterWriteFormatElement(writer, BAD_CAST "image_h2",
+                                          "%d", data->gal->image_h2);
+    rc |= xmlTextWriterWriteFormatElement(writer, BAD_CAST "image_h3",
+                                          "%d", data->gal->image_h3);
+    rc |= xmlTextWriterWriteFormatElement(writer, BAD_CAST "image_h4",
+                                          "%d", data->gal->image_h4);
 
     /* Write edited always as false */
-    xmlNewChild(settings, NULL, BAD_CAST "edited", BAD_CAST "false");
+    rc |= xmlTextWriterWriteElement(writer, BAD_CAST "edited",
+                                    BAD_CAST "false");
 
-    xmlNewChild(settings, NULL, BAD_CAST "remove_exif", 
-                BAD_CAST (data->gal->remove_exif ? "true" : "false"));
+    rc |= xmlTextWriterWriteElement(
+        writer, BAD_CAST "remove_exif",
+        BAD_CAST (data->gal->remove_exif ? "true" : "false"));
 
-    xmlNewChild(settings, NULL, BAD_CAST "rename", 
-                BAD_CAST (data->gal->rename ? "true" : "false"));
+    rc |= xmlTextWriterWriteElement(
+        writer, BAD_CAST "rename",
+        BAD_CAST (data->gal->rename ? "true" : "false"));
 
-    /* add pages node under pwgallery node */
-    pages = xmlNewNode(NULL, BAD_CAST "pages");
-    xmlAddChild(gallery, pages);
+    rc |= xmlTextWriterWriteFormatElement(writer, BAD_CAST "index_page_size",
+                                          "%d", data->gal->index_page_size);
 
-    /* add pages (images/generic) under the pages node */
-    list = data->gal->images;
-    while(list != NULL) {
-        struct image *img = list->data;
+    rc |= xmlTextWriterEndElement(writer); /* settings */
 
-        /* FIXME: how to support generic pages here? */
+    /* pages (images/generic) */
+    rc |= xmlTextWriterStartElement(writer, BAD_CAST "pages");
 
-        page = xmlNewNode(NULL, BAD_CAST "image");
-        xmlAddChild(pages, page);
-        
-        /* add page settings node under page node */
-        page_settings = xmlNewNode(NULL, BAD_CAST "settings");
-        xmlAddChild(page, page_settings);
-        
-        /* add page settings under the page settings node */
-        xmlNewTextChild(page_settings, NULL, BAD_CAST "text",
-                        BAD_CAST img->text);
+    for (i = 0; i < model_length(data->gal->model) && rc >= 0; i++) {
+        struct image *img = model_nth(data->gal->model, i);
 
-        xmlNewTextChild(page_settings, NULL, BAD_CAST "uri",
-                        BAD_CAST img->uri);
-
-        g_snprintf(tmp_setting, 256, "%f", img->gamma);
-        xmlNewChild(page_settings, NULL, BAD_CAST "gamma",
-                    BAD_CAST tmp_setting);
+        /* FIXME: how to support generic pages here? */
 
-        g_snprintf(tmp_setting, 256, "%d", img->rotate);
-        xmlNewChild(page_settings, NULL, BAD_CAST "rotate",
-                    BAD_CAST tmp_setting);
+        rc |= xmlTextWriterStartElement(writer, BAD_CAST "image");
 
-        g_snprintf(tmp_setting, 256, "%d", img->image_h);
-        xmlNewChild(page_settings, NULL, BAD_CAST "image_h",
-                    BAD_CAST tmp_setting);
+        /* page settings */
+        rc |= xmlTextWriterStartElement(writer, BAD_CAST "settings");
+        
+        rc |= xmlTextWriterWriteElement(writer, BAD_CAST "text",
+                                        BAD_CAST img->text);
+        rc |= xmlTextWriterWriteElement(writer, BAD_CAST "uri",
+                                        BAD_CAST img->uri);
+        rc |= xmlTextWriterWriteFormatElement(writer, BAD_CAST "gamma",
+                                              "%f", img->gamma);
+        rc |= xmlTextWriterWriteFormatElement(writer, BAD_CAST "rotate",
+                                              "%d", img->rotate);
+        rc |= xmlTextWriterWriteFormatElement(writer, BAD_CAST "image_h",
+                                              "%d", img->image_h);
+        rc |= xmlTextWriterWriteElement(
+            writer, BAD_CAST "nomodify",
+            BAD_CAST (img->nomodify == TRUE ? "true" : "false"));
+
+        rc |= xmlTextWriterEndElement(writer); /* settings */
+
+        /* cache the metadata of the original, valid as long as its
+         * size and mtime don't change */
+        if (img->mtime != -1 && img->width > 0 && img->height > 0) {
+            rc |= xmlTextWriterStartElement(writer, BAD_CAST "meta");
+
+            rc |= xmlTextWriterWriteFormatElement(writer, BAD_CAST "width",
+                                                  "%d", img->width);
+            rc |= xmlTextWriterWriteFormatElement(writer, BAD_CAST "height",
+                                                  "%d", img->height);
+            rc |= xmlTextWriterWriteFormatElement(writer,
+                                                  BAD_CAST "orientation",
+                                                  "%d", img->exif->orientation);
+            if (img->exif->timestamp != NULL) {
+                rc |= xmlTextWriterWriteElement(writer, BAD_CAST "timestamp",
+                                                BAD_CAST img->exif->timestamp);
+            }
+            rc |= xmlTextWriterWriteFormatElement(writer, BAD_CAST "size",
+                                                  "%" G_GINT64_FORMAT,
+                                                  (gint64)img->file_size);
+            rc |= xmlTextWriterWriteFormatElement(writer, BAD_CAST "mtime",
+                                                  "%ld", img->mtime);
 
-        g_snprintf(tmp_setting, 256, "%s", 
-                   img->nomodify == TRUE ? "true" : "false");
-        xmlNewChild(page_settings, NULL, BAD_CAST "nomodify",
-                    BAD_CAST tmp_setting);
+            rc |= xmlTextWriterEndElement(writer); /* meta */
+        }
 
-        list = list->next;
+        rc |= xmlTextWriterEndElement(writer); /* image */
     }
 
-    /* dump xml to a buffer */
-    xmlDocDumpFormatMemory(doc, &xmlbuff, &bufsize, 1);
-    *len = (gsize)bufsize;
+    /* closes pages and pwgallery and flushes to the file, and closes
+     * the file */
+    rc |= xmlTextWriterEndDocument(writer);
+    xmlFreeTextWriter(writer);
 
-    xmlFreeDoc(doc);
-    xmlCleanupParser();
+    if (rc < 0 || output.failed) {
+        /* FIXME: popup */
+        g_warning("xml_gal_write: Failed to write gallery '%s'", uri);
+        return FALSE;
+    }
 
-    return (guchar *)xmlbuff;
+    return TRUE;
 }
 
 
+
 /*
- * This parses a gallery xml file content and replaces current gallery
- * with it. The current gallery should be freshly initialized before
- * calling this function.
+ * This parses a gallery xml file and replaces current gallery with
+ * it. The file is read in parts and the image records are filled as
+ * their elements are read. The current gallery should be freshly
+ * initialized before calling this function.
  */
-void
-xml_gal_parse(struct data *data, guchar *content, gsize len)
+gboolean
+xml_gal_parse(struct data *data, const gchar *uri)
 {
     GSList *list = NULL;
-    xmlDocPtr doc;
-    xmlNodePtr gallery = NULL, pages = NULL, current = NULL;
+    struct vfs_reader *file;
+    xmlTextReaderPtr reader;
+    gboolean in_pages = FALSE;
+    int ret;
 
     g_assert(data != NULL);
-    g_assert(content != NULL);
+    g_assert(uri != NULL);
 
     g_debug("in xml_gal_parse");
 
     /* CHECKME: extra block to help emacs with indenting.. */
     { LIBXML_TEST_VERSION }
     
+    file = vfs_reader_new(data, uri);
+    if (file == NULL)
+        return FALSE;
+
     /* FIXME: XML_PARSE_NONET? XML_PARSE_NOENT? */
-    doc = xmlReadMemory((gchar*)content, len, "gallery.xml", NULL, 0);
-    if (doc == NULL) {
+    reader = xmlReaderForIO(_reader_read, _reader_close, file, uri, NULL, 0);
+    if (reader == NULL) {
         /* FIXME: popup */
         g_warning("xml_gal_parse: Failed to parse document\n");
-        return;
+        return FALSE;
     }
-    
-    /* get root and check that it matches <pwgallery> */
-    gallery = xmlDocGetRootElement(doc);
 
-    if (xmlStrcmp(gallery->name, (const xmlChar *) "pwgallery")) {
-        /* FIXME: popup */
-        g_warning("xml_gal_parse: Document of the wrong type");
-        xmlFreeDoc(doc);
-        xmlCleanupParser();
-        return;
-    }
-    
-    /* find <settings> */
-    current = gallery->xmlChildrenNode;
-    while (current != NULL) {
-        if ((!xmlStrcmp(current->name, (const xmlChar *) "settings"))) {
-            parse_gal_settings(data, current->xmlChildrenNode);
-            break;
-        }
-        current = current->next;
-    }
-    
-    /* FIXME: invalid xml. Better error handling? */
-    g_assert(current != NULL);
+    while ((ret = xmlTextReaderRead(reader)) == 1) {
+        const xmlChar *name;
+        int depth;
+
+        if (xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT)
+            continue;
+
+        name = xmlTextReaderConstName(reader);
+        depth = xmlTextReaderDepth(reader);
+
+        /* check that the root matches <pwgallery> */
+        if (depth == 0) {
+            if (xmlStrcmp(name, (const xmlChar *) "pwgallery")) {
+                /* FIXME: popup */
+                g_warning("xml_gal_parse: Document of the wrong type");
+                xmlFreeTextReader(reader);
+                return FALSE;
+            }
+            continue;
+        }
 
-    /* find subelements of <pages> */
-    while (current != NULL) {
-        if ((!xmlStrcmp(current->name, (const xmlChar *) "pages"))) {
-            pages = current->xmlChildrenNode;
-            break;
+        if (depth == 1) {
+            in_pages = !xmlStrcmp(name, (const xmlChar *) "pages");
+
+            if ((!xmlStrcmp(name, (const xmlChar *) "settings")))
+                parse_gal_settings(data, reader);
+            continue;
         }
-        current = current->next;
-    }
 
-    /* find <image> or <generic> page under <pages> */
-    while (pages != NULL) {
-        struct image *img = NULL;
-        if ((!xmlStrcmp(pages->name, (const xmlChar *) "image")))
-            img = parse_image_settings(data, pages->xmlChildrenNode);
-        else if ((!xmlStrcmp(pages->name, (const xmlChar *) "generic")))
-            img = parse_gen_settings(data, pages->xmlChildrenNode);
+        /* <image> page under <pages>. Generic pages are not supported. */
+        if (depth == 2 && in_pages &&
+            (!xmlStrcmp(name, (const xmlChar *) "image"))) {
+            struct image *img = parse_image(data, reader);
+
+            if (img != NULL)
+                list = g_slist_prepend(list, img);
+        }
+    }
 
-        /* if page found, load it to the gallery */
-        if (img != NULL)
-            list = g_slist_append(list, img);
+    xmlFreeTextReader(reader);
 
-        pages = pages->next;
+    if (ret != 0) {
+        /* FIXME: popup */
+        g_warning("xml_gal_parse: Failed to parse document\n");
+        g_slist_foreach(list, (GFunc)image_free, NULL);
+        g_slist_free(list);
+        return FALSE;
     }
-    
-    xmlFreeDoc(doc);
-    xmlCleanupParser();
 
-    gallery_open_images(data, list);
-    
+    gallery_open_images(data, g_slist_reverse(list));
+
+    return TRUE;
 }
 
 
 
-/*
- *
- * Static functions 
- *
- */
+/**********************
+ *                    *
+ * Static functions   *
+ *                    *
+ **********************/
 
 
 
-/* Parse gallery settings. The node should point to first node under
- * the settings node. */
+/* Parse gallery settings. The reader should be at the settings
+ * element. */
 static void
-parse_gal_settings(struct data *data, xmlNodePtr node)
+parse_gal_settings(struct data *data, xmlTextReaderPtr reader)
 {
+    int depth;
+
     g_assert(data != NULL);
-    g_assert(node != NULL);
+    g_assert(reader != NULL);
 
     g_debug("in parse_gal_settings");
 
+    depth = xmlTextReaderDepth(reader);
+
     /* find separate settings */
     /* FIXME: isn't this long and ugly.. */
-    while (node != NULL) {
-        if (node->type != XML_ELEMENT_NODE) {
-            node = node->next;
-            continue;
-        }
-        if ((!xmlStrcmp(node->name, (const xmlChar *) "name"))) {
+    while (_next_child(reader, depth)) {
+        const xmlChar *name = xmlTextReaderConstName(reader);
+
+        if ((!xmlStrcmp(name, (const xmlChar *) "name"))) {
             g_free(data->gal->name);
-            data->gal->name = (gchar *)xmlNodeGetContent(node);
+            data->gal->name = _read_value(reader);
         }
-        if ((!xmlStrcmp(node->name, (const xmlChar *) "dir_name"))) {
+        if ((!xmlStrcmp(name, (const xmlChar *) "dir_name"))) {
             g_free(data->gal->dir_name);
-            data->gal->dir_name = (gchar *)xmlNodeGetContent(node);
+            data->gal->dir_name = _read_value(reader);
         }
-        else if ((!xmlStrcmp(node->name, (const xmlChar *) "desc"))) {
+        else if ((!xmlStrcmp(name, (const xmlChar *) "desc"))) {
             g_free(data->gal->desc);
-            data->gal->desc = (gchar *)xmlNodeGetContent(node);
+            data->gal->desc = _read_value(reader);
         }
-        else if ((!xmlStrcmp(node->name, (const xmlChar *) "output_dir"))) {
+        else if ((!xmlStrcmp(name, (const xmlChar *) "output_dir"))) {
             g_free(data->gal->base_dir);
-            data->gal->base_dir = (gchar *)xmlNodeGetContent(node);
+            data->gal->base_dir = _read_value(reader);
         }
-        else if ((!xmlStrcmp(node->name, (const xmlChar *) "page_gen_prog"))) {
+        else if ((!xmlStrcmp(name, (const xmlChar *) "page_gen_prog"))) {
             g_free(data->gal->page_gen_prog);
-            data->gal->page_gen_prog = (gchar *)xmlNodeGetContent(node);
+            data->gal->page_gen_prog = _read_value(reader);
         }
-        else if ((!xmlStrcmp(node->name, (const xmlChar *) "templ_index"))) {
+        else if ((!xmlStrcmp(name, (const xmlChar *) "templ_index"))) {
             g_free(data->gal->templ_index);
-            data->gal->templ_index = (gchar *)xmlNodeGetContent(node);
+            data->gal->templ_index = _read_value(reader);
         }
-        else if ((!xmlStrcmp(node->name, (const xmlChar *) "templ_indeximg"))) {
+        else if ((!xmlStrcmp(name, (const xmlChar *) "templ_indeximg"))) {
             g_free(data->gal->templ_indeximg);
-            data->gal->templ_indeximg = (gchar *)xmlNodeGetContent(node);
+            data->gal->templ_indeximg = _read_value(reader);
         }
-        else if ((!xmlStrcmp(node->name, (const xmlChar *) "templ_indexgen"))) {
+        else if ((!xmlStrcmp(name, (const xmlChar *) "templ_indexgen"))) {
             g_free(data->gal->templ_indexgen);
-            data->gal->templ_indexgen = (gchar *)xmlNodeGetContent(node);
+            data->gal->templ_indexgen = _read_value(reader);
         }
-        else if ((!xmlStrcmp(node->name, (const xmlChar *) "templ_image"))) {
+        else if ((!xmlStrcmp(name, (const xmlChar *) "templ_image"))) {
             g_free(data->gal->templ_image);
-            data->gal->templ_image = (gchar *)xmlNodeGetContent(node);
+            data->gal->templ_image = _read_value(reader);
         }
-        else if ((!xmlStrcmp(node->name, (const xmlChar *) "templ_gen"))) {
+        else if ((!xmlStrcmp(name, (const xmlChar *) "templ_gen"))) {
             g_free(data->gal->templ_gen);
-            data->gal->templ_gen = (gchar *)xmlNodeGetContent(node);
+            data->gal->templ_gen = _read_value(reader);
         }
-        else if ((!xmlStrcmp(node->name, (const xmlChar *) "page_gen"))) {
-            gchar *str = (gchar *)xmlNodeGetContent(node);
+        else if ((!xmlStrcmp(name, (const xmlChar *) "page_gen"))) {
+            gchar *str = _read_value(reader);
             data->gal->page_gen = (gint) g_ascii_strtoull(str, NULL, 0);
-            xmlFree((xmlChar*)str);
+            g_free(str);
         }
-        else if ((!xmlStrcmp(node->name, (const xmlChar *) "thumb_w"))) {
-            gchar *str = (gchar *)xmlNodeGetContent(node);
+        else if ((!xmlStrcmp(name, (const xmlChar *) "thumb_w"))) {
+            gchar *str = _read_value(reader);
             data->gal->thumb_w = (gint) g_ascii_strtoull(str, NULL, 0);
-            xmlFree((xmlChar*)str);
+            g_free(str);
         }
-        else if ((!xmlStrcmp(node->name, (const xmlChar *) "image_h"))) {
-            gchar *str = (gchar *)xmlNodeGetContent(node);
+        else if ((!xmlStrcmp(name, (const xmlChar *) "image_h"))) {
+            gchar *str = _read_value(reader);
             data->gal->image_h = (gint) g_ascii_strtoull(str, NULL, 0);
-            xmlFree((xmlChar*)str);
+            g_free(str);
         }
-        else if ((!xmlStrcmp(node->name, (const xmlChar *) "image_h2"))) {
-            gchar *str = (gchar *)xmlNodeGetContent(node);
+        else if ((!xmlStrcmp(name, (const xmlChar *) "image_h2"))) {
+            gchar *str = _read_value(reader);
             data->gal->image_h2 = (gint) g_ascii_strtoull(str, NULL, 0);
-            xmlFree((xmlChar*)str);
+            g_free(str);
         }
-        else if ((!xmlStrcmp(node->name, (const xmlChar *) "image_h3"))) {
-            gchar *str = (gchar *)xmlNodeGetContent(node);
+        else if ((!xmlStrcmp(name, (const xmlChar *) "image_h3"))) {
+            gchar *str = _read_value(reader);
             data->gal->image_h3 = (gint) g_ascii_strtoull(str, NULL, 0);
-            xmlFree((xmlChar*)str);
+            g_free(str);
         }
-        else if ((!xmlStrcmp(node->name, (const xmlChar *) "image_h4"))) {
-            gchar *str = (gchar *)xmlNodeGetContent(node);
+        else if ((!xmlStrcmp(name, (const xmlChar *) "image_h4"))) {
+            gchar *str = _read_value(reader);
             data->gal->image_h4 = (gint) g_ascii_strtoull(str, NULL, 0);
-            xmlFree((xmlChar*)str);
+            g_free(str);
         }
-        else if ((!xmlStrcmp(node->name, (const xmlChar *) "edited"))) {
-            xmlChar *str = xmlNodeGetContent(node);
+        else if ((!xmlStrcmp(name, (const xmlChar *) "edited"))) {
             // Parse edited always as false
             data->gal->edited = 0;
-            xmlFree(str);
         }
-        else if ((!xmlStrcmp(node->name, (const xmlChar *) "remove_exif"))) {
-            xmlChar *str = xmlNodeGetContent(node);
-            if ((!xmlStrcmp(str, (const xmlChar *) "true")))
+        else if ((!xmlStrcmp(name, (const xmlChar *) "remove_exif"))) {
+            gchar *str = _read_value(reader);
+            if ((!strcmp(str, "true")))
                 data->gal->remove_exif = 1;
             else
                 data->gal->remove_exif = 0;
-            xmlFree(str);
+            g_free(str);
         }
-        else if ((!xmlStrcmp(node->name, (const xmlChar *) "rename"))) {
-            xmlChar *str = xmlNodeGetContent(node);
-            if ((!xmlStrcmp(str, (const xmlChar *) "true")))
+        else if ((!xmlStrcmp(name, (const xmlChar *) "rename"))) {
+            gchar *str = _read_value(reader);
+            if ((!strcmp(str, "true")))
                 data->gal->rename = 1;
             else
                 data->gal->rename = 0;
-            xmlFree(str);
+            g_free(str);
+        }
+        else if ((!xmlStrcmp(name,
+                             (const xmlChar *) "index_page_size"))) {
+            gchar *str = _read_value(reader);
+            data->gal->index_page_size = (gint) g_ascii_strtoull(str, NULL, 0);
+            g_free(str);
         }
-        node = node->next;
     }
 
     /* concatenate the actual output dir */
@@ -387,117 +453,247 @@ parse_gal_settings(struct data *data, xmlNodePtr node)
 }
 
 
-/* Parse image settings. */
+
+/* Parse an image page to a new image record. The reader should be at
+ * the image element. */
 static struct image *
-parse_image_settings(struct data *data, xmlNodePtr node)
+parse_image(struct data *data, xmlTextReaderPtr reader)
 {
     struct image *img;
+    gboolean settings_found = FALSE;
+    int depth;
 
     g_assert(data != NULL);
-    g_assert(node != NULL);
+    g_assert(reader != NULL);
 
-    g_debug("in parse_image_settings");
+    g_debug("in parse_image");
+
+    img = image_init(data);
+
+    depth = xmlTextReaderDepth(reader);
+
+    /* <settings> and the optional <meta> element */
+    while (_next_child(reader, depth)) {
+        const xmlChar *name = xmlTextReaderConstName(reader);
 
-    /* find <settings> element's children node */
-    while (node != NULL) {
-        if ((!xmlStrcmp(node->name, (const xmlChar *) "settings"))) {
-            node = node->xmlChildrenNode;
-            break;
+        if ((!xmlStrcmp(name, (const xmlChar *) "settings"))) {
+            parse_image_settings(data, img, reader);
+            settings_found = TRUE;
+        }
+        else if ((!xmlStrcmp(name, (const xmlChar *) "meta"))) {
+            parse_image_meta(data, img, reader);
         }
-        node = node->next;
     }
 
     /* FIXME: invalid xml. Better error handling? */
-    g_assert(node != NULL);
+    if (!settings_found) {
+        g_warning("parse_image: image without settings");
+        image_free(img);
+        return NULL;
+    }
+
+    return img;
+}
 
-    img = image_init(data);
+
+
+/* Parse image settings. The reader should be at the settings
+ * element. */
+static void
+parse_image_settings(struct data *data, struct image *img,
+                     xmlTextReaderPtr reader)
+{
+    int depth;
+
+    g_assert(data != NULL);
+    g_assert(img != NULL);
+    g_assert(reader != NULL);
+
+    g_debug("in parse_image_settings");
+
+    depth = xmlTextReaderDepth(reader);
 
     /* find values */
-    while (node != NULL) {/* uri, text, gamma, rotate, nomod */
-        if (node->type != XML_ELEMENT_NODE) {
-            node = node->next;
-            continue;
-        }
-        if ((!xmlStrcmp(node->name, (const xmlChar *) "uri"))) {   
+    while (_next_child(reader, depth)) {/* uri, text, gamma, rotate, nomod */
+        const xmlChar *name = xmlTextReaderConstName(reader);
+
+        if ((!xmlStrcmp(name, (const xmlChar *) "uri"))) {   
             g_free(img->uri);
-            img->uri = (gchar *)xmlNodeGetContent(node);
+            img->uri = _read_value(reader);
         }
-        else if ((!xmlStrcmp(node->name, (const xmlChar *) "text"))) {
+        else if ((!xmlStrcmp(name, (const xmlChar *) "text"))) {
             g_free(img->text);
-            img->text = (gchar *)xmlNodeGetContent(node);
+            img->text = _read_value(reader);
         }
-        else if ((!xmlStrcmp(node->name, (const xmlChar *) "gamma"))) {
-            gchar *tmpstr = (gchar *)xmlNodeGetContent(node);
+        else if ((!xmlStrcmp(name, (const xmlChar *) "gamma"))) {
+            gchar *tmpstr = _read_value(reader);
             if (strlen(tmpstr) == 0) {
                 img->gamma = 1;
             } else {
                 img->gamma = (gfloat)g_ascii_strtod(tmpstr, NULL);
             }
-            xmlFree((xmlChar*)tmpstr);
+            g_free(tmpstr);
         }
-        else if ((!xmlStrcmp(node->name, (const xmlChar *) "rotate"))) {
-            gchar *tmpstr = (gchar *)xmlNodeGetContent(node);
+        else if ((!xmlStrcmp(name, (const xmlChar *) "rotate"))) {
+            gchar *tmpstr = _read_value(reader);
             img->rotate = (gint)g_ascii_strtoull(tmpstr, NULL, 0);
-            xmlFree((xmlChar*)tmpstr);
+            g_free(tmpstr);
         }
-        else if ((!xmlStrcmp(node->name, (const xmlChar *) "image_h"))) {
-            gchar *tmpstr = (gchar *)xmlNodeGetContent(node);
+        else if ((!xmlStrcmp(name, (const xmlChar *) "image_h"))) {
+            gchar *tmpstr = _read_value(reader);
             img->image_h = (gint)g_ascii_strtoull(tmpstr, NULL, 0);
-            xmlFree((xmlChar*)tmpstr);
+            g_free(tmpstr);
         }
-        else if ((!xmlStrcmp(node->name, (const xmlChar *) "nomodify"))) {
-            xmlChar *tmpstr = xmlNodeGetContent(node);
-            if ((!xmlStrcmp(tmpstr, (const xmlChar *) "true")))
+        else if ((!xmlStrcmp(name, (const xmlChar *) "nomodify"))) {
+            gchar *tmpstr = _read_value(reader);
+            if ((!strcmp(tmpstr, "true")))
                 img->nomodify = TRUE;
             else
                 img->nomodify = FALSE;
-            xmlFree((xmlChar*)tmpstr);
+            g_free(tmpstr);
         }
-        node = node->next;
     }
-
-    return img;
 }
 
 
-/* FIXME: will this be the same as the above actually..? or does this
- * create struct image too but with default values except for the
- * text? */
-/* Parse generic page settings. */
-static struct image *
-parse_gen_settings(struct data *data, xmlNodePtr node)
+
+/* Parse the cached metadata of an image. The reader should be at the
+ * meta element. */
+static void
+parse_image_meta(struct data *data, struct image *img,
+                 xmlTextReaderPtr reader)
 {
+    int depth;
+
     g_assert(data != NULL);
-    g_assert(node != NULL);
+    g_assert(img != NULL);
+    g_assert(reader != NULL);
 
-    g_debug("in parse_gen_settings");
+    g_debug("in parse_image_meta");
 
-    /* find <settings> element's children node */
-    while (node != NULL) {
-        if (node->type != XML_ELEMENT_NODE) {
-            node = node->next;
-            continue;
+    depth = xmlTextReaderDepth(reader);
+
+    while (_next_child(reader, depth)) {/* width, height, orientation, ... */
+        const xmlChar *name = xmlTextReaderConstName(reader);
+        gchar *tmpstr;
+
+        tmpstr = _read_value(reader);
+        if ((!xmlStrcmp(name, (const xmlChar *) "width"))) {
+            img->width = (gint)g_ascii_strtoull(tmpstr, NULL, 0);
+        }
+        else if ((!xmlStrcmp(name, (const xmlChar *) "height"))) {
+            img->height = (gint)g_ascii_strtoull(tmpstr, NULL, 0);
+        }
+        else if ((!xmlStrcmp(name, (const xmlChar *) "orientation"))) {
+            img->exif->orientation = (gint)g_ascii_strtoull(tmpstr, NULL, 0);
         }
-        if ((!xmlStrcmp(node->name, (const xmlChar *) "settings"))) {
-            node = node->xmlChildrenNode;
-            break;
+        else if ((!xmlStrcmp(name, (const xmlChar *) "timestamp"))) {
+            g_free(img->exif->timestamp);
+            img->exif->timestamp = g_strdup(tmpstr);
         }
-        node = node->next;
+        else if ((!xmlStrcmp(name, (const xmlChar *) "size"))) {
+            img->file_size = (goffset)g_ascii_strtoll(tmpstr, NULL, 0);
+        }
+        else if ((!xmlStrcmp(name, (const xmlChar *) "mtime"))) {
+            img->mtime = (glong)g_ascii_strtoll(tmpstr, NULL, 0);
+        }
+        g_free(tmpstr);
     }
+}
 
-    /* FIXME: invalid xml. Better error handling? */
-    g_assert(node != NULL);
 
-    /* find settings */
-    while (node != NULL) {
-        if (node->type != XML_ELEMENT_NODE) {
-            node = node->next;
-            continue;
-        }
-        node = node->next;
+
+/*
+ * Move the reader to the next child element of the element at depth.
+ * Returns FALSE when the element ends or on error.
+ */
+static gboolean
+_next_child(xmlTextReaderPtr reader, int depth)
+{
+    /* <element/> has no children nor end */
+    if (xmlTextReaderDepth(reader) == depth &&
+        xmlTextReaderNodeType(reader) == XML_READER_TYPE_ELEMENT &&
+        xmlTextReaderIsEmptyElement(reader))
+        return FALSE;
+
+    while (xmlTextReaderRead(reader) == 1) {
+        int type = xmlTextReaderNodeType(reader);
+        int node_depth = xmlTextReaderDepth(reader);
+
+        if (type == XML_READER_TYPE_END_ELEMENT && node_depth == depth)
+            return FALSE;
+        if (type == XML_READER_TYPE_ELEMENT && node_depth == depth + 1)
+            return TRUE;
     }
-    
-    return NULL;
+
+    return FALSE;
+}
+
+
+
+/*
+ * Get the text content of the current element, empty if none
+ */
+static gchar *
+_read_value(xmlTextReaderPtr reader)
+{
+    xmlChar *value;
+    gchar *str;
+
+    value = xmlTextReaderReadString(reader);
+    str = g_strdup(value != NULL ? (gchar *)value : "");
+    xmlFree(value);
+
+    return str;
+}
+
+
+
+/*
+ * Input callbacks for reading the gallery file through gnome-vfs
+ */
+static int
+_reader_read(void *context, char *buffer, int len)
+{
+    return (int)vfs_reader_read(context, (guchar *)buffer, (gsize)len);
+}
+
+
+
+static int
+_reader_close(void *context)
+{
+    vfs_reader_close(context);
+    return 0;
+}
+
+
+
+/*
+ * Output callbacks for writing the gallery file through gnome-vfs
+ */
+static int
+_writer_write(void *context, const char *buffer, int len)
+{
+    struct xml_output *output = context;
+
+    vfs_writer_write(output->writer, (const guchar *)buffer, (gsize)len);
+    return len;
+}
+
+
+
+static int
+_writer_close(void *context)
+{
+    struct xml_output *output = context;
+
+    /* the result of the close callback is not passed on by libxml */
+    if (!vfs_writer_close(output->writer)) {
+        output->failed = TRUE;
+        return -1;
+    }
+    return 0;
 }
 
 